@@ -7,6 +7,12 @@
 #include "Thread.h"
 #include "File.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 using namespace Log;
 
 std::unique_ptr<LogManager> g_log_manager;
@@ -124,10 +130,161 @@ struct FileListener : LogListener
 	}
 };
 
-LogManager::LogManager() 
-#ifdef BUFFERED_LOGGING
-	: mExiting(false), mLogConsumer()
+LogBuffer::LogBuffer()
+	: head(0)
+	, tail(0)
+	, owned(false)
+	, thread(nullptr)
+	, thread_valid(false)
+{
+}
+
+thread_local LogBuffer* g_tls_log_buffer = nullptr;
+
+// called on exit of the thread owning the buffer (including threads not derived from NamedThreadBase)
+#ifdef _WIN32
+static void NTAPI free_exited_thread_buffer(void* buffer)
+#else
+static void free_exited_thread_buffer(void* buffer)
 #endif
+{
+	if (buffer && g_log_manager)
+	{
+		g_log_manager->freeBuffer(static_cast<LogBuffer*>(buffer));
+	}
+}
+
+#ifdef _WIN32
+static const DWORD g_log_buffer_key = FlsAlloc(free_exited_thread_buffer);
+#else
+static pthread_key_t create_log_buffer_key()
+{
+	pthread_key_t key;
+	pthread_key_create(&key, free_exited_thread_buffer);
+	return key;
+}
+
+static const pthread_key_t g_log_buffer_key = create_log_buffer_key();
+#endif
+
+static void set_exit_buffer(LogBuffer* buffer)
+{
+#ifdef _WIN32
+	FlsSetValue(g_log_buffer_key, buffer);
+#else
+	pthread_setspecific(g_log_buffer_key, buffer);
+#endif
+}
+
+std::atomic<u64> g_log_seq(1);
+
+__forceinline u32 record_size(u32 args_size)
+{
+	// align to 8 bytes
+	return (sizeof(LogRecord) + args_size + 7) & ~7;
+}
+
+LogRecord* reserve_record(LogBuffer& buffer, u32 args_size)
+{
+	const u32 size = record_size(args_size);
+	const u64 head = buffer.head.load(std::memory_order_relaxed);
+	const u32 pos = head % LogBuffer::size;
+
+	// records never wrap, the rest of the buffer is skipped with a padding record
+	const u32 skip = pos + size > LogBuffer::size ? LogBuffer::size - pos : 0;
+
+	// wait until the consumer frees enough space
+	if (head + skip + size - buffer.tail.load(std::memory_order_acquire) > LogBuffer::size)
+	{
+		g_log_manager->waitConsumed(&buffer, head + skip + size - LogBuffer::size);
+	}
+
+	if (skip)
+	{
+		auto& padding = *reinterpret_cast<LogRecord*>(buffer.data + pos);
+		padding.size = skip;
+		padding.kind = LogRecordPadding;
+		buffer.head.store(head + skip, std::memory_order_release);
+	}
+
+	auto& record = *reinterpret_cast<LogRecord*>(buffer.data + (head + skip) % LogBuffer::size);
+	record.size = size;
+	record.seq = 0;
+	record.fmt = nullptr;
+	record.formatter = nullptr;
+	return &record;
+}
+
+LogRecord* Log::begin_record(u32 args_size)
+{
+	// too big records are written synchronously
+	if (!g_log_manager || record_size(args_size) > LogBuffer::size / 4)
+	{
+		return nullptr;
+	}
+
+	if (!g_tls_log_buffer)
+	{
+		g_tls_log_buffer = g_log_manager->getBuffer();
+		set_exit_buffer(g_tls_log_buffer);
+	}
+
+	auto& buffer = *g_tls_log_buffer;
+
+	// write the name of the thread if it's changed since the last record
+	const auto thread = GetCurrentNamedThread();
+
+	if (!buffer.thread_valid || buffer.thread != thread)
+	{
+		const std::string name = thread ? thread->GetThreadName() : "";
+		const u32 name_size = std::min<u32>((u32)name.size() + 1, 256);
+
+		auto record = reserve_record(buffer, name_size);
+		record->kind = LogRecordThread;
+		memcpy(record->args(), name.c_str(), name_size - 1);
+		record->args()[name_size - 1] = 0;
+		buffer.head.store(buffer.head.load(std::memory_order_relaxed) + record->size, std::memory_order_release);
+
+		buffer.thread = thread;
+		buffer.thread_valid = true;
+	}
+
+	return reserve_record(buffer, args_size);
+}
+
+void Log::end_record(LogRecord* record)
+{
+	auto& buffer = *g_tls_log_buffer;
+	const bool sync = record->severity >= LogSeverityError;
+
+	record->seq = g_log_seq++;
+	buffer.head.store(buffer.head.load(std::memory_order_relaxed) + record->size, std::memory_order_release);
+
+	g_log_manager->wakeConsumer();
+
+	// errors are written before returning, so they aren't lost on crash and aren't reordered with later records
+	if (sync && !g_log_manager->isConsumerThread())
+	{
+		g_log_manager->flush(&buffer);
+	}
+}
+
+void Log::free_thread_buffer()
+{
+	if (g_tls_log_buffer && g_log_manager)
+	{
+		g_log_manager->freeBuffer(g_tls_log_buffer);
+	}
+
+	g_tls_log_buffer = nullptr;
+	set_exit_buffer(nullptr);
+}
+
+LogManager::LogManager() 
+	: mSleeping(false)
+	, mExiting(false)
+	, mSpaceWaiters(0)
+	, mLogConsumer()
 {
 	auto it = mChannels.begin();
 	std::shared_ptr<LogListener> listener(new FileListener());
@@ -139,44 +296,231 @@ LogManager::LogManager()
 	}
 	std::shared_ptr<LogListener> TTYListener(new FileListener("TTY",false));
 	getChannel(TTY).addListener(TTYListener);
-#ifdef BUFFERED_LOGGING
 	mLogConsumer = std::thread(&LogManager::consumeLog, this);
-#endif
 }
 
 LogManager::~LogManager()
 {
-#ifdef BUFFERED_LOGGING
-	mExiting = true;
+	{
+		std::lock_guard<std::mutex> lock(mStatusMut);
+		mExiting = true;
+	}
+
 	mBufferReady.notify_all();
 	mLogConsumer.join();
+
+	{
+		std::lock_guard<std::mutex> lock(mSpaceMut);
+	}
+
+	mSpaceReady.notify_all();
+}
+
+LogBuffer* LogManager::getBuffer()
+{
+	std::lock_guard<std::mutex> lock(mBufferLock);
+
+	// reuse a buffer released by another thread
+	for (auto& buffer : mBuffers)
+	{
+		if (!buffer->owned.exchange(true))
+		{
+			buffer->thread_valid = false;
+			return buffer.get();
+		}
+	}
+
+	mBuffers.emplace_back(new LogBuffer);
+	mBuffers.back()->owned = true;
+	return mBuffers.back().get();
+}
+
+void LogManager::freeBuffer(LogBuffer* buffer)
+{
+	std::lock_guard<std::mutex> lock(mBufferLock);
+
+	buffer->owned = false;
+}
+
+void LogManager::wakeConsumer()
+{
+	if (mSleeping && mSleeping.exchange(false))
+	{
+		std::lock_guard<std::mutex> lock(mStatusMut);
+
+		mBufferReady.notify_one();
+	}
+}
+
+bool LogManager::isConsumerThread() const
+{
+	return std::this_thread::get_id() == mLogConsumer.get_id();
+}
+
+void LogManager::waitConsumed(LogBuffer* buffer, u64 pos)
+{
+	std::unique_lock<std::mutex> lock(mSpaceMut);
+
+	mSpaceWaiters++;
+
+	// the consumer checks mSpaceWaiters after advancing the tail
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	while (buffer->tail.load(std::memory_order_acquire) < pos && !mExiting)
+	{
+		wakeConsumer();
+		mSpaceReady.wait(lock);
+	}
+
+	mSpaceWaiters--;
+}
+
+void LogManager::flush(LogBuffer* buffer)
+{
+	if (buffer->tail.load(std::memory_order_acquire) != buffer->head.load(std::memory_order_relaxed))
+	{
+		waitConsumed(buffer, buffer->head.load(std::memory_order_relaxed));
+	}
 }
 
 void LogManager::consumeLog()
 {
-	std::unique_lock<std::mutex> lock(mStatusMut);
-	while (!mExiting)
+	SetCurrentThreadDebugName("Log Consumer");
+
+	while (true)
 	{
+		if (consumeRecords())
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mStatusMut);
+
+		if (mExiting)
+		{
+			break;
+		}
+
+		mSleeping = true;
+
+		// check again after setting the flag, producers only notify the sleeping consumer
+		if (consumeRecords())
+		{
+			mSleeping = false;
+			continue;
+		}
+
 		mBufferReady.wait(lock);
-		mBuffer.lockGet();
-		size_t size = mBuffer.size();
-		std::vector<char> local_messages(size);
-		mBuffer.popN(&local_messages.front(), size);
-		mBuffer.unlockGet();
-
-		u32 cursor = 0;
-		u32 removed = 0;
-		while (cursor < size)
+		mSleeping = false;
+	}
+
+	consumeRecords();
+}
+
+bool LogManager::consumeRecords()
+{
+	std::vector<LogBuffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(mBufferLock);
+
+		for (auto& buffer : mBuffers)
 		{
-			Log::LogMessage msg = Log::LogMessage::deserialize(local_messages.data() + cursor, &removed);
-			cursor += removed;
-			getChannel(msg.mType).log(msg);
+			buffers.push_back(buffer.get());
 		}
 	}
-#endif
+
+	// records available at the moment
+	std::vector<u64> heads(buffers.size());
+
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		heads[i] = buffers[i]->head.load(std::memory_order_acquire);
+	}
+
+	bool consumed = false;
+
+	// merge the buffers by the sequence number of the records
+	while (true)
+	{
+		LogBuffer* next = nullptr;
+		LogRecord* next_record = nullptr;
+
+		for (size_t i = 0; i < buffers.size(); i++)
+		{
+			auto& buffer = *buffers[i];
+
+			while (buffer.tail.load(std::memory_order_relaxed) != heads[i])
+			{
+				const u64 tail = buffer.tail.load(std::memory_order_relaxed);
+				auto& record = *reinterpret_cast<LogRecord*>(buffer.data + tail % LogBuffer::size);
+
+				if (record.kind == LogRecordPadding)
+				{
+					buffer.tail.store(tail + record.size, std::memory_order_release);
+				}
+				else if (record.kind == LogRecordThread)
+				{
+					buffer.thread_name = reinterpret_cast<const char*>(record.args());
+					buffer.tail.store(tail + record.size, std::memory_order_release);
+				}
+				else
+				{
+					if (!next_record || record.seq < next_record->seq)
+					{
+						next = &buffer;
+						next_record = &record;
+					}
+
+					break;
+				}
+			}
+		}
+
+		if (!next)
+		{
+			// wake producers waiting for space in their buffers
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (consumed && mSpaceWaiters)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mSpaceMut);
+				}
+
+				mSpaceReady.notify_all();
+			}
+
+			return consumed;
+		}
+
+		logRecord(*next, *next_record);
+		next->tail.store(next->tail.load(std::memory_order_relaxed) + next_record->size, std::memory_order_release);
+		consumed = true;
+	}
 }
 
-void LogManager::log(LogMessage msg)
+void LogManager::logRecord(LogBuffer& buffer, LogRecord& record)
+{
+	LogMessage msg;
+	msg.mType = static_cast<LogType>(record.type);
+	msg.mServerity = static_cast<LogSeverity>(record.severity);
+
+	if (record.kind == LogRecordText)
+	{
+		u32 length;
+		memcpy(&length, record.args(), sizeof(u32));
+		msg.mText.assign(reinterpret_cast<const char*>(record.args() + sizeof(u32)), length);
+	}
+	else
+	{
+		msg.mText = record.formatter(record.fmt, record.args());
+	}
+
+	addPrefix(msg, buffer.thread_name);
+	mChannels[record.type].log(msg);
+}
+
+void LogManager::addPrefix(LogMessage& msg, const std::string& thread_name)
 {
 	//don't do any formatting changes or filtering to the TTY output since we
 	//use the raw output to do diffs with the output of a real PS3 and some
@@ -199,22 +543,39 @@ void LogManager::log(LogMessage msg)
 			prefix = "E ";
 			break;
 		}
-		if (NamedThreadBase* thr = GetCurrentNamedThread())
+		if (thread_name.size())
 		{
-			prefix += "{" + thr->GetThreadName() + "} ";
+			prefix += "{" + thread_name + "} ";
 		}
 		msg.mText.insert(0, prefix);
 		msg.mText.append(1,'\n');
 	}
-#ifdef BUFFERED_LOGGING
-	size_t size = msg.size();
-	std::vector<char> temp_buffer(size);
-	msg.serialize(temp_buffer.data());
-	mBuffer.pushRange(temp_buffer.begin(), temp_buffer.end());
-	mBufferReady.notify_one();
-#else
+}
+
+void LogManager::log(LogMessage msg)
+{
+	const u32 length = (u32)msg.mText.size();
+
+	if (Log::LogRecord* record = Log::begin_record(sizeof(u32) + length))
+	{
+		record->kind = LogRecordText;
+		record->type = msg.mType;
+		record->severity = msg.mServerity;
+		memcpy(record->args(), &length, sizeof(u32));
+		memcpy(record->args() + sizeof(u32), msg.mText.data(), length);
+		Log::end_record(record);
+		return;
+	}
+
+	// big messages are logged synchronously after the records already written by this thread
+	if (g_tls_log_buffer)
+	{
+		flush(g_tls_log_buffer);
+	}
+
+	const auto thread = GetCurrentNamedThread();
+	addPrefix(msg, thread ? thread->GetThreadName() : "");
 	mChannels[static_cast<u32>(msg.mType)].log(msg);
-#endif
 }
 
 void LogManager::addListener(std::shared_ptr<LogListener> listener)
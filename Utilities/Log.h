@@ -1,7 +1,7 @@
 #pragma once
 #include "Utilities/MTRingbuffer.h"
 
-//#define BUFFERED_LOGGING 1
+class NamedThreadBase;
 
 //first parameter is of type Log::LogType and text is of type std::string
 
@@ -91,6 +91,168 @@ namespace Log
 		std::set<std::shared_ptr<LogListener>> mListeners;
 	};
 
+	enum LogRecordKind : u8
+	{
+		LogRecordPadding = 0, // unused space at the end of the buffer
+		LogRecordThread, // name of the thread which writes the following records
+		LogRecordText, // preformatted text (length and characters)
+		LogRecordFormat, // format string and binary arguments
+	};
+
+	// binary log record header, it's followed by the arguments (aligned to 8 bytes)
+	struct LogRecord
+	{
+		u32 size; // total size of the record
+		LogRecordKind kind;
+		u8 type; // LogType
+		u8 severity; // LogSeverity
+		u8 reserved;
+		u64 seq; // global order of the records
+		const char* fmt; // format ID (format string)
+		std::string(*formatter)(const char* fmt, const u8* args);
+
+		u8* args()
+		{
+			return reinterpret_cast<u8*>(this + 1);
+		}
+	};
+
+	// per-thread single-producer single-consumer buffer for log records
+	struct LogBuffer
+	{
+		static const u32 size = 64 * 1024;
+
+		std::atomic<u64> head; // written by the owner thread
+		std::atomic<u64> tail; // written by the consumer thread
+		std::atomic<bool> owned;
+
+		NamedThreadBase* thread; // thread for which the last LogRecordThread was written
+		bool thread_valid;
+
+		std::string thread_name; // consumer side
+
+		alignas(8) u8 data[size];
+
+		LogBuffer();
+	};
+
+	// get contiguous space for the record in the buffer of the current thread (returns nullptr if unavailable)
+	LogRecord* begin_record(u32 args_size);
+
+	// publish the record
+	void end_record(LogRecord* record);
+
+	// release the buffer of the current thread (called when a named thread exits, other threads release it automatically)
+	void free_thread_buffer();
+
+	// argument serialization for LogRecordFormat (trivially copyable types are stored as is)
+	template<typename T> struct LogArg
+	{
+		static_assert(std::is_pod<T>::value, "Invalid log argument type");
+
+		static u32 size(const T& arg)
+		{
+			return sizeof(T);
+		}
+
+		static void write(u8*& out, const T& arg)
+		{
+			memcpy(out, &arg, sizeof(T));
+			out += sizeof(T);
+		}
+
+		static T read(const u8*& in)
+		{
+			T result;
+			memcpy(&result, in, sizeof(T));
+			in += sizeof(T);
+			return result;
+		}
+	};
+
+	// strings are copied into the record
+	template<> struct LogArg<const char*>
+	{
+		static u32 size(const char* arg)
+		{
+			return sizeof(u32) + (arg ? (u32)strlen(arg) + 1 : 0);
+		}
+
+		static void write(u8*& out, const char* arg)
+		{
+			const u32 len = arg ? (u32)strlen(arg) + 1 : 0;
+			memcpy(out, &len, sizeof(u32));
+			memcpy(out + sizeof(u32), arg, len);
+			out += sizeof(u32) + len;
+		}
+
+		static const char* read(const u8*& in)
+		{
+			u32 len;
+			memcpy(&len, in, sizeof(u32));
+			const char* result = len ? reinterpret_cast<const char*>(in + sizeof(u32)) : nullptr;
+			in += sizeof(u32) + len;
+			return result;
+		}
+	};
+
+	template<> struct LogArg<char*> : LogArg<const char*>
+	{
+	};
+
+	template<typename... Args> struct LogArgs;
+
+	template<> struct LogArgs<>
+	{
+		static u32 size()
+		{
+			return 0;
+		}
+
+		static void write(u8*& out)
+		{
+		}
+
+		template<typename... Done> static std::string unpack(const char* fmt, const u8* in, Done... done)
+		{
+			return fmt::Format(fmt, done...);
+		}
+	};
+
+	template<typename T, typename... Args> struct LogArgs<T, Args...>
+	{
+		static u32 size(const T& arg, const Args&... args)
+		{
+			return LogArg<T>::size(arg) + LogArgs<Args...>::size(args...);
+		}
+
+		static void write(u8*& out, const T& arg, const Args&... args)
+		{
+			LogArg<T>::write(out, arg);
+			LogArgs<Args...>::write(out, args...);
+		}
+
+		// read the arguments in order and format them
+		template<typename... Done> static std::string unpack(const char* fmt, const u8* in, Done... done)
+		{
+			const T arg = LogArg<T>::read(in);
+			return LogArgs<Args...>::unpack(fmt, in, done..., arg);
+		}
+	};
+
+	template<typename... Args> std::string format_record(const char* fmt, const u8* args)
+	{
+		return LogArgs<Args...>::unpack(fmt, args);
+	}
+
+	// the record starts with two strings which are prepended to the formatted text
+	template<typename... Args> std::string format_prefixed_record(const char* fmt, const u8* args)
+	{
+		std::string result = LogArg<const char*>::read(args);
+		result += LogArg<const char*>::read(args);
+		return result + LogArgs<Args...>::unpack(fmt, args);
+	}
+
 	struct LogManager
 	{
 		LogManager();
@@ -100,17 +262,28 @@ namespace Log
 		void log(LogMessage msg);
 		void addListener(std::shared_ptr<LogListener> listener);
 		void removeListener(std::shared_ptr<LogListener> listener);
-#ifdef BUFFERED_LOGGING
-		void consumeLog();
-#endif
+		LogBuffer* getBuffer();
+		void freeBuffer(LogBuffer* buffer);
+		void wakeConsumer();
+		// park until the consumer has read the buffer up to the position
+		void waitConsumed(LogBuffer* buffer, u64 pos);
+		void flush(LogBuffer* buffer);
+		bool isConsumerThread() const;
 	private:
-#ifdef BUFFERED_LOGGING
-		MTRingbuffer<char, MAX_LOG_BUFFER_LENGTH> mBuffer;
+		void consumeLog();
+		bool consumeRecords();
+		void logRecord(LogBuffer& buffer, LogRecord& record);
+		static void addPrefix(LogMessage& msg, const std::string& thread_name);
+		std::mutex mBufferLock;
+		std::vector<std::unique_ptr<LogBuffer>> mBuffers;
 		std::condition_variable mBufferReady;
 		std::mutex mStatusMut;
+		std::atomic<bool> mSleeping;
 		std::atomic<bool> mExiting;
+		std::condition_variable mSpaceReady; // notified by the consumer after reading records if producers wait
+		std::mutex mSpaceMut;
+		std::atomic<u32> mSpaceWaiters;
 		std::thread mLogConsumer;
-#endif
 		std::array<LogChannel, std::tuple_size<decltype(gTypeNameTable)>::value> mChannels;
 		//std::array<LogChannel,gTypeNameTable.size()> mChannels; //TODO: use this once Microsoft sorts their shit out
 	};
@@ -129,8 +302,52 @@ static struct { inline operator Log::LogType() { return Log::LogType::TTY; } } T
 void log_message(Log::LogType type, Log::LogSeverity sev, const char* text);
 void log_message(Log::LogType type, Log::LogSeverity sev, std::string text);
 
-template<typename... Targs> 
-__noinline void log_message(Log::LogType type, Log::LogSeverity sev, const char* fmt, Targs... args)
+template<typename... Targs>
+__noinline void log_record(Log::LogType type, Log::LogSeverity sev, const char* fmt, Targs... args)
+{
+	// store the format ID and arguments, they are formatted later by the log consumer thread
+	if (Log::LogRecord* record = Log::begin_record(Log::LogArgs<Targs...>::size(args...)))
+	{
+		record->kind = Log::LogRecordFormat;
+		record->type = type;
+		record->severity = sev;
+		record->fmt = fmt;
+		record->formatter = &Log::format_record<Targs...>;
+
+		u8* out = record->args();
+		Log::LogArgs<Targs...>::write(out, args...);
+		Log::end_record(record);
+	}
+	else
+	{
+		log_message(type, sev, fmt::Format(fmt, args...));
+	}
+}
+
+// same as log_record(), but the text is prefixed with name and separator (which must not be null)
+template<typename... Targs>
+__noinline void log_record_prefixed(Log::LogType type, Log::LogSeverity sev, const char* name, const char* sep, const char* fmt, Targs... args)
+{
+	if (Log::LogRecord* record = Log::begin_record(Log::LogArgs<const char*, const char*, Targs...>::size(name, sep, args...)))
+	{
+		record->kind = Log::LogRecordFormat;
+		record->type = type;
+		record->severity = sev;
+		record->fmt = fmt;
+		record->formatter = &Log::format_prefixed_record<Targs...>;
+
+		u8* out = record->args();
+		Log::LogArgs<const char*, const char*, Targs...>::write(out, name, sep, args...);
+		Log::end_record(record);
+	}
+	else
+	{
+		log_message(type, sev, std::string(name) + sep + fmt::Format(fmt, args...));
+	}
+}
+
+template<typename... Targs>
+__forceinline void log_message(Log::LogType type, Log::LogSeverity sev, const char* fmt, Targs... args)
 {
-	log_message(type, sev, fmt::Format(fmt, fmt::do_unveil(args)...));
+	log_record(type, sev, fmt, fmt::do_unveil(args)...);
 }
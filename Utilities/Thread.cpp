@@ -19,6 +19,12 @@
 #include <ucontext.h>
 #endif
 
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
 void SetCurrentThreadDebugName(const char* threadName)
 {
 #if defined(_MSC_VER) // this is VS-specific way to set thread names for the debugger
@@ -1168,6 +1174,11 @@ void SetCurrentNamedThread(NamedThreadBase* value)
 		vm::reservation_free();
 	}
 
+	if (!value)
+	{
+		Log::free_thread_buffer();
+	}
+
 	if (value && value->m_tls_assigned.exchange(true))
 	{
 		LOG_ERROR(GENERAL, "Thread '%s' was already assigned to g_tls_this_thread of another thread", value->GetThreadName());
@@ -1478,6 +1489,223 @@ bool waiter_map_t::is_stopped(u64 signal_id)
 	return false;
 }
 
+struct waiter_bucket_t
+{
+	std::mutex mutex;
+	std::vector<waiter_record_t*> waiters;
+};
+
+// waiters are distributed by 128-byte line, so notify_line() only needs to visit one bucket
+std::array<waiter_bucket_t, 64> g_waiter_buckets;
+
+std::atomic<u32> g_waiter_count(0);
+std::atomic<u64> g_waiter_parked(0);
+std::atomic<u64> g_waiter_woken(0);
+std::atomic<u64> g_waiter_spurious(0);
+std::atomic<u64> g_waiter_latency(0);
+std::atomic<u64> g_waiter_timeouts(0);
+
+__forceinline waiter_bucket_t& get_waiter_bucket(u32 addr)
+{
+	return g_waiter_buckets[(addr >> 7) % g_waiter_buckets.size()];
+}
+
+__forceinline u64 get_waiter_time()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+waiter_record_t::waiter_record_t(const waiter_map_t* map, u32 addr)
+	: map(map)
+	, addr(addr)
+	, signaled(0)
+	, notify_stamp(0)
+{
+	auto& bucket = get_waiter_bucket(addr);
+
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+
+	bucket.waiters.push_back(this);
+	g_waiter_count++;
+}
+
+waiter_record_t::~waiter_record_t()
+{
+	auto& bucket = get_waiter_bucket(addr);
+
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+
+	for (auto& w : bucket.waiters)
+	{
+		if (w == this)
+		{
+			w = bucket.waiters.back();
+			bucket.waiters.pop_back();
+			g_waiter_count--;
+			return;
+		}
+	}
+
+	assert(!"waiter_record_t::~waiter_record_t() failed (not registered)");
+}
+
+bool waiter_record_t::wait()
+{
+	g_waiter_parked++;
+
+	// all writers are expected to notify, the timeout only guards against plain guest stores and is counted in the stats
+#ifdef __linux__
+	if (!signaled)
+	{
+		const timespec timeout = { 0, 100000000 };
+		syscall(SYS_futex, &signaled, FUTEX_WAIT_PRIVATE, 0, &timeout, nullptr, 0);
+	}
+#else
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (!signaled)
+		{
+			cv.wait_for(lock, std::chrono::milliseconds(100));
+		}
+	}
+#endif
+
+	if (!signaled)
+	{
+		if (!Emu.IsStopped())
+		{
+			g_waiter_timeouts++;
+		}
+
+		return false;
+	}
+
+	g_waiter_woken++;
+	g_waiter_latency += get_waiter_time() - notify_stamp;
+	return true;
+}
+
+void waiter_record_t::signal()
+{
+	notify_stamp = get_waiter_time();
+
+#ifdef __linux__
+	signaled = 1;
+	syscall(SYS_futex, &signaled, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		signaled = 1;
+	}
+
+	cv.notify_one();
+#endif
+}
+
+void waiter_map_t::notify(u32 signal_id)
+{
+	// the condition was modified before, make sure the waiter registered after that will see it
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (!g_waiter_count)
+	{
+		return;
+	}
+
+	auto& bucket = get_waiter_bucket(signal_id);
+
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+
+	for (auto w : bucket.waiters)
+	{
+		if (w->map == this && w->addr == signal_id)
+		{
+			w->signal();
+		}
+	}
+}
+
+void waiter_map_t::notify_line(u32 addr)
+{
+	// the condition was modified before, make sure the waiter registered after that will see it
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (!g_waiter_count)
+	{
+		return;
+	}
+
+	auto& bucket = get_waiter_bucket(addr);
+
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+
+	for (auto w : bucket.waiters)
+	{
+		if ((w->addr >> 7) == (addr >> 7))
+		{
+			w->signal();
+		}
+	}
+}
+
+void waiter_map_t::notify_range(u32 addr, u32 size)
+{
+	// the memory was modified before, make sure the waiter registered after that will see it
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (!g_waiter_count || !size)
+	{
+		return;
+	}
+
+	const u32 first = addr >> 7;
+	const u32 last = (addr + size - 1) >> 7;
+
+	// visit each bucket once, even if the range covers more lines than there are buckets
+	const u32 count = std::min<u32>(last - first + 1, (u32)g_waiter_buckets.size());
+
+	for (u32 i = 0; i < count; i++)
+	{
+		auto& bucket = g_waiter_buckets[(first + i) % g_waiter_buckets.size()];
+
+		std::lock_guard<std::mutex> lock(bucket.mutex);
+
+		for (auto w : bucket.waiters)
+		{
+			const u32 line = w->addr >> 7;
+
+			if (line >= first && line <= last)
+			{
+				w->signal();
+			}
+		}
+	}
+}
+
+void waiter_map_t::notify_all()
+{
+	for (auto& bucket : g_waiter_buckets)
+	{
+		std::lock_guard<std::mutex> lock(bucket.mutex);
+
+		for (auto w : bucket.waiters)
+		{
+			w->signal();
+		}
+	}
+}
+
+waiter_stats_t waiter_map_t::get_stats()
+{
+	return{ g_waiter_parked.load(), g_waiter_woken.load(), g_waiter_spurious.load(), g_waiter_latency.load(), g_waiter_timeouts.load() };
+}
+
+void waiter_map_t::spurious_wakeup()
+{
+	g_waiter_spurious++;
+}
+
 const std::function<bool()> SQUEUE_ALWAYS_EXIT = [](){ return true; };
 const std::function<bool()> SQUEUE_NEVER_EXIT = [](){ return false; };
 
@@ -1485,3 +1713,97 @@ bool squeue_test_exit()
 {
 	return Emu.IsStopped();
 }
+
+std::mutex g_squeue_mutex;
+std::set<squeue_sync_t*> g_squeues;
+
+squeue_sync_t::squeue_sync_t()
+	: m_waiters(0)
+{
+	std::lock_guard<std::mutex> lock(g_squeue_mutex);
+
+	g_squeues.insert(this);
+}
+
+squeue_sync_t::~squeue_sync_t()
+{
+	std::lock_guard<std::mutex> lock(g_squeue_mutex);
+
+	g_squeues.erase(this);
+}
+
+void squeue_sync_t::notify()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_cv.notify_all();
+}
+
+void squeue_notify_all()
+{
+	std::lock_guard<std::mutex> lock(g_squeue_mutex);
+
+	for (auto queue : g_squeues)
+	{
+		queue->notify();
+	}
+}
+
+//#define SQUEUE_BENCHMARK 1
+
+void squeue_benchmark()
+{
+#ifdef SQUEUE_BENCHMARK
+	const u32 count = 1000000; // elements per producer
+
+	for (u32 threads = 1; threads <= 4; threads *= 2)
+	{
+		squeue_t<u64> queue;
+
+		std::atomic<u64> latency(0);
+		std::atomic<u64> received(0);
+
+		const auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::unique_ptr<thread_t>> workers;
+
+		for (u32 i = 0; i < threads; i++)
+		{
+			// producer: pushes timestamps
+			workers.emplace_back(new thread_t("squeue producer", true, [&queue, count]()
+			{
+				for (u32 j = 0; j < count; j++)
+				{
+					queue.push(std::chrono::steady_clock::now().time_since_epoch().count());
+				}
+			}));
+
+			// consumer: measures the time between push and pop
+			workers.emplace_back(new thread_t("squeue consumer", true, [&queue, &latency, &received, count, threads]()
+			{
+				u64 sum = 0;
+				u64 data;
+
+				while (received.load() < (u64)count * threads && queue.pop(data, [&received, count, threads](){ return received.load() >= (u64)count * threads; }))
+				{
+					sum += std::chrono::steady_clock::now().time_since_epoch().count() - data;
+
+					if (++received >= (u64)count * threads)
+					{
+						squeue_notify_all();
+					}
+				}
+
+				latency += sum;
+			}));
+		}
+
+		workers.clear();
+
+		const auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+		LOG_NOTICE(GENERAL, "squeue benchmark (%d producer(s), %d consumer(s)): %.0f ops/s, average latency %.0f ns", threads, threads,
+			(double)count * threads * 1000000 / time, (double)latency.load() * std::chrono::steady_clock::period::num * 1000000000 / std::chrono::steady_clock::period::den / received.load());
+	}
+#endif
+}
@@ -27,6 +27,7 @@ public:
 };
 
 NamedThreadBase* GetCurrentNamedThread();
+void SetCurrentThreadDebugName(const char* threadName);
 void SetCurrentNamedThread(NamedThreadBase* value);
 
 class ThreadBase : public NamedThreadBase
@@ -101,13 +102,46 @@ class slw_shared_mutex_t
 
 };
 
-struct waiter_map_t
+struct waiter_map_t;
+
+// waiter registered for the exact address, lives on the stack of the waiting thread
+struct waiter_record_t
 {
-	static const size_t size = 32;
+	const waiter_map_t* const map;
+	const u32 addr;
+
+	std::atomic<u32> signaled; // futex word (on Linux)
+	std::atomic<u64> notify_stamp; // time of the last signal (ns), for wake latency stats
+
+#ifndef __linux__
+	std::mutex mutex;
+	std::condition_variable cv;
+#endif
+
+	// register in the bucket of the address
+	waiter_record_t(const waiter_map_t* map, u32 addr);
+
+	// unregister
+	~waiter_record_t();
 
-	std::array<std::mutex, size> mutex;
-	std::array<std::condition_variable, size> cv;
+	// park the thread until signaled, returns true if signaled (false after the safety timeout)
+	bool wait();
 
+	// wake the thread (called under the bucket lock)
+	void signal();
+};
+
+struct waiter_stats_t
+{
+	u64 parked; // number of times threads were parked
+	u64 woken; // number of wakeups
+	u64 spurious; // wakeups after which the condition was still false
+	u64 latency; // total wake latency (ns)
+	u64 timeouts; // parks ended by the safety timeout (memory modified without notification)
+};
+
+struct waiter_map_t
+{
 	const std::string name;
 
 	waiter_map_t(const char* name)
@@ -117,38 +151,52 @@ struct waiter_map_t
 
 	bool is_stopped(u64 signal_id);
 
-	// wait until waiter_func() returns true, signal_id is an arbitrary number
-	template<typename S, typename WT> __forceinline __safebuffers void wait_op(const S& signal_id, const WT waiter_func)
+	// wait until waiter_func() returns true, signal_id is the exact address of the object
+	template<typename WT> __safebuffers void wait_op(u32 signal_id, const WT waiter_func)
 	{
-		// generate hash
-		const auto hash = std::hash<S>()(signal_id) % size;
+		// check the condition or if the emulator is stopped
+		if (waiter_func() || is_stopped(signal_id))
+		{
+			return;
+		}
 
-		// set mutex locker
-		std::unique_lock<std::mutex> locker(mutex[hash], std::defer_lock);
+		// register the waiter before checking the condition again, so notify() can't be missed
+		waiter_record_t waiter(this, signal_id);
 
-		// check the condition or if the emulator is stopped
-		while (!waiter_func() && !is_stopped(signal_id))
+		for (bool woken = false;;)
 		{
-			// lock the mutex and initialize waiter (only once)
-			if (!locker.owns_lock())
+			waiter.signaled = 0;
+
+			if (waiter_func() || is_stopped(signal_id))
 			{
-				locker.lock();
+				return;
 			}
-			
-			// wait on appropriate condition variable for 1 ms or until signal arrived
-			cv[hash].wait_for(locker, std::chrono::milliseconds(1));
+
+			if (woken)
+			{
+				spurious_wakeup();
+			}
+
+			woken = waiter.wait();
 		}
 	}
 
-	// signal all threads waiting on waiter_op() with the same signal_id (signaling only hints those threads that corresponding conditions are *probably* met)
-	template<typename S> __forceinline void notify(const S& signal_id)
-	{
-		// generate hash
-		const auto hash = std::hash<S>()(signal_id) % size;
+	// signal all threads waiting on wait_op() of this waiter map with the same signal_id (signaling only hints those threads that corresponding conditions are *probably* met)
+	void notify(u32 signal_id);
 
-		// signal appropriate condition variable
-		cv[hash].notify_all();
-	}
+	// signal all threads waiting on any address in the 128-byte line (for memory modified by atomic operations)
+	static void notify_line(u32 addr);
+
+	// signal all threads waiting on any address in the range (for memory modified by DMA, HLE or RSX)
+	static void notify_range(u32 addr, u32 size);
+
+	// signal all waiting threads (on emulator stop)
+	static void notify_all();
+
+	static waiter_stats_t get_stats();
+
+private:
+	static void spurious_wakeup();
 };
 
 extern const std::function<bool()> SQUEUE_ALWAYS_EXIT;
@@ -156,169 +204,276 @@ extern const std::function<bool()> SQUEUE_NEVER_EXIT;
 
 bool squeue_test_exit();
 
-template<typename T, u32 sq_size = 256>
-class squeue_t
+// wake all threads waiting in squeue_t, so they check their exit conditions again
+void squeue_notify_all();
+
+void squeue_benchmark();
+
+// non-template part of squeue_t: parking without timeouts
+class squeue_sync_t
 {
-	struct squeue_sync_var_t
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::atomic<u32> m_waiters;
+
+protected:
+	squeue_sync_t();
+	~squeue_sync_t();
+
+	// wait until ready() returns true, returns false if the exit condition is met first
+	template<typename F> bool wait(F ready, const std::function<bool()>& test_exit)
 	{
-		struct
-		{
-			u32 position : 31;
-			u32 pop_lock : 1;
-		};
-		struct
-		{
-			u32 count : 31;
-			u32 push_lock : 1;
-		};
-	};
+		m_waiters++;
 
-	atomic_le_t<squeue_sync_var_t> m_sync;
+		std::unique_lock<std::mutex> lock(m_mutex);
 
-	mutable std::mutex m_rcv_mutex;
-	mutable std::mutex m_wcv_mutex;
-	mutable std::condition_variable m_rcv;
-	mutable std::condition_variable m_wcv;
+		while (!ready())
+		{
+			if (test_exit() || squeue_test_exit())
+			{
+				m_waiters--;
+				return false;
+			}
+
+			m_cv.wait(lock);
+		}
 
-	T m_data[sq_size];
+		m_waiters--;
+		return true;
+	}
 
-	enum squeue_sync_var_result : u32
+	// wake waiting threads after the queue state is changed
+	__forceinline void wake()
 	{
-		SQSVR_OK = 0,
-		SQSVR_LOCKED = 1,
-		SQSVR_FAILED = 2,
-	};
+		// the state was modified before, make sure the waiter registered after that will see it
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (m_waiters)
+		{
+			notify();
+		}
+	}
 
 public:
-	squeue_t()
-		: m_sync({})
+	// wake all waiting threads (for example, after their exit condition is changed)
+	void notify();
+};
+
+// bounded MPMC queue (based on Dmitry Vyukov's ring buffer, each cell has a sequence number)
+template<typename T, u32 sq_size = 256>
+class squeue_t : public squeue_sync_t
+{
+	struct squeue_cell_t
 	{
-	}
+		std::atomic<u64> seq; // == position (free), == position + 1 (written)
+		T data;
+	};
 
-	u32 get_max_size() const
+	const u32 m_size;
+	std::unique_ptr<squeue_cell_t[]> m_cells;
+
+	std::atomic<u64> m_push_pos;
+	std::atomic<u64> m_pop_pos;
+
+	__forceinline squeue_cell_t& get_cell(u64 pos)
 	{
-		return sq_size;
+		return m_cells[pos % m_size];
 	}
 
-	bool is_full() const volatile
+	// reserve up to count cells for writing, returns the number of reserved cells
+	u32 try_reserve_push(u64& pos, u32 count)
 	{
-		return m_sync.data.count == sq_size;
+		pos = m_push_pos.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			u32 free = 0;
+
+			while (free < count && get_cell(pos + free).seq.load(std::memory_order_acquire) == pos + free)
+			{
+				free++;
+			}
+
+			if (!free)
+			{
+				const u64 new_pos = m_push_pos.load(std::memory_order_relaxed);
+
+				if (new_pos == pos)
+				{
+					return 0; // full
+				}
+
+				pos = new_pos;
+				continue;
+			}
+
+			if (m_push_pos.compare_exchange_weak(pos, pos + free))
+			{
+				return free;
+			}
+		}
 	}
 
-	bool push(const T& data, const std::function<bool()>& test_exit)
+	// reserve up to count written cells for reading, returns the number of reserved cells
+	u32 try_reserve_pop(u64& pos, u32 count)
 	{
-		u32 pos = 0;
+		pos = m_pop_pos.load(std::memory_order_relaxed);
 
-		while (u32 res = m_sync.atomic_op_sync(SQSVR_OK, [&pos](squeue_sync_var_t& sync) -> u32
+		while (true)
 		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
+			u32 ready = 0;
 
-			if (sync.push_lock)
+			while (ready < count && get_cell(pos + ready).seq.load(std::memory_order_acquire) == pos + ready + 1)
 			{
-				return SQSVR_LOCKED;
+				ready++;
 			}
-			if (sync.count == sq_size)
+
+			if (!ready)
 			{
-				return SQSVR_FAILED;
+				const u64 new_pos = m_pop_pos.load(std::memory_order_relaxed);
+
+				if (new_pos == pos)
+				{
+					return 0; // empty
+				}
+
+				pos = new_pos;
+				continue;
 			}
 
-			sync.push_lock = 1;
-			pos = sync.position + sync.count;
-			return SQSVR_OK;
-		}))
-		{
-			if (res == SQSVR_FAILED && (test_exit() || squeue_test_exit()))
+			if (m_pop_pos.compare_exchange_weak(pos, pos + ready))
 			{
-				return false;
+				return ready;
 			}
+		}
+	}
 
-			std::unique_lock<std::mutex> wcv_lock(m_wcv_mutex);
-			m_wcv.wait_for(wcv_lock, std::chrono::milliseconds(1));
+	void do_push(u64 pos, const T* data, u32 count)
+	{
+		for (u32 i = 0; i < count; i++)
+		{
+			auto& cell = get_cell(pos + i);
+			cell.data = data[i];
+			cell.seq.store(pos + i + 1, std::memory_order_release);
 		}
 
-		m_data[pos >= sq_size ? pos - sq_size : pos] = data;
+		wake();
+	}
 
-		m_sync.atomic_op([](squeue_sync_var_t& sync)
+	void do_pop(u64 pos, T* data, u32 count)
+	{
+		for (u32 i = 0; i < count; i++)
 		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
-			assert(sync.push_lock);
-			sync.push_lock = 0;
-			sync.count++;
-		});
-
-		m_rcv.notify_one();
-		m_wcv.notify_one();
-		return true;
+			auto& cell = get_cell(pos + i);
+			data[i] = std::move(cell.data);
+			cell.seq.store(pos + i + m_size, std::memory_order_release);
+		}
+
+		wake();
 	}
 
-	bool push(const T& data, const volatile bool* do_exit)
+public:
+	squeue_t(u32 size = sq_size)
+		: m_size(size)
+		, m_cells(new squeue_cell_t[size])
+		, m_push_pos(0)
+		, m_pop_pos(0)
 	{
-		return push(data, [do_exit](){ return do_exit && *do_exit; });
+		assert(size);
+
+		for (u32 i = 0; i < size; i++)
+		{
+			m_cells[i].seq = i;
+		}
 	}
 
-	__forceinline bool push(const T& data)
+	u32 get_max_size() const
 	{
-		return push(data, SQUEUE_NEVER_EXIT);
+		return m_size;
 	}
 
-	__forceinline bool try_push(const T& data)
+	u32 get_count() const
 	{
-		return push(data, SQUEUE_ALWAYS_EXIT);
+		const u64 pop_pos = m_pop_pos.load();
+		const u64 push_pos = m_push_pos.load();
+		return push_pos > pop_pos ? static_cast<u32>(push_pos - pop_pos) : 0;
 	}
 
-	bool pop(T& data, const std::function<bool()>& test_exit)
+	bool is_full() const
 	{
-		u32 pos = 0;
+		return get_count() >= m_size;
+	}
+
+	// push up to count elements, blocks until all elements are pushed; returns the number of pushed elements
+	u32 push_n(const T* data, u32 count, const std::function<bool()>& test_exit)
+	{
+		u32 done = 0;
 
-		while (u32 res = m_sync.atomic_op_sync(SQSVR_OK, [&pos](squeue_sync_var_t& sync) -> u32
+		while (done < count)
 		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
+			u64 pos;
 
-			if (!sync.count)
+			if (const u32 n = try_reserve_push(pos, count - done))
 			{
-				return SQSVR_FAILED;
+				do_push(pos, data + done, n);
+				done += n;
+				continue;
 			}
-			if (sync.pop_lock)
+
+			if (!wait([this](){ return !is_full(); }, test_exit))
 			{
-				return SQSVR_LOCKED;
+				break;
 			}
+		}
 
-			sync.pop_lock = 1;
-			pos = sync.position;
-			return SQSVR_OK;
-		}))
+		return done;
+	}
+
+	// pop up to count elements, blocks until at least one element is available; returns the number of popped elements
+	u32 pop_n(T* data, u32 count, const std::function<bool()>& test_exit)
+	{
+		while (count)
 		{
-			if (res == SQSVR_FAILED && (test_exit() || squeue_test_exit()))
+			u64 pos;
+
+			if (const u32 n = try_reserve_pop(pos, count))
 			{
-				return false;
+				do_pop(pos, data, n);
+				return n;
 			}
 
-			std::unique_lock<std::mutex> rcv_lock(m_rcv_mutex);
-			m_rcv.wait_for(rcv_lock, std::chrono::milliseconds(1));
+			if (!wait([this](){ return get_count() != 0; }, test_exit))
+			{
+				break;
+			}
 		}
 
-		data = m_data[pos];
+		return 0;
+	}
 
-		m_sync.atomic_op([](squeue_sync_var_t& sync)
-		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
-			assert(sync.pop_lock);
-			sync.pop_lock = 0;
-			sync.position++;
-			sync.count--;
-			if (sync.position == sq_size)
-			{
-				sync.position = 0;
-			}
-		});
+	bool push(const T& data, const std::function<bool()>& test_exit)
+	{
+		return push_n(&data, 1, test_exit) == 1;
+	}
 
-		m_rcv.notify_one();
-		m_wcv.notify_one();
-		return true;
+	bool push(const T& data, const volatile bool* do_exit)
+	{
+		return push(data, [do_exit](){ return do_exit && *do_exit; });
+	}
+
+	__forceinline bool push(const T& data)
+	{
+		return push(data, SQUEUE_NEVER_EXIT);
+	}
+
+	__forceinline bool try_push(const T& data)
+	{
+		return push(data, SQUEUE_ALWAYS_EXIT);
+	}
+
+	bool pop(T& data, const std::function<bool()>& test_exit)
+	{
+		return pop_n(&data, 1, test_exit) == 1;
 	}
 
 	bool pop(T& data, const volatile bool* do_exit)
@@ -336,50 +491,23 @@ public:
 		return pop(data, SQUEUE_ALWAYS_EXIT);
 	}
 
+	// read the element at start_pos without removing it (only safe if there is a single consumer)
 	bool peek(T& data, u32 start_pos, const std::function<bool()>& test_exit)
 	{
-		assert(start_pos < sq_size);
-		u32 pos = 0;
+		assert(start_pos < m_size);
 
-		while (u32 res = m_sync.atomic_op_sync(SQSVR_OK, [&pos, start_pos](squeue_sync_var_t& sync) -> u32
+		auto is_ready = [this, start_pos]() -> bool
 		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
-
-			if (sync.count <= start_pos)
-			{
-				return SQSVR_FAILED;
-			}
-			if (sync.pop_lock)
-			{
-				return SQSVR_LOCKED;
-			}
+			const u64 pos = m_pop_pos.load() + start_pos;
+			return get_cell(pos).seq.load(std::memory_order_acquire) == pos + 1;
+		};
 
-			sync.pop_lock = 1;
-			pos = sync.position + start_pos;
-			return SQSVR_OK;
-		}))
+		if (!is_ready() && !wait(is_ready, test_exit))
 		{
-			if (res == SQSVR_FAILED && (test_exit() || squeue_test_exit()))
-			{
-				return false;
-			}
-
-			std::unique_lock<std::mutex> rcv_lock(m_rcv_mutex);
-			m_rcv.wait_for(rcv_lock, std::chrono::milliseconds(1));
+			return false;
 		}
 
-		data = m_data[pos >= sq_size ? pos - sq_size : pos];
-
-		m_sync.atomic_op([](squeue_sync_var_t& sync)
-		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
-			assert(sync.pop_lock);
-			sync.pop_lock = 0;
-		});
-
-		m_rcv.notify_one();
+		data = get_cell(m_pop_pos.load() + start_pos).data;
 		return true;
 	}
 
@@ -398,92 +526,12 @@ public:
 		return peek(data, start_pos, SQUEUE_ALWAYS_EXIT);
 	}
 
-	class squeue_data_t
-	{
-		T* const m_data;
-		const u32 m_pos;
-		const u32 m_count;
-
-		squeue_data_t(T* data, u32 pos, u32 count)
-			: m_data(data)
-			, m_pos(pos)
-			, m_count(count)
-		{
-		}
-
-	public:
-		T& operator [] (u32 index)
-		{
-			assert(index < m_count);
-			index += m_pos;
-			index = index < sq_size ? index : index - sq_size;
-			return m_data[index];
-		}
-	};
-
-	void process(void(*proc)(squeue_data_t data))
-	{
-		u32 pos, count;
-
-		while (m_sync.atomic_op_sync(SQSVR_OK, [&pos, &count](squeue_sync_var_t& sync) -> u32
-		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
-
-			if (sync.pop_lock || sync.push_lock)
-			{
-				return SQSVR_LOCKED;
-			}
-
-			pos = sync.position;
-			count = sync.count;
-			sync.pop_lock = 1;
-			sync.push_lock = 1;
-			return SQSVR_OK;
-		}))
-		{
-			std::unique_lock<std::mutex> rcv_lock(m_rcv_mutex);
-			m_rcv.wait_for(rcv_lock, std::chrono::milliseconds(1));
-		}
-
-		proc(squeue_data_t(m_data, pos, count));
-
-		m_sync.atomic_op([](squeue_sync_var_t& sync)
-		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
-			assert(sync.pop_lock && sync.push_lock);
-			sync.pop_lock = 0;
-			sync.push_lock = 0;
-		});
-
-		m_wcv.notify_one();
-		m_rcv.notify_one();
-	}
-
 	void clear()
 	{
-		while (m_sync.atomic_op_sync(SQSVR_OK, [](squeue_sync_var_t& sync) -> u32
-		{
-			assert(sync.count <= sq_size);
-			assert(sync.position < sq_size);
+		T data;
 
-			if (sync.pop_lock || sync.push_lock)
-			{
-				return SQSVR_LOCKED;
-			}
-
-			sync.pop_lock = 1;
-			sync.push_lock = 1;
-			return SQSVR_OK;
-		}))
+		while (try_pop(data))
 		{
-			std::unique_lock<std::mutex> rcv_lock(m_rcv_mutex);
-			m_rcv.wait_for(rcv_lock, std::chrono::milliseconds(1));
 		}
-
-		m_sync.exchange({});
-		m_wcv.notify_one();
-		m_rcv.notify_one();
 	}
 };
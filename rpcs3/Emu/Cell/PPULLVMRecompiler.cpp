@@ -3,6 +3,7 @@
 #include "Emu/System.h"
 #include "Emu/Cell/PPULLVMRecompiler.h"
 #include "Emu/Memory/Memory.h"
+#include "Utilities/File.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/ManagedStatic.h"
@@ -128,8 +129,7 @@ Executable Compiler::Compile(const std::string & name, const ControlFlowGraph &
 
         if (!inline_all && *instr_i != cfg.start_address) {
             // Use an already compiled implementation of this block if available
-            auto ordinal = m_recompilation_engine.GetOrdinal(*instr_i);
-            if (ordinal != 0xFFFFFFFF) {
+            if (m_recompilation_engine.GetExecutable(*instr_i)) {
                 auto exit_instr_i32 = m_ir_builder->CreatePHI(m_ir_builder->getInt32Ty(), 0);
                 exit_instr_list.push_back(exit_instr_i32);
 
@@ -230,12 +230,15 @@ Executable Compiler::Compile(const std::string & name, const ControlFlowGraph &
     }
 
 #ifdef _DEBUG
-    m_recompilation_engine.Log() << *m_state.function;
+    // The log is shared by the compile workers, so the output is written at once when the function is compiled
+    std::string        debug_log;
+    raw_string_ostream debug_ostream(debug_log);
+    debug_ostream << *m_state.function;
 
     std::string        verify;
     raw_string_ostream verify_ostream(verify);
     if (verifyFunction(*m_state.function, &verify_ostream)) {
-        m_recompilation_engine.Log() << "Verification failed: " << verify << "\n";
+        debug_ostream << "Verification failed: " << verify << "\n";
     }
 #endif
 
@@ -254,17 +257,18 @@ Executable Compiler::Compile(const std::string & name, const ControlFlowGraph &
     m_stats.translation_time += std::chrono::duration_cast<std::chrono::nanoseconds>(translate_end - optimize_end);
 
 #ifdef _DEBUG
-    m_recompilation_engine.Log() << "\nDisassembly:\n";
+    debug_ostream << "\nDisassembly:\n";
     auto disassembler = LLVMCreateDisasm(sys::getProcessTriple().c_str(), nullptr, 0, nullptr, nullptr);
     for (size_t pc = 0; pc < mci.size();) {
         char str[1024];
 
         auto size = LLVMDisasmInstruction(disassembler, ((u8 *)mci.address()) + pc, mci.size() - pc, (uint64_t)(((u8 *)mci.address()) + pc), str, sizeof(str));
-        m_recompilation_engine.Log() << fmt::Format("0x%08X: ", (u64)(((u8 *)mci.address()) + pc)) << str << '\n';
+        debug_ostream << fmt::Format("0x%08X: ", (u64)(((u8 *)mci.address()) + pc)) << str << '\n';
         pc += size;
     }
 
     LLVMDisasmDispose(disassembler);
+    m_recompilation_engine.WriteLog(debug_ostream.str());
 #endif
 
     auto compilation_end  = std::chrono::high_resolution_clock::now();
@@ -5569,8 +5573,7 @@ Value * Compiler::Call(const char * name, Func function, Args... args) {
 }
 
 llvm::Value * Compiler::IndirectCall(u32 address, Value * context_i64, bool is_function) {
-    auto ordinal          = m_recompilation_engine.AllocateOrdinal(address, is_function);
-    auto location_i64     = m_ir_builder->getInt64(m_recompilation_engine.GetAddressOfExecutableLookup() + (ordinal * sizeof(u64)));
+    auto location_i64     = m_ir_builder->getInt64((u64)m_recompilation_engine.GetExecutableLocation(address, is_function));
     auto location_i64_ptr = m_ir_builder->CreateIntToPtr(location_i64, m_ir_builder->getInt64Ty()->getPointerTo());
     auto executable_i64   = m_ir_builder->CreateLoad(location_i64_ptr);
     auto executable_ptr   = m_ir_builder->CreateIntToPtr(executable_i64, m_compiled_function_type->getPointerTo());
@@ -5607,55 +5610,73 @@ std::shared_ptr<RecompilationEngine> RecompilationEngine::s_the_instance = nullp
 RecompilationEngine::RecompilationEngine()
     : ThreadBase("PPU Recompilation Engine")
     , m_log(nullptr)
-    , m_next_ordinal(0)
-    , m_compiler(*this, ExecutionEngine::ExecuteFunction, ExecutionEngine::ExecuteTillReturn, ExecutionEngine::PollStatus) {
+    , m_pending_execution_traces(nullptr)
+    , m_exit_workers(false)
+    , m_num_executable_pages(0)
+    , m_compiler(*this, ExecutionEngine::ExecuteFunction, ExecutionEngine::ExecuteTillReturn, ExecutionEngine::PollStatus)
+    , m_executable_hash(0)
+    , m_num_cached_blocks(0)
+    , m_num_cached_blocks_pending(0)
+    , m_cache_load_time(0) {
+    for (auto & page : m_executable_lookup) {
+        page.store(nullptr, std::memory_order_relaxed);
+    }
+
     m_compiler.RunAllTests();
 }
 
 RecompilationEngine::~RecompilationEngine() {
     Stop();
-}
 
-u32 RecompilationEngine::AllocateOrdinal(u32 address, bool is_function) {
-    std::lock_guard<std::mutex> lock(m_address_to_ordinal_lock);
+    for (auto & page : m_executable_lookup) {
+        delete[] page.load();
+    }
 
-    auto i = m_address_to_ordinal.find(address);
-    if (i == m_address_to_ordinal.end()) {
-        assert(m_next_ordinal < (sizeof(m_executable_lookup) / sizeof(m_executable_lookup[0])));
+    for (auto execution_trace = m_pending_execution_traces.exchange(nullptr); execution_trace;) {
+        auto next = execution_trace->next;
+        delete execution_trace;
+        execution_trace = next;
+    }
+}
 
-        m_executable_lookup[m_next_ordinal] = is_function ? ExecutionEngine::ExecuteFunction : ExecutionEngine::ExecuteTillReturn;
-        std::atomic_thread_fence(std::memory_order_release);
-        i = m_address_to_ordinal.insert(m_address_to_ordinal.end(), std::make_pair(address, m_next_ordinal++));
+Executable RecompilationEngine::GetExecutable(u32 address) const {
+    auto page = m_executable_lookup[address >> (s_executable_page_bits + 2)].load(std::memory_order_acquire);
+    if (!page) {
+        return nullptr;
     }
 
-    return i->second;
+    return page[(address >> 2) & ((1 << s_executable_page_bits) - 1)].load(std::memory_order_acquire);
 }
 
-u32 RecompilationEngine::GetOrdinal(u32 address) const {
-    std::lock_guard<std::mutex> lock(m_address_to_ordinal_lock);
+std::atomic<Executable> * RecompilationEngine::GetExecutableLocation(u32 address, bool is_function) {
+    auto & page_location = m_executable_lookup[address >> (s_executable_page_bits + 2)];
+    auto   page          = page_location.load(std::memory_order_acquire);
+    if (!page) {
+        auto new_page = new std::atomic<Executable>[1 << s_executable_page_bits];
+        for (u32 i = 0; i < (1 << s_executable_page_bits); i++) {
+            new_page[i].store(nullptr, std::memory_order_relaxed);
+        }
 
-    auto i = m_address_to_ordinal.find(address);
-    if (i != m_address_to_ordinal.end()) {
-        return i->second;
-    } else {
-        return 0xFFFFFFFF;
+        if (page_location.compare_exchange_strong(page, new_page, std::memory_order_acq_rel)) {
+            page = new_page;
+            m_num_executable_pages++;
+        } else {
+            // Another thread allocated the page
+            delete[] new_page;
+        }
     }
-}
-
-const Executable RecompilationEngine::GetExecutable(u32 ordinal) const {
-    std::atomic_thread_fence(std::memory_order_acquire);
-    return m_executable_lookup[ordinal];
-}
 
-u64 RecompilationEngine::GetAddressOfExecutableLookup() const {
-    return (u64)m_executable_lookup;
+    auto &     location = page[(address >> 2) & ((1 << s_executable_page_bits) - 1)];
+    Executable expected = nullptr;
+    location.compare_exchange_strong(expected, is_function ? ExecutionEngine::ExecuteFunction : ExecutionEngine::ExecuteTillReturn);
+    return &location;
 }
 
 void RecompilationEngine::NotifyTrace(ExecutionTrace * execution_trace) {
-    {
-        std::lock_guard<std::mutex> lock(m_pending_execution_traces_lock);
-        m_pending_execution_traces.push_back(execution_trace);
-    }
+    auto head = m_pending_execution_traces.load(std::memory_order_relaxed);
+    do {
+        execution_trace->next = head;
+    } while (!m_pending_execution_traces.compare_exchange_weak(head, execution_trace, std::memory_order_release, std::memory_order_relaxed));
 
     if (!IsAlive()) {
         Start();
@@ -5675,29 +5696,37 @@ raw_fd_ostream & RecompilationEngine::Log() {
     return *m_log;
 }
 
+void RecompilationEngine::WriteLog(const std::string & text) {
+    std::lock_guard<std::mutex> lock(m_log_mutex);
+    Log() << text;
+}
+
 void RecompilationEngine::Task() {
     bool                     is_idling = false;
     std::chrono::nanoseconds idling_time(0);
     std::chrono::nanoseconds recompiling_time(0);
 
     auto start = std::chrono::high_resolution_clock::now();
-    while (!TestDestroy() && !Emu.IsStopped()) {
-        bool             work_done_this_iteration = false;
-        ExecutionTrace * execution_trace          = nullptr;
+    StartWorkers();
+    LoadCache();
 
-        {
-            std::lock_guard<std::mutex> lock(m_pending_execution_traces_lock);
-
-            auto i = m_pending_execution_traces.begin();
-            if (i != m_pending_execution_traces.end()) {
-                execution_trace = *i;
-                m_pending_execution_traces.erase(i);
-            }
+    while (!TestDestroy() && !Emu.IsStopped()) {
+        bool work_done_this_iteration = false;
+
+        // Take all pending traces and process them in the order in which they were queued
+        ExecutionTrace * execution_traces = nullptr;
+        for (auto execution_trace = m_pending_execution_traces.exchange(nullptr, std::memory_order_acquire); execution_trace;) {
+            auto next             = execution_trace->next;
+            execution_trace->next = execution_traces;
+            execution_traces      = execution_trace;
+            execution_trace       = next;
         }
 
-        if (execution_trace) {
-            ProcessExecutionTrace(*execution_trace);
-            delete execution_trace;
+        while (execution_traces) {
+            auto next = execution_traces->next;
+            ProcessExecutionTrace(*execution_traces);
+            delete execution_traces;
+            execution_traces         = next;
             work_done_this_iteration = true;
         }
 
@@ -5714,7 +5743,7 @@ void RecompilationEngine::Task() {
             auto   candidate = (BlockEntry *)nullptr;
             size_t max_diff  = 0;
             for (auto block : m_block_table) {
-                if (block->IsFunction() && block->is_compiled) {
+                if (block->IsFunction() && block->is_compiled && !block->is_queued) {
                     auto diff = block->cfg.GetSize() - block->last_compiled_cfg_size;
                     if (diff > max_diff) {
                         candidate = block;
@@ -5724,7 +5753,7 @@ void RecompilationEngine::Task() {
             }
 
             if (candidate != nullptr) {
-                Log() << "Recompiling: " << candidate->ToString() << "\n";
+                WriteLog("Recompiling: " + candidate->ToString() + "\n");
                 CompileBlock(*candidate);
                 work_done_this_iteration = true;
             }
@@ -5744,19 +5773,32 @@ void RecompilationEngine::Task() {
         }
     }
 
+    StopWorkers();
+    SaveCache();
+
     std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
     auto total_time     = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
     auto compiler_stats = m_compiler.GetStats();
+    for (auto & compiler : m_worker_compilers) {
+        auto stats                        = compiler->GetStats();
+        compiler_stats.ir_build_time     += stats.ir_build_time;
+        compiler_stats.optimization_time += stats.optimization_time;
+        compiler_stats.translation_time  += stats.translation_time;
+        compiler_stats.total_time        += stats.total_time;
+    }
 
     Log() << "Total time                      = " << total_time.count() / 1000000 << "ms\n";
-    Log() << "    Time spent compiling        = " << compiler_stats.total_time.count() / 1000000 << "ms\n";
+    Log() << "    Compile workers             = " << m_worker_compilers.size() + 1 << "\n";
+    Log() << "    Time spent compiling        = " << compiler_stats.total_time.count() / 1000000 << "ms (all workers)\n";
     Log() << "        Time spent building IR  = " << compiler_stats.ir_build_time.count() / 1000000 << "ms\n";
     Log() << "        Time spent optimizing   = " << compiler_stats.optimization_time.count() / 1000000 << "ms\n";
     Log() << "        Time spent translating  = " << compiler_stats.translation_time.count() / 1000000 << "ms\n";
     Log() << "    Time spent recompiling      = " << recompiling_time.count() / 1000000 << "ms\n";
     Log() << "    Time spent idling           = " << idling_time.count() / 1000000 << "ms\n";
-    Log() << "    Time spent doing misc tasks = " << (total_time.count() - idling_time.count() - compiler_stats.total_time.count()) / 1000000 << "ms\n";
-    Log() << "Ordinals allocated              = " << m_next_ordinal << "\n";
+    Log() << "    Time spent doing misc tasks = " << (total_time.count() - idling_time.count()) / 1000000 << "ms\n";
+    Log() << "    Time spent loading cache    = " << m_cache_load_time.count() / 1000000 << "ms\n";
+    Log() << "Executable lookup pages         = " << m_num_executable_pages << "\n";
+    Log() << "Blocks loaded from cache        = " << m_num_cached_blocks << "\n";
 
     LOG_NOTICE(PPU, "PPU LLVM Recompilation thread exiting.");
     s_the_instance = nullptr; // Can cause deadlock if this is the last instance. Need to fix this.
@@ -5767,7 +5809,7 @@ void RecompilationEngine::ProcessExecutionTrace(const ExecutionTrace & execution
     auto processed_execution_trace_i = m_processed_execution_traces.find(execution_trace_id);
     if (processed_execution_trace_i == m_processed_execution_traces.end()) {
 #ifdef _DEBUG
-        Log() << "Trace: " << execution_trace.ToString() << "\n";
+        WriteLog("Trace: " + execution_trace.ToString() + "\n");
 #endif
         // Find the function block
         BlockEntry key(execution_trace.function_address, execution_trace.function_address);
@@ -5850,18 +5892,269 @@ void RecompilationEngine::UpdateControlFlowGraph(ControlFlowGraph & cfg, const E
     }
 }
 
-void RecompilationEngine::CompileBlock(BlockEntry & block_entry) {
+void RecompilationEngine::CompileBlock(BlockEntry & block_entry, bool from_cache) {
 #ifdef _DEBUG
-    Log() << "Compile: " << block_entry.ToString() << "\n";
-    Log() << "CFG: " << block_entry.cfg.ToString() << "\n";
+    WriteLog("Compile: " + block_entry.ToString() + "\nCFG: " + block_entry.cfg.ToString() + "\n");
 #endif
 
-    auto ordinal    = AllocateOrdinal(block_entry.cfg.start_address, block_entry.IsFunction());
-    auto executable = m_compiler.Compile(fmt::Format("fn_0x%08X_%u", block_entry.cfg.start_address, block_entry.revision++), block_entry.cfg, true,
-                                         block_entry.IsFunction() ? true : false /*generate_linkable_exits*/);
-    m_executable_lookup[ordinal]       = executable;
+    // The block keeps running in the interpreter until a worker publishes the executable
+    CompileJob job = {
+        block_entry.num_hits,
+        fmt::Format("fn_0x%08X_%u", block_entry.cfg.start_address, block_entry.revision++),
+        block_entry.cfg,
+        GetExecutableLocation(block_entry.cfg.start_address, block_entry.IsFunction()),
+        &block_entry,
+        from_cache,
+    };
+
     block_entry.last_compiled_cfg_size = block_entry.cfg.GetSize();
     block_entry.is_compiled            = true;
+    block_entry.is_queued              = true;
+    block_entry.compiled_cfg           = block_entry.cfg;
+    block_entry.code_hash              = HashCode(block_entry.compiled_cfg);
+
+    {
+        std::lock_guard<std::mutex> lock(m_compile_jobs_lock);
+        m_compile_jobs.push(std::move(job));
+    }
+
+    m_compile_jobs_cv.notify_one();
+}
+
+void RecompilationEngine::StartWorkers() {
+    // Each worker needs its own LLVM context and JIT, so the count is limited to keep memory usage reasonable
+    auto num_workers = std::min(std::max(std::thread::hardware_concurrency() / 2, 1u), 4u);
+
+    m_exit_workers = false;
+    for (u32 i = 0; i < num_workers; i++) {
+        if (i > m_worker_compilers.size()) {
+            m_worker_compilers.emplace_back(new Compiler(*this, ExecutionEngine::ExecuteFunction, ExecutionEngine::ExecuteTillReturn, ExecutionEngine::PollStatus));
+        }
+
+        auto & compiler = i ? *m_worker_compilers[i - 1] : m_compiler;
+        m_workers.emplace_back(new thread_t(fmt::Format("PPU Compile Worker %u", i), true, [this, &compiler]() {
+            WorkerTask(compiler);
+        }));
+    }
+}
+
+void RecompilationEngine::StopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_compile_jobs_lock);
+        m_exit_workers = true;
+    }
+
+    m_compile_jobs_cv.notify_all();
+    for (auto & worker : m_workers) {
+        worker->join();
+    }
+
+    m_workers.clear();
+
+    // Discard the jobs which were not started. The blocks keep running in the interpreter and stay in the block cache,
+    // so they are compiled again on the next run.
+    std::lock_guard<std::mutex> lock(m_compile_jobs_lock);
+    while (!m_compile_jobs.empty()) {
+        m_compile_jobs.top().block_entry->is_queued = false;
+        m_compile_jobs.pop();
+    }
+}
+
+void RecompilationEngine::WorkerTask(Compiler & compiler) {
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_compile_jobs_lock);
+        m_compile_jobs_cv.wait(lock, [this]() { return m_exit_workers || !m_compile_jobs.empty(); });
+
+        if (m_exit_workers) {
+            break;
+        }
+
+        CompileJob job = m_compile_jobs.top();
+        m_compile_jobs.pop();
+        lock.unlock();
+
+        auto executable = compiler.Compile(job.name, job.cfg, true, job.cfg.function_address == job.cfg.start_address /*generate_linkable_exits*/);
+        job.executable_location->store(executable, std::memory_order_release);
+        job.block_entry->is_queued = false;
+
+        if (job.from_cache) {
+            CachedBlockCompiled();
+        }
+    }
+}
+
+std::string RecompilationEngine::GetCacheDirectory() const {
+    return Emu.GetEmulatorPath().empty() ? std::string("ppu_cache") : Emu.GetEmulatorPath() + "/ppu_cache";
+}
+
+std::string RecompilationEngine::GetCacheFilePath() const {
+    return fmt::Format("%s/%016llX.bin", GetCacheDirectory().c_str(), m_executable_hash);
+}
+
+u64 RecompilationEngine::HashCode(const ControlFlowGraph & cfg) {
+    u64 hash = 0xCBF29CE484222325ull; // FNV-1a
+    for (auto i = cfg.instruction_addresses.begin(); i != cfg.instruction_addresses.end(); i++) {
+        if (!vm::check_addr(*i, 4)) {
+            return 0;
+        }
+
+        hash = (hash ^ *i) * 0x100000001B3ull;
+        hash = (hash ^ vm::read32(*i)) * 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+// Block cache file layout (all values are u32):
+//   magic, version, number of blocks
+//   for each block: start address, function address, code hash (low, high),
+//                   number of instructions, instruction addresses...,
+//                   number of branch sources, {source, number of targets, targets...}...,
+//                   number of call sources, {source, number of targets, targets...}...
+static const u32 s_cache_magic   = 0x43555050; // "PPUC"
+static const u32 s_cache_version = 1;
+
+void RecompilationEngine::LoadCache() {
+    m_cache_load_start = std::chrono::high_resolution_clock::now();
+
+    // Hash the executable
+    fs::file elf(Emu.GetPath());
+    if (!elf) {
+        return;
+    }
+
+    std::vector<u8> elf_data((size_t)elf.size());
+    elf.read(elf_data.data(), elf_data.size());
+
+    m_executable_hash = 0xCBF29CE484222325ull; // FNV-1a
+    for (auto byte : elf_data) {
+        m_executable_hash = (m_executable_hash ^ byte) * 0x100000001B3ull;
+    }
+
+    fs::file cache(GetCacheFilePath());
+    if (!cache) {
+        return;
+    }
+
+    std::vector<u32> data((size_t)cache.size() / sizeof(u32));
+    cache.read(data.data(), data.size() * sizeof(u32));
+
+    size_t pos  = 0;
+    auto   read = [&]() -> u32 {
+        return pos < data.size() ? data[pos++] : 0;
+    };
+
+    auto read_edges = [&](std::map<u32, std::set<u32>> & edges) {
+        for (u32 n = read(); n && pos < data.size(); n--) {
+            auto & targets = edges[read()];
+            for (u32 m = read(); m && pos < data.size(); m--) {
+                targets.insert(read());
+            }
+        }
+    };
+
+    if (read() != s_cache_magic || read() != s_cache_version) {
+        LOG_WARNING(PPU, "PPU LLVM block cache %s is invalid", GetCacheFilePath().c_str());
+        return;
+    }
+
+    // The workers may compile the blocks before all of them are queued
+    m_num_cached_blocks_pending = 1;
+
+    u32 num_rejected = 0;
+    for (u32 n = read(); n && pos < data.size(); n--) {
+        auto start_address    = read();
+        auto function_address = read();
+        auto code_hash        = (u64)read();
+        code_hash            |= (u64)read() << 32;
+
+        std::unique_ptr<BlockEntry> block_entry(new BlockEntry(start_address, function_address));
+        for (u32 m = read(); m && pos < data.size(); m--) {
+            block_entry->cfg.instruction_addresses.insert(read());
+        }
+
+        read_edges(block_entry->cfg.branches);
+        read_edges(block_entry->cfg.calls);
+
+        // Skip blocks whose code has changed (self-modifying code or a different revision of the executable)
+        if (block_entry->cfg.instruction_addresses.empty() || HashCode(block_entry->cfg) != code_hash) {
+            num_rejected++;
+            continue;
+        }
+
+        if (m_block_table.find(block_entry.get()) != m_block_table.end()) {
+            continue;
+        }
+
+        m_num_cached_blocks_pending++;
+        CompileBlock(*block_entry, true);
+        m_block_table.insert(block_entry.release());
+        m_num_cached_blocks++;
+    }
+
+    if (num_rejected) {
+        LOG_WARNING(PPU, "PPU LLVM block cache: %u blocks rejected (code changed)", num_rejected);
+    }
+
+    CachedBlockCompiled();
+}
+
+void RecompilationEngine::CachedBlockCompiled() {
+    if (--m_num_cached_blocks_pending == 0) {
+        auto load_end     = std::chrono::high_resolution_clock::now();
+        m_cache_load_time = std::chrono::duration_cast<std::chrono::nanoseconds>(load_end - m_cache_load_start);
+
+        LOG_NOTICE(PPU, "PPU LLVM block cache: %u blocks compiled in %llu ms", m_num_cached_blocks, (u64)m_cache_load_time.count() / 1000000);
+    }
+}
+
+void RecompilationEngine::SaveCache() {
+    if (!m_executable_hash) {
+        return;
+    }
+
+    std::vector<u32> data;
+    data.push_back(s_cache_magic);
+    data.push_back(s_cache_version);
+    data.push_back(0);
+
+    auto write_edges = [&](const std::map<u32, std::set<u32>> & edges) {
+        data.push_back((u32)edges.size());
+        for (auto i = edges.begin(); i != edges.end(); i++) {
+            data.push_back(i->first);
+            data.push_back((u32)i->second.size());
+            data.insert(data.end(), i->second.begin(), i->second.end());
+        }
+    };
+
+    for (auto block : m_block_table) {
+        if (!block->is_compiled || !block->code_hash) {
+            continue;
+        }
+
+        // Save the CFG which was compiled, the hash doesn't cover instructions traced after that
+        auto & cfg = block->compiled_cfg;
+        data.push_back(cfg.start_address);
+        data.push_back(cfg.function_address);
+        data.push_back((u32)block->code_hash);
+        data.push_back((u32)(block->code_hash >> 32));
+        data.push_back((u32)cfg.instruction_addresses.size());
+        data.insert(data.end(), cfg.instruction_addresses.begin(), cfg.instruction_addresses.end());
+        write_edges(cfg.branches);
+        write_edges(cfg.calls);
+        data[2]++;
+    }
+
+    auto dir = GetCacheDirectory();
+    if (!fs::is_dir(dir) && !fs::create_dir(dir)) {
+        LOG_ERROR(PPU, "Failed to create PPU LLVM block cache directory %s", dir.c_str());
+        return;
+    }
+
+    fs::file cache(GetCacheFilePath(), o_write | o_create | o_trunc);
+    if (!cache || cache.write(data.data(), data.size() * sizeof(u32)) != data.size() * sizeof(u32)) {
+        LOG_ERROR(PPU, "Failed to write PPU LLVM block cache %s", GetCacheFilePath().c_str());
+    }
 }
 
 std::shared_ptr<RecompilationEngine> RecompilationEngine::GetInstance() {
@@ -5958,7 +6251,6 @@ ppu_recompiler_llvm::ExecutionEngine::ExecutionEngine(PPUThread & ppu)
     : m_ppu(ppu)
     , m_interpreter(new PPUInterpreter(ppu))
     , m_decoder(m_interpreter)
-    , m_last_cache_clear_time(std::chrono::high_resolution_clock::now())
     , m_recompilation_engine(RecompilationEngine::GetInstance()) {
 }
 
@@ -5971,41 +6263,9 @@ u32 ppu_recompiler_llvm::ExecutionEngine::DecodeMemory(const u32 address) {
     return 0;
 }
 
-void ppu_recompiler_llvm::ExecutionEngine::RemoveUnusedEntriesFromCache() const {
-    auto now = std::chrono::high_resolution_clock::now();
-    if (std::chrono::duration_cast<std::chrono::milliseconds>(now - m_last_cache_clear_time).count() > 10000) {
-        for (auto i = m_address_to_ordinal.begin(); i != m_address_to_ordinal.end();) {
-            auto tmp = i;
-            i++;
-            if (tmp->second.second == 0) {
-                m_address_to_ordinal.erase(tmp);
-            } else {
-                tmp->second.second = 0;
-            }
-        }
-
-        m_last_cache_clear_time = now;
-    }
-}
-
 Executable ppu_recompiler_llvm::ExecutionEngine::GetExecutable(u32 address, Executable default_executable) const {
-    // Find the ordinal for the specified address and insert it to the cache
-    auto i = m_address_to_ordinal.find(address);
-    if (i == m_address_to_ordinal.end()) {
-        auto ordinal = m_recompilation_engine->GetOrdinal(address);
-        if (ordinal != 0xFFFFFFFF) {
-            i = m_address_to_ordinal.insert(m_address_to_ordinal.end(), std::make_pair(address, std::make_pair(ordinal, 0)));
-        }
-    }
-
-    Executable executable = default_executable;
-    if (i != m_address_to_ordinal.end()) {
-        i->second.second++;
-        executable = m_recompilation_engine->GetExecutable(i->second.first);
-    }
-
-    RemoveUnusedEntriesFromCache();
-    return executable;
+    auto executable = m_recompilation_engine->GetExecutable(address);
+    return executable ? executable : default_executable;
 }
 
 u32 ppu_recompiler_llvm::ExecutionEngine::ExecuteFunction(PPUThread * ppu_state, u64 context) {
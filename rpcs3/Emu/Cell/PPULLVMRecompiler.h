@@ -135,8 +135,12 @@ namespace ppu_recompiler_llvm {
         /// entries in the trace
         std::vector<ExecutionTraceEntry> entries;
 
+        /// Next trace in the queue of pending execution traces
+        ExecutionTrace * next;
+
         ExecutionTrace(u32 address)
-            : function_address(address) {
+            : function_address(address)
+            , next(nullptr) {
         }
 
         std::string ToString() const {
@@ -952,17 +956,13 @@ namespace ppu_recompiler_llvm {
     public:
         virtual ~RecompilationEngine();
 
-        /// Allocate an ordinal
-        u32 AllocateOrdinal(u32 address, bool is_function);
-
-        /// Get the ordinal for the specified address
-        u32 GetOrdinal(u32 address) const;
-
-        /// Get the executable specified by the ordinal
-        const Executable GetExecutable(u32 ordinal) const;
+        /// Get the executable for the specified address. Returns nullptr if no executable has been assigned to the address.
+        /// This does not take any lock.
+        Executable GetExecutable(u32 address) const;
 
-        /// Get the address of the executable lookup
-        u64 GetAddressOfExecutableLookup() const;
+        /// Get the location of the executable for the specified address. The location never changes so compiled code can
+        /// refer to it directly. If no executable has been assigned to the address, the interpreter is assigned to it.
+        std::atomic<Executable> * GetExecutableLocation(u32 address, bool is_function);
 
         /// Notify the recompilation engine about a newly detected trace. It takes ownership of the trace.
         void NotifyTrace(ExecutionTrace * execution_trace);
@@ -970,6 +970,9 @@ namespace ppu_recompiler_llvm {
         /// Log
         llvm::raw_fd_ostream & Log();
 
+        /// Write to the log. Can be called while the compile workers are running.
+        void WriteLog(const std::string & text);
+
         void Task() override;
 
         /// Get a pointer to the instance of this class
@@ -990,15 +993,27 @@ namespace ppu_recompiler_llvm {
             /// The CFG for this block
             ControlFlowGraph cfg;
 
-            /// Indicates whether the block has been compiled or not
+            /// Indicates whether the block has been compiled (or queued for compilation) or not
             bool is_compiled;
 
+            /// Indicates whether a compile job for this block is waiting for or being processed by a worker
+            std::atomic<bool> is_queued;
+
+            /// Hash of the instructions in compiled_cfg
+            u64 code_hash;
+
+            /// Copy of the CFG when it was last compiled (cfg keeps growing after that). This is what the block cache stores.
+            ControlFlowGraph compiled_cfg;
+
             BlockEntry(u32 start_address, u32 function_address)
                 : num_hits(0)
                 , revision(0)
                 , last_compiled_cfg_size(0)
                 , is_compiled(false)
-                , cfg(start_address, function_address) {
+                , is_queued(false)
+                , code_hash(0)
+                , cfg(start_address, function_address)
+                , compiled_cfg(start_address, function_address) {
             }
 
             std::string ToString() const {
@@ -1027,14 +1042,57 @@ namespace ppu_recompiler_llvm {
             };
         };
 
+        /// A block waiting to be compiled by a worker
+        struct CompileJob {
+            /// Priority of the job. This is BlockEntry::num_hits at the time the job was queued.
+            u32 num_hits;
+
+            /// Name of the function to generate
+            std::string name;
+
+            /// Copy of the CFG of the block
+            ControlFlowGraph cfg;
+
+            /// Location of the executable of the block
+            std::atomic<Executable> * executable_location;
+
+            /// The block being compiled
+            BlockEntry * block_entry;
+
+            /// Set if the block was loaded from the block cache
+            bool from_cache;
+
+            bool operator < (const CompileJob & other) const {
+                return num_hits < other.num_hits;
+            }
+        };
+
         /// Log
         llvm::raw_fd_ostream * m_log;
 
-        /// Lock for accessing m_pending_execution_traces. TODO: Eliminate this and use a lock-free queue.
-        std::mutex m_pending_execution_traces_lock;
+        /// Lock-free queue of execution traces pending processing, linked through ExecutionTrace::next (newest first)
+        std::atomic<ExecutionTrace *> m_pending_execution_traces;
+
+        /// Lock for accessing m_compile_jobs and m_exit_workers
+        std::mutex m_compile_jobs_lock;
+
+        /// Signalled when a compile job is queued or when the workers must exit
+        std::condition_variable m_compile_jobs_cv;
 
-        /// Queue of execution traces pending processing
-        std::list<ExecutionTrace *> m_pending_execution_traces;
+        /// Blocks waiting to be compiled, the most frequently hit block first
+        std::priority_queue<CompileJob> m_compile_jobs;
+
+        /// Set to make the compile workers exit
+        bool m_exit_workers;
+
+        /// Serializes writes to the log
+        std::mutex m_log_mutex;
+
+        /// Compile worker threads. Each worker owns a Compiler with its own LLVM context.
+        std::vector<std::unique_ptr<thread_t>> m_workers;
+
+        /// Compilers of the workers other than the first one (which uses m_compiler)
+        std::vector<std::unique_ptr<Compiler>> m_worker_compilers;
 
         /// Block table
         std::unordered_set<BlockEntry *, BlockEntry::hash, BlockEntry::equal_to> m_block_table;
@@ -1042,21 +1100,33 @@ namespace ppu_recompiler_llvm {
         /// Execution traces that have been already encountered. Data is the list of all blocks that this trace includes.
         std::unordered_map<ExecutionTrace::Id, std::vector<BlockEntry *>> m_processed_execution_traces;
 
-        /// Lock for accessing m_address_to_ordinal.
-        // TODO: Make this a RW lock
-        mutable std::mutex m_address_to_ordinal_lock;
+        /// Number of address bits (excluding the two alignment bits) resolved by a page of the executable lookup table
+        static const u32 s_executable_page_bits = 14;
 
-        /// Mapping from address to ordinal
-        std::unordered_map<u32, u32> m_address_to_ordinal;
+        /// Executable lookup table. This is a two level page table indexed by the address of a block. Pages are allocated
+        /// on demand and are never moved or freed while the engine exists, so readers do not need any lock.
+        std::atomic<std::atomic<Executable> *> m_executable_lookup[1 << (30 - s_executable_page_bits)];
 
-        /// Next ordinal to allocate
-        u32 m_next_ordinal;
+        /// Number of pages allocated in the executable lookup table
+        std::atomic<u32> m_num_executable_pages;
 
         /// PPU Compiler
         Compiler m_compiler;
 
-        /// Executable lookup table
-        Executable m_executable_lookup[10000]; // TODO: Adjust size
+        /// Hash of the executable file. Used to name the block cache file. 0 if the block cache is not used.
+        u64 m_executable_hash;
+
+        /// Number of blocks compiled from the block cache
+        u32 m_num_cached_blocks;
+
+        /// Number of blocks loaded from the block cache that are not compiled yet (plus one while the cache is being loaded)
+        std::atomic<u32> m_num_cached_blocks_pending;
+
+        /// Time at which loading the block cache started
+        std::chrono::high_resolution_clock::time_point m_cache_load_start;
+
+        /// Time from the start of loading the block cache until all its blocks were compiled
+        std::chrono::nanoseconds m_cache_load_time;
 
         RecompilationEngine();
 
@@ -1072,8 +1142,35 @@ namespace ppu_recompiler_llvm {
         /// Update a CFG
         void UpdateControlFlowGraph(ControlFlowGraph & cfg, const ExecutionTraceEntry & this_entry, const ExecutionTraceEntry * next_entry);
 
-        /// Compile a block
-        void CompileBlock(BlockEntry & block_entry);
+        /// Queue a block for compilation
+        void CompileBlock(BlockEntry & block_entry, bool from_cache = false);
+
+        /// Start the compile workers
+        void StartWorkers();
+
+        /// Stop the compile workers and wait for them to exit
+        void StopWorkers();
+
+        /// Compile worker. Compiles queued blocks using the specified compiler.
+        void WorkerTask(Compiler & compiler);
+
+        /// Get the directory of the block cache files
+        std::string GetCacheDirectory() const;
+
+        /// Get the path of the block cache file for the current executable
+        std::string GetCacheFilePath() const;
+
+        /// Load CFGs from the block cache and compile them
+        void LoadCache();
+
+        /// Called when a block from the block cache is compiled (or when loading the cache is done)
+        void CachedBlockCompiled();
+
+        /// Save CFGs of all compiled blocks to the block cache
+        void SaveCache();
+
+        /// Hash the instructions of a CFG. Returns 0 if an instruction is not in mapped memory.
+        static u64 HashCode(const ControlFlowGraph & cfg);
 
         /// Mutex used to prevent multiple creation
         static std::mutex s_mutex;
@@ -1149,18 +1246,9 @@ namespace ppu_recompiler_llvm {
         /// Execution tracer
         Tracer m_tracer;
 
-        /// The time at which the m_address_to_ordinal cache was last cleared
-        mutable std::chrono::high_resolution_clock::time_point m_last_cache_clear_time;
-
-        /// Address to ordinal cahce. Key is address. Data is the pair (ordinal, times hit).
-        mutable std::unordered_map<u32, std::pair<u32, u32>> m_address_to_ordinal;
-
         /// Recompilation engine
         std::shared_ptr<RecompilationEngine> m_recompilation_engine;
 
-        /// Remove unused entries from the m_address_to_ordinal cache
-        void RemoveUnusedEntriesFromCache() const;
-
         /// Get the executable for the specified address
         Executable GetExecutable(u32 address, Executable default_executable) const;
 
@@ -20,6 +20,8 @@
 #include <sys/stat.h>
 #endif
 
+//#define PPU_INTERPRETER_BENCHMARK 1 // log instruction count and MIPS of the precomputed PPU interpreter on thread exit
+
 u64 rotate_mask[64][64];
 
 const ppu_inter_func_t g_ppu_inter_func_list[] =
@@ -429,7 +431,15 @@ const ppu_inter_func_t g_ppu_inter_func_list[] =
 extern u32 ppu_get_tls(u32 thread);
 extern void ppu_free_tls(u32 thread);
 
-void* g_ppu_exec_map = nullptr;
+// PPU executable map: one u64 entry per guest instruction, containing the opcode it was decoded from (high word)
+// and the index of its interpreter function in g_ppu_inter_func_list (low word). Entries are decoded lazily on first
+// execution and re-decoded whenever the opcode in memory doesn't match anymore, so code modifications are handled
+// without explicit invalidation. A zeroed entry is valid as well (opcode 0 -> NULL_OP).
+u64* g_ppu_exec_map = nullptr;
+
+const u64 g_ppu_exec_map_size = 0x100000000ull / 4 * sizeof(u64);
+
+std::unordered_map<ppu_inter_func_t, u32> g_ppu_inter_func_index;
 
 void finalize_ppu_exec_map()
 {
@@ -438,7 +448,7 @@ void finalize_ppu_exec_map()
 #ifdef _WIN32
 		VirtualFree(g_ppu_exec_map, 0, MEM_RELEASE);
 #else
-		munmap(g_ppu_exec_map, 0x100000000);
+		munmap(g_ppu_exec_map, g_ppu_exec_map_size);
 #endif
 		g_ppu_exec_map = nullptr;
 	}
@@ -449,44 +459,44 @@ void initialize_ppu_exec_map()
 	finalize_ppu_exec_map();
 
 #ifdef _WIN32
-	g_ppu_exec_map = VirtualAlloc(NULL, 0x100000000, MEM_RESERVE, PAGE_NOACCESS);
+	g_ppu_exec_map = (u64*)VirtualAlloc(NULL, g_ppu_exec_map_size, MEM_RESERVE, PAGE_NOACCESS);
 #else
-	g_ppu_exec_map = mmap(nullptr, 0x100000000, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	g_ppu_exec_map = (u64*)mmap(nullptr, g_ppu_exec_map_size, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
 #endif
+
+	if (g_ppu_inter_func_index.empty())
+	{
+		// build reverse lookup table (function -> index)
+		for (u32 index = 0; index < sizeof(g_ppu_inter_func_list) / sizeof(ppu_inter_func_t); index++)
+		{
+			g_ppu_inter_func_index.emplace(g_ppu_inter_func_list[index], index);
+		}
+	}
 }
 
 void fill_ppu_exec_map(u32 addr, u32 size)
 {
+	// only commit memory, entries are decoded on demand
 #ifdef _WIN32
-	VirtualAlloc((u8*)g_ppu_exec_map + addr, size, MEM_COMMIT, PAGE_READWRITE);
+	VirtualAlloc(g_ppu_exec_map + addr / 4, size / 4 * sizeof(u64), MEM_COMMIT, PAGE_READWRITE);
 #else
-	mprotect((u8*)g_ppu_exec_map + addr, size, PROT_READ | PROT_WRITE);
+	mprotect(g_ppu_exec_map + addr / 4, size / 4 * sizeof(u64), PROT_READ | PROT_WRITE);
 #endif
+}
 
-	PPUInterpreter2* inter;
-	PPUDecoder dec(inter = new PPUInterpreter2);
-
-	for (u32 pos = addr; pos < addr + size; pos += 4)
-	{
-		inter->func = ppu_interpreter::NULL_OP;
+u64 decode_ppu_exec_entry(u32 opcode)
+{
+	PPUInterpreter2 inter;
 
-		// decode PPU opcode
-		dec.Decode(vm::read32(pos));
+	inter.func = ppu_interpreter::NULL_OP;
 
-		u32 index = 0;
+	// decode PPU opcode
+	(*PPU_instr::main_list)(&inter, opcode);
 
-		// find function index
-		for (; index < sizeof(g_ppu_inter_func_list) / sizeof(ppu_inter_func_t); index++)
-		{
-			if (inter->func == g_ppu_inter_func_list[index])
-			{
-				break;
-			}
-		}
+	const auto found = g_ppu_inter_func_index.find(inter.func);
 
-		// write index in memory
-		*(u32*)((u8*)g_ppu_exec_map + pos) = index;
-	}
+	// unknown functions are handled by NULL_OP (index 0)
+	return (u64)opcode << 32 | (found != g_ppu_inter_func_index.end() ? found->second : 0);
 }
 
 PPUThread& GetCurrentPPUThread()
@@ -713,36 +723,63 @@ void PPUThread::Task()
 		return CPUThread::Task();
 	}
 
+#ifdef PPU_INTERPRETER_BENCHMARK
+	const auto bench_start = std::chrono::high_resolution_clock::now();
+	u64 bench_count = 0;
+	u64 bench_decoded = 0;
+#endif
+
 	while (true)
 	{
+		// read opcode
+		const ppu_opcode_t opcode = { vm::read32(PC) };
+
+		// get executable map entry, decode it again if it was decoded from another opcode
+		u64& entry = g_ppu_exec_map[PC / 4];
+
+		if (entry >> 32 != opcode.opcode)
+		{
+			entry = decode_ppu_exec_entry(opcode.opcode);
+#ifdef PPU_INTERPRETER_BENCHMARK
+			bench_decoded++;
+#endif
+		}
+
 		// get interpreter function
-		const auto func = g_ppu_inter_func_list[*(u32*)((u8*)g_ppu_exec_map + PC)];
+		const auto func = g_ppu_inter_func_list[(u32)entry];
 
 		if (m_events)
 		{
 			// process events
 			if (Emu.IsStopped())
 			{
-				return;
+				break;
 			}
 
 			if (m_events & CPU_EVENT_STOP && (IsStopped() || IsPaused()))
 			{
 				m_events &= ~CPU_EVENT_STOP;
-				return;
+				break;
 			}
 		}
 
-		// read opcode
-		const ppu_opcode_t opcode = { vm::read32(PC) };
-
 		// call interpreter function
 		func(*this, opcode);
 
+#ifdef PPU_INTERPRETER_BENCHMARK
+		bench_count++;
+#endif
+
 		// next instruction
 		//PC += 4;
 		NextPc(4);
 	}
+
+#ifdef PPU_INTERPRETER_BENCHMARK
+	const double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - bench_start).count();
+	LOG_NOTICE(PPU, "%s: precomputed interpreter: %lld instructions (%lld decoded) in %.3fs (%.2f MIPS)", GetFName().c_str(),
+		bench_count, bench_decoded, time, time ? bench_count / time / 1000000 : 0.0);
+#endif
 }
 
 ppu_thread::ppu_thread(u32 entry, const std::string& name, u32 stack_size, u32 prio)
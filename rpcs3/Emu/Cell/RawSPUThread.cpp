@@ -165,6 +165,7 @@ bool RawSPUThread::WriteReg(const u32 addr, const u32 value)
 
 	case SPU_In_MBox_offs:
 	{
+		invalidate_ls();
 		ch_in_mbox.push_uncond(value); 
 		return true;
 	}
@@ -202,12 +203,14 @@ bool RawSPUThread::WriteReg(const u32 addr, const u32 value)
 
 	case SPU_RdSigNotify1_offs:
 	{
+		invalidate_ls();
 		write_snr(0, value);
 		return true;
 	}
 
 	case SPU_RdSigNotify2_offs:
 	{
+		invalidate_ls();
 		write_snr(1, value);
 		return true;
 	}
@@ -329,7 +329,10 @@ void spu_interpreter::STOPD(SPUThread& CPU, spu_opcode_t op)
 
 void spu_interpreter::STQX(SPUThread& CPU, spu_opcode_t op)
 {
-	CPU.write128((CPU.GPR[op.ra]._u32[3] + CPU.GPR[op.rb]._u32[3]) & 0x3fff0, CPU.GPR[op.rt]);
+	const u32 lsa = (CPU.GPR[op.ra]._u32[3] + CPU.GPR[op.rb]._u32[3]) & 0x3fff0;
+
+	CPU.write128(lsa, CPU.GPR[op.rt]);
+	CPU.ls_dirty[lsa / 128] = 1;
 }
 
 void spu_interpreter::BI(SPUThread& CPU, spu_opcode_t op)
@@ -937,7 +940,10 @@ void spu_interpreter::BRZ(SPUThread& CPU, spu_opcode_t op)
 
 void spu_interpreter::STQA(SPUThread& CPU, spu_opcode_t op)
 {
-	CPU.write128((op.i16 << 2) & 0x3fff0, CPU.GPR[op.rt]);
+	const u32 lsa = (op.i16 << 2) & 0x3fff0;
+
+	CPU.write128(lsa, CPU.GPR[op.rt]);
+	CPU.ls_dirty[lsa / 128] = 1;
 }
 
 void spu_interpreter::BRNZ(SPUThread& CPU, spu_opcode_t op)
@@ -966,7 +972,10 @@ void spu_interpreter::BRHNZ(SPUThread& CPU, spu_opcode_t op)
 
 void spu_interpreter::STQR(SPUThread& CPU, spu_opcode_t op)
 {
-	CPU.write128(SPUOpcodes::branchTarget(CPU.PC, op.i16) & 0x3fff0, CPU.GPR[op.rt]);
+	const u32 lsa = SPUOpcodes::branchTarget(CPU.PC, op.i16) & 0x3fff0;
+
+	CPU.write128(lsa, CPU.GPR[op.rt]);
+	CPU.ls_dirty[lsa / 128] = 1;
 }
 
 void spu_interpreter::BRA(SPUThread& CPU, spu_opcode_t op)
@@ -1081,7 +1090,10 @@ void spu_interpreter::AHI(SPUThread& CPU, spu_opcode_t op)
 
 void spu_interpreter::STQD(SPUThread& CPU, spu_opcode_t op)
 {
-	CPU.write128((CPU.GPR[op.ra]._s32[3] + (op.si10 << 4)) & 0x3fff0, CPU.GPR[op.rt]);
+	const u32 lsa = (CPU.GPR[op.ra]._s32[3] + (op.si10 << 4)) & 0x3fff0;
+
+	CPU.write128(lsa, CPU.GPR[op.rt]);
+	CPU.ls_dirty[lsa / 128] = 1;
 }
 
 void spu_interpreter::LQD(SPUThread& CPU, spu_opcode_t op)
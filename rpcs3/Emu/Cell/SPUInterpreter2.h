@@ -84,6 +84,12 @@ union spu_opcode_t
 
 using spu_inter_func_t = void(*)(SPUThread& CPU, spu_opcode_t opcode);
 
+struct spu_decoded_op_t // pre-decoded LS word for the threaded interpreter
+{
+	spu_inter_func_t func;
+	spu_opcode_t opcode;
+};
+
 namespace spu_interpreter
 {
 	void DEFAULT(SPUThread& CPU, spu_opcode_t op);
@@ -11,6 +11,18 @@ using namespace asmjit::host;
 
 class SPURecompiler;
 
+// compiled block shared between all SPU threads (see SPURecompilerCore.cpp)
+struct SPURecBlock
+{
+	u16 start; // LS position of the first instruction
+	u16 count; // count of instructions compiled
+	u64 hash; // hash of the LS words covered
+	std::vector<u32> code; // copy of the LS words covered (as stored in LS)
+	std::vector<u128> imm_table; // constants referenced by the compiled code
+	void* pointer; // pointer to executable memory object
+	u32 refs; // count of SPURecompilerCore entries referencing this block
+};
+
 class SPURecompilerCore : public CPUDecoder
 {
 	SPURecompiler* m_enc;
@@ -18,7 +30,6 @@ class SPURecompilerCore : public CPUDecoder
 
 public:
 	SPUInterpreter* inter;
-	JitRuntime runtime;
 	bool first;
 	bool need_check;
 
@@ -28,11 +39,14 @@ public:
 		u16 count; // count of instructions compiled from current point (and to be checked)
 		u32 valid; // copy of valid opcode for validation
 		void* pointer; // pointer to executable memory object
+		SPURecBlock* block; // shared block owning the pointer
 	};
 
 	SPURecEntry entry[0x10000];
 
-	std::vector<u128> imm_table;
+	std::vector<u16> line_blocks[0x40000 / 128]; // start positions of blocks covering each LS line
+
+	std::vector<u128> imm_table; // constants of the block being compiled
 
 	SPURecompilerCore(SPUThread& cpu);
 
@@ -40,6 +54,10 @@ public:
 
 	void Compile(u16 pos);
 
+	void Link(u16 start, SPURecBlock* block);
+
+	void Unlink(u16 start);
+
 	virtual void Decode(const u32 code);
 
 	virtual u32 DecodeMemory(const u32 address);
@@ -928,6 +946,8 @@ private:
 		c.bswap(*qw1);
 		c.mov(qword_ptr(*ls_var, *addr, 0, 0), *qw1);
 		c.mov(qword_ptr(*ls_var, *addr, 0, 8), *qw0);
+		c.shr(*addr, 7);
+		c.mov(byte_ptr(*cpu_var, *addr, 0, cpu_offsetof(ls_dirty)), 1);
 
 		LOG_OPCODE();
 	}
@@ -2274,6 +2294,7 @@ private:
 		c.bswap(*qw1);
 		c.mov(qword_ptr(*ls_var, lsa), *qw1);
 		c.mov(qword_ptr(*ls_var, lsa + 8), *qw0);
+		c.mov(cpu_byte(ls_dirty[lsa / 128]), 1);
 
 		LOG_OPCODE();
 	}
@@ -2325,6 +2346,7 @@ private:
 		c.bswap(*qw1);
 		c.mov(qword_ptr(*ls_var, lsa), *qw1);
 		c.mov(qword_ptr(*ls_var, lsa + 8), *qw0);
+		c.mov(cpu_byte(ls_dirty[lsa / 128]), 1);
 
 		LOG_OPCODE();
 	}
@@ -2622,6 +2644,8 @@ private:
 		c.bswap(*qw1);
 		c.mov(qword_ptr(*ls_var, *addr, 0, 0), *qw1);
 		c.mov(qword_ptr(*ls_var, *addr, 0, 8), *qw0);
+		c.shr(*addr, 7);
+		c.mov(byte_ptr(*cpu_var, *addr, 0, cpu_offsetof(ls_dirty)), 1);
 
 		LOG_OPCODE();
 	}
@@ -13,6 +13,179 @@
 #include "SPUInterpreter.h"
 #include "SPURecompiler.h"
 
+// Compiled code only depends on its LS position and on the LS words it was compiled from (constants
+// are kept in the block's own imm_table), so blocks are shared between all SPU threads running the same code.
+class SPURecCache
+{
+	std::mutex m_mutex;
+	std::unordered_map<u16, std::vector<std::unique_ptr<SPURecBlock>>> m_blocks; // blocks by start position
+	u32 m_count;
+	u64 m_hits;
+	u64 m_misses;
+
+	// free blocks not referenced by any SPU thread (m_mutex must be locked)
+	u32 evict()
+	{
+		u32 result = 0;
+
+		for (auto it = m_blocks.begin(); it != m_blocks.end();)
+		{
+			auto& list = it->second;
+
+			for (auto i = list.begin(); i != list.end();)
+			{
+				if ((*i)->refs)
+				{
+					i++;
+					continue;
+				}
+
+				runtime.release((*i)->pointer);
+				i = list.erase(i);
+				result++;
+			}
+
+			it = list.empty() ? m_blocks.erase(it) : std::next(it);
+		}
+
+		m_count -= result;
+		return result;
+	}
+
+public:
+	static const size_t max_code_size = 64 * 1024 * 1024; // unused blocks are freed above this limit
+
+	JitRuntime runtime;
+
+	SPURecCache()
+		: m_count(0)
+		, m_hits(0)
+		, m_misses(0)
+	{
+	}
+
+	static u64 hash(const u32* ls, u16 start, u32 size)
+	{
+		u64 result = 0xcbf29ce484222325ull; // FNV-1a
+
+		for (u32 i = 0; i < size; i++)
+		{
+			result = (result ^ ls[(u16)(start + i)]) * 0x100000001b3ull;
+		}
+
+		return result;
+	}
+
+	// find block compiled from the same LS words at the same position and reference it
+	SPURecBlock* find(const u32* ls, u16 start)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		const auto found = m_blocks.find(start);
+
+		if (found != m_blocks.end())
+		{
+			for (auto& block : found->second)
+			{
+				const u32 size = (u32)block->code.size();
+
+				if (hash(ls, start, size) != block->hash)
+				{
+					continue;
+				}
+
+				bool equal = true;
+
+				for (u32 i = 0; i < size; i++)
+				{
+					if (ls[(u16)(start + i)] != block->code[i])
+					{
+						equal = false;
+						break;
+					}
+				}
+
+				if (equal)
+				{
+					block->refs++;
+					m_hits++;
+					return block.get();
+				}
+			}
+		}
+
+		m_misses++;
+		return nullptr;
+	}
+
+	void* make(X86Compiler& compiler)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		return compiler.make();
+	}
+
+	// add new block and reference it (returns existing block if another thread compiled the same code)
+	SPURecBlock* add(std::unique_ptr<SPURecBlock> block)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto& list = m_blocks[block->start];
+
+		for (auto& b : list)
+		{
+			if (b->hash == block->hash && b->code == block->code)
+			{
+				runtime.release(block->pointer);
+				b->refs++;
+				return b.get();
+			}
+		}
+
+		if (runtime.getMemMgr()->getUsedBytes() > max_code_size)
+		{
+			const u32 count = evict();
+
+			LOG_NOTICE(SPU, "SPU recompiler cache: %d unused blocks freed", count);
+		}
+
+		block->refs = 1;
+		list.emplace_back(std::move(block));
+		m_count++;
+		return list.back().get();
+	}
+
+	void release(SPURecBlock* block)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		assert(block->refs);
+		block->refs--;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_hits || m_misses)
+		{
+			LOG_NOTICE(SPU, "SPU recompiler cache: hits=%lld, misses=%lld, blocks=%d, code size=%lld KiB",
+				m_hits, m_misses, m_count, (u64)runtime.getMemMgr()->getUsedBytes() / 1024);
+		}
+
+		evict();
+		m_hits = 0;
+		m_misses = 0;
+	}
+};
+
+SPURecCache g_spu_rec_cache;
+
+void spu_recompiler_cache_clear()
+{
+	g_spu_rec_cache.clear();
+}
+
 SPURecompilerCore::SPURecompilerCore(SPUThread& cpu)
 	: m_enc(new SPURecompiler(cpu, *this))
 	, inter(new SPUInterpreter(cpu))
@@ -27,6 +200,14 @@ SPURecompilerCore::SPURecompilerCore(SPUThread& cpu)
 
 SPURecompilerCore::~SPURecompilerCore()
 {
+	for (u32 i = 0; i < 0x10000; i++)
+	{
+		if (entry[i].block)
+		{
+			g_spu_rec_cache.release(entry[i].block);
+		}
+	}
+
 	delete m_enc;
 	delete inter;
 }
@@ -47,12 +228,23 @@ void SPURecompilerCore::Compile(u16 pos)
 	//StringLogger stringLogger;
 	//stringLogger.setOption(kLoggerOptionBinaryForm, true);
 
-	X86Compiler compiler(&runtime);
+	const u16 start = pos;
+	const u32* ls = vm::get_ptr<u32>(CPU.offset);
+
+	if (SPURecBlock* block = g_spu_rec_cache.find(ls, start))
+	{
+		Link(start, block);
+		first = false;
+		return;
+	}
+
+	imm_table.clear();
+
+	X86Compiler compiler(&g_spu_rec_cache.runtime);
 	m_enc->compiler = &compiler;
 	//compiler.setLogger(&stringLogger);
 
 	compiler.addFunc(kFuncConvHost, FuncBuilder4<u32, void*, void*, void*, u32>());
-	const u16 start = pos;
 	//u32 excess = 0;
 	entry[start].count = 0;
 
@@ -144,9 +336,32 @@ void SPURecompilerCore::Compile(u16 pos)
 	//const u64 stamp1 = get_system_time();
 	compiler.ret(pos_var);
 	compiler.endFunc();
-	entry[start].pointer = compiler.make();
+	void* pointer = g_spu_rec_cache.make(compiler);
 	compiler.setLogger(nullptr); // crashes without it
 
+	if (pointer)
+	{
+		std::unique_ptr<SPURecBlock> block(new SPURecBlock());
+		block->start = start;
+		block->count = entry[start].count;
+
+		for (u16 i = start;; i++)
+		{
+			block->code.push_back(ls[i]);
+			if (i == pos) break;
+		}
+
+		block->hash = SPURecCache::hash(ls, start, (u32)block->code.size());
+		block->imm_table = std::move(imm_table);
+		block->pointer = pointer;
+
+		Link(start, g_spu_rec_cache.add(std::move(block)));
+	}
+	else
+	{
+		entry[start].pointer = nullptr;
+	}
+
 	//std::string log = fmt::format("========== START POSITION 0x%x ==========\n\n", start * 4);
 	//log += stringLogger.getString();
 	//if (!entry[start].pointer)
@@ -167,53 +382,108 @@ void SPURecompilerCore::Compile(u16 pos)
 	first = false;
 }
 
-u32 SPURecompilerCore::DecodeMemory(const u32 address)
+void SPURecompilerCore::Link(u16 start, SPURecBlock* block)
 {
-	assert(CPU.offset == address - CPU.PC);
-	const u32 m_offset = CPU.offset;
-	const u16 pos = (u16)(CPU.PC >> 2);
+	entry[start].count = block->count;
+	entry[start].pointer = block->pointer;
+	entry[start].block = block;
 
-	//ConLog.Write("DecodeMemory: pos=%d", pos);
-	u32* ls = vm::get_ptr<u32>(m_offset);
+	for (u32 i = 0; i < block->code.size(); i++)
+	{
+		const u16 pos = start + i;
+		auto& list = line_blocks[pos / 32];
+
+		entry[pos].valid = block->code[i];
+
+		if (list.empty() || list.back() != start)
+		{
+			list.push_back(start);
+		}
+	}
+}
+
+void SPURecompilerCore::Unlink(u16 start)
+{
+	SPURecBlock* block = entry[start].block;
 
-	if (entry[pos].pointer)
+	for (u32 i = 0; i < block->code.size(); i++)
 	{
-		// check data (hard way)
-		bool is_valid = true;
-		if (need_check)
+		entry[(u16)(start + i)].valid = 0;
+	}
+
+	for (u32 i = 0; i < block->code.size(); i++)
+	{
+		const u16 pos = start + i;
+
+		if (i && pos % 32) continue; // once per line
+
+		auto& list = line_blocks[pos / 32];
+
+		list.erase(std::remove(list.begin(), list.end(), start), list.end());
+
+		// restore words of this line still covered by other blocks
+		for (const u16 other : list)
 		{
-			for (u32 i = 0; i < 0x10000; i++)
+			const SPURecBlock* b = entry[other].block;
+
+			for (u32 j = 0; j < b->code.size(); j++)
 			{
-				if (entry[i].valid && entry[i].valid != ls[i])
+				if ((u16)(other + j) / 32 == pos / 32)
 				{
-					is_valid = false;
-					break;
+					entry[(u16)(other + j)].valid = b->code[j];
 				}
 			}
-			need_check = false;
 		}
-		// invalidate if necessary
-		if (!is_valid)
+	}
+
+	g_spu_rec_cache.release(block);
+	entry[start].pointer = nullptr;
+	entry[start].block = nullptr;
+}
+
+u32 SPURecompilerCore::DecodeMemory(const u32 address)
+{
+	assert(CPU.offset == address - CPU.PC);
+	const u32 m_offset = CPU.offset;
+	const u16 pos = (u16)(CPU.PC >> 2);
+
+	//ConLog.Write("DecodeMemory: pos=%d", pos);
+	u32* ls = vm::get_ptr<u32>(m_offset);
+
+	if (entry[pos].pointer && need_check)
+	{
+		// only check LS lines written since the last check
+		for (u32 i = 0; i < sizeof(CPU.ls_dirty); i += sizeof(u64))
 		{
-			for (u32 i = 0; i < 0x10000; i++)
+			u64 dirty;
+			memcpy(&dirty, CPU.ls_dirty + i, sizeof(u64));
+
+			if (!dirty) continue;
+
+			for (u32 line = i; line < i + sizeof(u64); line++)
 			{
-				if (!entry[i].pointer) continue;
+				if (!CPU.ls_dirty[line]) continue;
 
-				if (!entry[i].valid || entry[i].valid != ls[i] ||
-					i + (u32)entry[i].count > (u32)pos &&
-					i < (u32)pos + (u32)entry[pos].count)
+				CPU.ls_dirty[line] = 0;
+
+				for (u32 j = line * 32; j < line * 32 + 32; j++)
 				{
-					runtime.release(entry[i].pointer);
-					entry[i].pointer = nullptr;
-					for (u32 j = i; j < i + (u32)entry[i].count; j++)
+					if (entry[j].valid && entry[j].valid != ls[j])
 					{
-						entry[j].valid = 0;
+						// invalidate all blocks covering modified line
+						while (line_blocks[line].size())
+						{
+							Unlink(line_blocks[line].back());
+						}
+
+						//LOG_ERROR(Log::SPU, "SPURecompilerCore::DecodeMemory(ls=0x%x): code has changed", j * sizeof(u32));
+						break;
 					}
-					//need_check = true;
 				}
 			}
-			//LOG_ERROR(Log::SPU, "SPURecompilerCore::DecodeMemory(ls=0x%x): code has changed", pos * sizeof(u32));
 		}
+
+		need_check = false;
 	}
 
 	bool did_compile = false;
@@ -248,7 +518,7 @@ u32 SPURecompilerCore::DecodeMemory(const u32 address)
 	}
 
 	u32 res = pos;
-	res = func(cpu, vm::get_ptr<void>(m_offset), imm_table.data(), &g_spu_imm);
+	res = func(cpu, vm::get_ptr<void>(m_offset), entry[pos].block->imm_table.data(), &g_spu_imm);
 
 	if (res & 0x1000000)
 	{
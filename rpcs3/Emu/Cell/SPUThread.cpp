@@ -78,6 +78,15 @@ SPUThread::SPUThread(CPUThreadType type) : CPUThread(type)
 
 SPUThread::~SPUThread()
 {
+	delete[] ls_decoded;
+
+	if (dma_cmd_count)
+	{
+		const double time = (get_system_time() - dma_start_time) / 1000000.0;
+
+		LOG_NOTICE(SPU, "%s: DMA: %lld commands, %lld copies, %lld KB (%.2f MB/s), average queue depth %.2f, max %d", GetFName().c_str(),
+			dma_cmd_count, dma_copy_count, dma_bytes / 1024, time ? dma_bytes / time / 1000000 : 0.0, dma_enqueue_count ? (double)dma_queue_depth_sum / dma_enqueue_count : 0.0, dma_queue_depth_max);
+	}
 }
 
 void SPUThread::Task()
@@ -86,39 +95,66 @@ void SPUThread::Task()
 
 	if (m_custom_task)
 	{
-		return m_custom_task(*this);
+		m_custom_task(*this);
+
+		return process_mfc_pending();
 	}
 	
 	if (m_dec)
 	{
-		return CPUThread::Task();
+		CPUThread::Task();
+
+		return process_mfc_pending();
 	}
 	
+	if (!ls_decoded)
+	{
+		ls_decoded = new spu_decoded_op_t[0x40000 / 4];
+	}
+
+	// LS could be modified directly while the thread was not running
+	memset(ls_dirty, 0xff, sizeof(ls_dirty));
+
 	while (true)
 	{
-		// read opcode
-		const spu_opcode_t opcode = { vm::read32(PC + offset) };
+		const u32 pc = PC & 0x3fffc;
 
-		// get interpreter function
-		const auto func = g_spu_inter_func_list[opcode.opcode];
+		if (ls_dirty[pc / 128])
+		{
+			ls_dirty[pc / 128] = 0;
+
+			// decode LS line (written by DMA or SPU store)
+			for (u32 i = pc & ~127; i < (pc & ~127) + 128; i += 4)
+			{
+				const u32 opcode = vm::read32(i + offset);
+
+				ls_decoded[i / 4].func = g_spu_inter_func_list[opcode];
+				ls_decoded[i / 4].opcode.opcode = opcode;
+			}
+		}
+
+		// get pre-decoded interpreter function and opcode
+		const spu_decoded_op_t op = ls_decoded[pc / 4];
+
+		check_mfc_pending();
 
 		if (m_events)
 		{
 			// process events
 			if (Emu.IsStopped())
 			{
-				return;
+				return process_mfc_pending();
 			}
 
 			if (m_events & CPU_EVENT_STOP && (IsStopped() || IsPaused()))
 			{
 				m_events &= ~CPU_EVENT_STOP;
-				return;
+				return process_mfc_pending();
 			}
 		}
 
 		// call interpreter function
-		func(*this, opcode);
+		op.func(*this, op.opcode);
 
 		// next instruction
 		//PC += 4;
@@ -126,6 +162,11 @@ void SPUThread::Task()
 	}
 }
 
+void SPUThread::Step()
+{
+	check_mfc_pending();
+}
+
 void SPUThread::DoReset()
 {
 	InitRegs();
@@ -138,6 +179,7 @@ void SPUThread::InitRegs()
 
 	ch_mfc_args = {};
 	mfc_queue.clear();
+	mfc_pending.clear();
 
 	ch_tag_mask = 0;
 	ch_tag_stat = {};
@@ -167,6 +209,8 @@ void SPUThread::InitRegs()
 	int0.clear();
 	int2.clear();
 
+	memset(ls_dirty, 0, sizeof(ls_dirty));
+
 	GPR[1]._u32[3] = 0x3FFF0; // initial stack frame pointer
 }
 
@@ -262,6 +306,9 @@ void SPUThread::FastStop()
 
 void SPUThread::FastRun()
 {
+	// LS could be modified directly while the thread was stopped
+	memset(ls_dirty, 0xff, sizeof(ls_dirty));
+
 	m_status = Running;
 	Exec();
 }
@@ -274,6 +321,7 @@ void SPUThread::do_dma_transfer(u32 cmd, spu_mfc_arg_t args)
 	}
 
 	u32 eal = vm::cast(args.ea, "ea");
+	SPUThread* target = nullptr; // other SPU thread of the group whose LS is written
 
 	if (eal >= SYS_SPU_THREAD_BASE_LOW && m_type == CPU_THREAD_SPU) // SPU Thread Group MMIO (LS and SNR)
 	{
@@ -289,6 +337,7 @@ void SPUThread::do_dma_transfer(u32 cmd, spu_mfc_arg_t args)
 			if (offset + args.size - 1 < 0x40000) // LS access
 			{
 				eal = spu.offset + offset; // redirect access
+				target = &spu;
 			}
 			else if ((cmd & MFC_PUT_CMD) && args.size == 4 && (offset == SYS_SPU_THREAD_SNR1 || offset == SYS_SPU_THREAD_SNR2))
 			{
@@ -314,12 +363,29 @@ void SPUThread::do_dma_transfer(u32 cmd, spu_mfc_arg_t args)
 	case MFC_PUTR_CMD:
 	{
 		memcpy(vm::get_ptr(eal), vm::get_ptr(offset + args.lsa), args.size);
+
+		if (target)
+		{
+			// mark after the copy so the target thread can't re-decode the old data and clear the mark
+			target->mark_ls_dirty(eal - target->offset, args.size);
+		}
+		else
+		{
+			// plain stores don't go through the reservation table, wake threads waiting on this memory
+			waiter_map_t::notify_range(eal, args.size);
+		}
+
+		dma_copy_count++;
+		dma_bytes += args.size;
 		return;
 	}
 
 	case MFC_GET_CMD:
 	{
 		memcpy(vm::get_ptr(offset + args.lsa), vm::get_ptr(eal), args.size);
+		mark_ls_dirty(args.lsa, args.size);
+		dma_copy_count++;
+		dma_bytes += args.size;
 		return;
 	}
 	}
@@ -347,28 +413,49 @@ void SPUThread::do_dma_list_cmd(u32 cmd, spu_mfc_arg_t args)
 		be_t<u32> ea; // External Address Low
 	};
 
+	const auto list = vm::get_ptr<const list_element>(offset + list_addr);
+
+	// adjacent elements (contiguous both in LS and in main memory) are merged into one transfer
+	spu_mfc_arg_t merged = {};
+
 	for (u32 i = 0; i < list_size; i++)
 	{
-		auto rec = vm::ptr<list_element>::make(offset + list_addr + i * 8);
+		const auto& rec = list[i];
 
-		const u32 size = rec->ts;
-		const u32 addr = rec->ea;
+		const u32 size = rec.ts;
+		const u32 addr = rec.ea;
 
 		if (size)
 		{
-			spu_mfc_arg_t transfer;
-			transfer.ea = addr;
-			transfer.lsa = args.lsa | (addr & 0xf);
-			transfer.tag = args.tag;
-			transfer.size = size;
+			const u32 lsa = args.lsa | (addr & 0xf);
 
-			do_dma_transfer(cmd & ~MFC_LIST_MASK, transfer);
+			if (merged.size && merged.eal + merged.size == addr && merged.lsa + merged.size == lsa && merged.size + size < 0x10000 && addr < SYS_SPU_THREAD_BASE_LOW)
+			{
+				merged.size += size;
+			}
+			else
+			{
+				if (merged.size)
+				{
+					do_dma_transfer(cmd & ~MFC_LIST_MASK, merged);
+				}
+
+				merged.ea = addr;
+				merged.lsa = lsa;
+				merged.tag = args.tag;
+				merged.size = size;
+			}
 
 			args.lsa += std::max<u32>(size, 16);
 		}
 
-		if (rec->sb.data() & se16(0x8000))
+		if (rec.sb.data() & se16(0x8000))
 		{
+			if (merged.size)
+			{
+				do_dma_transfer(cmd & ~MFC_LIST_MASK, merged);
+			}
+
 			ch_stall_stat.push_bit_or(1 << args.tag);
 
 			spu_mfc_arg_t stalled;
@@ -381,6 +468,124 @@ void SPUThread::do_dma_list_cmd(u32 cmd, spu_mfc_arg_t args)
 			return;
 		}
 	}
+
+	if (merged.size)
+	{
+		do_dma_transfer(cmd & ~MFC_LIST_MASK, merged);
+	}
+}
+
+void SPUThread::enqueue_mfc_cmd(u32 cmd)
+{
+	switch (cmd)
+	{
+	case MFC_PUT_CMD:
+	case MFC_PUTB_CMD:
+	case MFC_PUTF_CMD:
+	case MFC_PUTR_CMD:
+	case MFC_PUTRB_CMD:
+	case MFC_PUTRF_CMD:
+	case MFC_GET_CMD:
+	case MFC_GETB_CMD:
+	case MFC_GETF_CMD:
+	case MFC_PUTL_CMD:
+	case MFC_PUTLB_CMD:
+	case MFC_PUTLF_CMD:
+	case MFC_PUTRL_CMD:
+	case MFC_PUTRLB_CMD:
+	case MFC_PUTRLF_CMD:
+	case MFC_GETL_CMD:
+	case MFC_GETLB_CMD:
+	case MFC_GETLF_CMD:
+	{
+		if (Ini.HLELogging.GetValue())
+		{
+			LOG_NOTICE(SPU, "DMA %s (queued): cmd=0x%x, lsa=0x%x, ea=0x%llx, tag=0x%x, size=0x%x", get_mfc_cmd_name(cmd), cmd, ch_mfc_args.lsa, ch_mfc_args.ea, ch_mfc_args.tag, ch_mfc_args.size);
+		}
+
+		if (!dma_start_time)
+		{
+			dma_start_time = get_system_time();
+		}
+
+		dma_cmd_count++;
+
+		if (mfc_pending.size())
+		{
+			auto& last = mfc_pending.back().second;
+
+			// merge with the previous command if it's the same simple transfer and both ranges are contiguous
+			if (mfc_pending.back().first == cmd &&
+				(cmd == MFC_PUT_CMD || cmd == MFC_PUTR_CMD || cmd == MFC_GET_CMD) &&
+				last.tag == ch_mfc_args.tag &&
+				last.ea + last.size == ch_mfc_args.ea &&
+				last.lsa + last.size == ch_mfc_args.lsa &&
+				last.size + ch_mfc_args.size < 0x10000 &&
+				ch_mfc_args.ea + ch_mfc_args.size <= SYS_SPU_THREAD_BASE_LOW)
+			{
+				last.size += ch_mfc_args.size;
+				return;
+			}
+		}
+
+		if (mfc_pending.empty())
+		{
+			mfc_pending_steps = 0;
+		}
+
+		mfc_pending.emplace_back(cmd, ch_mfc_args);
+
+		dma_enqueue_count++;
+		dma_queue_depth_sum += mfc_pending.size();
+		dma_queue_depth_max = std::max<u32>(dma_queue_depth_max, (u32)mfc_pending.size());
+
+		if (mfc_pending.size() >= 16)
+		{
+			// MFC SPU command queue is full
+			process_mfc_pending();
+		}
+
+		return;
+	}
+	}
+
+	// other commands (atomic and unknown) are executed immediately, after all pending transfers
+	process_mfc_pending();
+	process_mfc_cmd(cmd);
+}
+
+void SPUThread::process_mfc_pending(u32 tag_mask)
+{
+	if (mfc_pending.empty())
+	{
+		return;
+	}
+
+	size_t kept = 0;
+
+	// perform commands of selected tag groups in issue order
+	for (size_t i = 0; i < mfc_pending.size(); i++)
+	{
+		const auto cmd = mfc_pending[i];
+
+		if (tag_mask & (1 << cmd.second.tag))
+		{
+			if (cmd.first & MFC_LIST_MASK)
+			{
+				do_dma_list_cmd(cmd.first, cmd.second);
+			}
+			else
+			{
+				do_dma_transfer(cmd.first, cmd.second);
+			}
+		}
+		else
+		{
+			mfc_pending[kept++] = cmd;
+		}
+	}
+
+	mfc_pending.resize(kept);
 }
 
 void SPUThread::process_mfc_cmd(u32 cmd)
@@ -427,11 +632,15 @@ void SPUThread::process_mfc_cmd(u32 cmd)
 			break;
 		}
 
-		vm::reservation_acquire(vm::get_ptr(offset + ch_mfc_args.lsa), vm::cast(ch_mfc_args.ea), 128, [this]()
+		vm::reservation_acquire(vm::get_ptr(offset + ch_mfc_args.lsa), vm::cast(ch_mfc_args.ea), 128, [](void* arg)
 		{
-			ch_event_stat |= SPU_EVENT_LR;
-			Notify();
-		});
+			auto& spu = *static_cast<SPUThread*>(arg);
+
+			spu.ch_event_stat |= SPU_EVENT_LR;
+			spu.Notify();
+		}, this);
+
+		mark_ls_dirty(ch_mfc_args.lsa, 128);
 
 		ch_atomic_stat.push_uncond(MFC_GETLLAR_SUCCESS);
 		return;
@@ -493,6 +702,11 @@ u32 SPUThread::get_ch_count(u32 ch)
 		LOG_NOTICE(SPU, "get_ch_count(ch=%d [%s])", ch, ch < 128 ? spu_ch_name[ch] : "???");
 	}
 
+	if (ch != MFC_RdTagStat && ch != MFC_WrTagUpdate)
+	{
+		process_mfc_pending(); // complete queued DMA before the SPU can observe anything else
+	}
+
 	switch (ch)
 	{
 	//case MFC_Cmd:             return 16;
@@ -521,6 +735,11 @@ u32 SPUThread::get_ch_value(u32 ch)
 		LOG_NOTICE(SPU, "get_ch_value(ch=%d [%s])", ch, ch < 128 ? spu_ch_name[ch] : "???");
 	}
 
+	if (ch != MFC_RdTagStat && ch != MFC_RdTagMask)
+	{
+		process_mfc_pending(); // complete queued DMA before the SPU can observe anything else
+	}
+
 	switch (ch)
 	{
 	//case SPU_RdSRR0:
@@ -640,6 +859,26 @@ void SPUThread::set_ch_value(u32 ch, u32 value)
 		LOG_NOTICE(SPU, "set_ch_value(ch=%d [%s], value=0x%x)", ch, ch < 128 ? spu_ch_name[ch] : "???", value);
 	}
 
+	switch (ch)
+	{
+	case MFC_LSA:
+	case MFC_EAH:
+	case MFC_EAL:
+	case MFC_Size:
+	case MFC_TagID:
+	case MFC_Cmd:
+	case MFC_WrTagMask:
+	case MFC_WrTagUpdate:
+	{
+		break; // these channels don't require completion of queued DMA
+	}
+
+	default:
+	{
+		process_mfc_pending(); // mailboxes, events, signals etc. may let PPU or other SPUs see the results
+	}
+	}
+
 	switch (ch)
 	{
 	//case SPU_WrSRR0:
@@ -861,6 +1100,8 @@ void SPUThread::set_ch_value(u32 ch, u32 value)
 
 	case MFC_WrTagUpdate:
 	{
+		process_mfc_pending(ch_tag_mask); // complete selected tag groups
+
 		ch_tag_stat.push_uncond(ch_tag_mask); // hack
 		return;
 	}
@@ -912,7 +1153,7 @@ void SPUThread::set_ch_value(u32 ch, u32 value)
 
 	case MFC_Cmd:
 	{
-		process_mfc_cmd(value);
+		enqueue_mfc_cmd(value);
 		ch_mfc_args = {}; // clear non-persistent data
 		return;
 	}
@@ -988,6 +1229,8 @@ void SPUThread::stop_and_signal(u32 code)
 		LOG_NOTICE(SPU, "stop_and_signal(code=0x%x)", code);
 	}
 
+	process_mfc_pending();
+
 	if (m_type == CPU_THREAD_RAW_SPU)
 	{
 		status.atomic_op([code](u32& status)
@@ -1195,6 +1438,8 @@ void SPUThread::halt()
 		LOG_NOTICE(SPU, "halt(code=0x%x)");
 	}
 
+	process_mfc_pending();
+
 	if (m_type == CPU_THREAD_RAW_SPU)
 	{
 		status.atomic_op([](u32& status)
@@ -4,6 +4,8 @@
 #include "Emu/Cell/SPUContext.h"
 #include "MFC.h"
 
+struct spu_decoded_op_t;
+
 struct event_queue_t;
 struct spu_group_t;
 
@@ -399,6 +401,9 @@ struct g_spu_imm_table_t
 
 extern const g_spu_imm_table_t g_spu_imm;
 
+// log SPU recompiler cache statistics and free unused blocks
+void spu_recompiler_cache_clear();
+
 enum FPSCR_EX
 {
 	//Single-precision exceptions
@@ -510,6 +515,16 @@ public:
 	spu_mfc_arg_t ch_mfc_args;
 
 	std::vector<std::pair<u32, spu_mfc_arg_t>> mfc_queue; // Only used for stalled list transfers
+	std::vector<std::pair<u32, spu_mfc_arg_t>> mfc_pending; // DMA commands issued by SPU but not performed yet
+	u32 mfc_pending_steps = 0; // execution steps since the first pending command was issued
+
+	u64 dma_cmd_count = 0; // DMA statistics (SPU lifetime)
+	u64 dma_copy_count = 0;
+	u64 dma_bytes = 0;
+	u64 dma_enqueue_count = 0; // commands added to the queue (not merged with the previous one)
+	u64 dma_queue_depth_sum = 0;
+	u32 dma_queue_depth_max = 0;
+	u64 dma_start_time = 0;
 
 	u32 ch_tag_mask;
 	spu_channel_t ch_tag_stat;
@@ -544,6 +559,24 @@ public:
 	std::array<std::pair<u32, std::weak_ptr<event_queue_t>>, 32> spuq; // Event Queue Keys for SPU Thread
 	std::weak_ptr<event_queue_t> spup[64]; // SPU Ports
 
+	u8 ls_dirty[0x40000 / 128]; // LS lines written since the last recompiler (or interpreter) check (set by DMA and SPU stores)
+
+	spu_decoded_op_t* ls_decoded = nullptr; // pre-decoded LS for the alternative interpreter, lines are re-decoded when dirty
+
+	void mark_ls_dirty(u32 lsa, u32 size)
+	{
+		for (u32 i = lsa / 128, end = (lsa + size + 127) / 128; i < end; i++)
+		{
+			ls_dirty[i % (0x40000 / 128)] = 1;
+		}
+	}
+
+	// PPU stores into the LS mapping of a running Raw SPU can't be tracked, so it's invalidated entirely before the SPU is signaled
+	void invalidate_ls()
+	{
+		memset(ls_dirty, 1, sizeof(ls_dirty));
+	}
+
 	void write_snr(bool number, u32 value)
 	{
 		if (!number)
@@ -573,6 +606,17 @@ public:
 	void do_dma_transfer(u32 cmd, spu_mfc_arg_t args);
 	void do_dma_list_cmd(u32 cmd, spu_mfc_arg_t args);
 	void process_mfc_cmd(u32 cmd);
+	void enqueue_mfc_cmd(u32 cmd);
+	void process_mfc_pending(u32 tag_mask = ~0);
+
+	// perform queued DMA if it stays pending for too long (the SPU may be spinning without accessing channels)
+	void check_mfc_pending()
+	{
+		if (mfc_pending.size() && ++mfc_pending_steps >= 1024)
+		{
+			process_mfc_pending();
+		}
+	}
 
 	u32 get_ch_count(u32 ch);
 	u32 get_ch_value(u32 ch);
@@ -602,6 +646,7 @@ public:
 	{
 		m_addr_to_hle_function_map[addr] = function;
 		write32(addr, 0x00000003); // STOP 3
+		mark_ls_dirty(addr, 4);
 	}
 
 	void UnregisterHleFunction(u32 addr)
@@ -690,6 +735,7 @@ public:
 	void FastRun();
 
 protected:
+	virtual void Step();
 	virtual void DoReset();
 	virtual void DoRun();
 	virtual void DoPause();
@@ -29,151 +29,269 @@ enum IDType
 	TYPE_OTHER,
 };
 
-class ID final
+class IdManager
 {
-	const std::type_info& m_info;
-	std::shared_ptr<void> m_data;
-	IDType m_type;
+	static const u32 s_first_id = 1;
 
-public:
-	template<typename T> ID(std::shared_ptr<T>& data, const IDType type)
-		: m_info(typeid(T))
-		, m_data(data)
-		, m_type(type)
+	static const u32 s_chunk_size = 4096; // number of IDs in one chunk of the ID table
+	static const u32 s_dir_size = 1024; // number of chunks in one directory
+	static const u32 s_dir_count = 1024; // number of directories (covers the whole u32 range)
+
+	static const u32 s_alive = 0x80000000;
+
+	// object slot, IDs are never reused until Clear(), so the slot is only changed by GetNewID() and RemoveID()
+	struct slot_t
 	{
-	}
+		std::atomic<u32> state; // s_alive flag and the number of readers copying data
+		u32 type_index; // object type tag (see type_index_t), set before the slot becomes alive
+		IDType type;
+		std::shared_ptr<void> data; // object (only changed when there are no readers)
+	};
+
+	// one chunk of IDs
+	struct chunk_t
+	{
+		std::array<slot_t, s_chunk_size> slots;
+	};
 
-	ID()
-		: m_info(typeid(void))
-		, m_data(nullptr)
-		, m_type(TYPE_OTHER)
+	// chunks of s_dir_size * s_chunk_size consecutive IDs
+	struct dir_t
 	{
-	}
+		std::array<std::atomic<chunk_t*>, s_dir_size> chunks;
 
-	ID(const ID& right) = delete;
+		dir_t()
+		{
+			for (auto& chunk : chunks)
+			{
+				chunk.store(nullptr);
+			}
+		}
 
-	ID(ID&& right)
-		: m_info(right.m_info)
-		, m_data(right.m_data)
-		, m_type(right.m_type)
+		~dir_t()
+		{
+			for (auto& chunk : chunks)
+			{
+				delete chunk.exchange(nullptr);
+			}
+		}
+	};
+
+	// tag of the object type (process-wide, 0 if no ID of the type was created yet)
+	template<typename T> struct type_index_t
 	{
-		right.m_data = nullptr;
-		right.m_type = TYPE_OTHER;
-	}
+		static std::atomic<u32> value;
+	};
+
+	// single ID table shared by all types, chunks are allocated when the first ID in them is created and freed only by Clear()
+	std::array<std::atomic<dir_t*>, s_dir_count> m_dirs;
 
-	ID& operator=(ID&& other) = delete;
+	std::set<u32> m_types[TYPE_OTHER];
+	std::mutex m_mutex; // for ID creation and removal, lookups are lock-free
+
+	u32 m_cur_id = s_first_id;
+	bool m_exhausted = false;
 
-	const std::type_info& GetInfo() const
+	// returns the slot if the ID exists (or was removed)
+	slot_t* FindSlot(const u32 id) const
 	{
-		return m_info;
+		const dir_t* dir = m_dirs[id / s_chunk_size / s_dir_size].load(std::memory_order_acquire);
+
+		if (!dir)
+		{
+			return nullptr;
+		}
+
+		chunk_t* chunk = dir->chunks[id / s_chunk_size % s_dir_size].load(std::memory_order_acquire);
+
+		return chunk ? &chunk->slots[id % s_chunk_size] : nullptr;
 	}
 
-	template<typename T> std::shared_ptr<T> GetData() const
+	// returns the slot if the ID exists, is alive and holds an object of the type
+	template<typename T> slot_t* FindSlot(const u32 id) const
 	{
-		return std::static_pointer_cast<T>(m_data);
+		const u32 index = type_index_t<T>::value.load(std::memory_order_acquire);
+
+		if (!index)
+		{
+			return nullptr;
+		}
+
+		slot_t* slot = FindSlot(id);
+
+		return slot && (slot->state.load(std::memory_order_acquire) & s_alive) && slot->type_index == index ? slot : nullptr;
 	}
 
-	IDType GetType() const
+	// must be called under m_mutex
+	slot_t& GetNewSlot(const u32 id)
 	{
-		return m_type;
+		auto& dir = m_dirs[id / s_chunk_size / s_dir_size];
+
+		if (!dir.load())
+		{
+			dir.store(new dir_t(), std::memory_order_release);
+		}
+
+		auto& chunk = dir.load()->chunks[id / s_chunk_size % s_dir_size];
+
+		if (!chunk.load())
+		{
+			chunk.store(new chunk_t(), std::memory_order_release);
+		}
+
+		return chunk.load()->slots[id % s_chunk_size];
 	}
-};
 
-class IdManager
-{
-	static const u32 s_first_id = 1;
-	static const u32 s_max_id = -1;
+	// must be called under m_mutex
+	static u32 GetNewTypeIndex()
+	{
+		static u32 s_type_count = 0;
 
-	std::unordered_map<u32, ID> m_id_map;
-	std::set<u32> m_types[TYPE_OTHER];
-	std::mutex m_mutex;
+		return ++s_type_count;
+	}
 
-	u32 m_cur_id = s_first_id;
+	// must be called under m_mutex
+	template<typename T> u32 GetTypeIndex()
+	{
+		auto& index = type_index_t<T>::value;
+
+		if (!index.load())
+		{
+			index.store(GetNewTypeIndex(), std::memory_order_release);
+		}
+
+		return index.load();
+	}
 
 public:
-	template<typename T> bool CheckID(const u32 id)
+	IdManager()
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& dir : m_dirs)
+		{
+			dir.store(nullptr);
+		}
+	}
 
-		auto f = m_id_map.find(id);
+	~IdManager()
+	{
+		Clear();
+	}
 
-		return f != m_id_map.end() && f->second.GetInfo() == typeid(T);
+	template<typename T> bool CheckID(const u32 id)
+	{
+		return FindSlot<T>(id) != nullptr;
 	}
 
+	// must not be called while other threads access IDs
 	void Clear()
 	{
 		std::lock_guard<std::mutex> lock(m_mutex);
 
-		m_id_map.clear();
+		for (auto& dir : m_dirs)
+		{
+			delete dir.exchange(nullptr);
+		}
+
+		for (auto& ids : m_types)
+		{
+			ids.clear();
+		}
+
 		m_cur_id = s_first_id;
+		m_exhausted = false;
 	}
 	
 	template<typename T> u32 GetNewID(std::shared_ptr<T>& data, const IDType type = TYPE_OTHER)
 	{
 		std::lock_guard<std::mutex> lock(m_mutex);
 
-		m_id_map.emplace(m_cur_id, ID(data, type));
+		if (m_exhausted)
+		{
+			throw "IdManager::GetNewID(): ID limit reached";
+		}
+
+		slot_t& slot = GetNewSlot(m_cur_id);
+
+		slot.type_index = GetTypeIndex<T>();
+		slot.type = type;
+		slot.data = std::static_pointer_cast<void>(data);
+		slot.state.store(s_alive, std::memory_order_release);
 
 		if (type < TYPE_OTHER)
 		{
 			m_types[type].insert(m_cur_id);
 		}
 
+		// IDs are never reused, stop after the last u32 value
+		m_exhausted = m_cur_id == 0xffffffff;
+
 		return m_cur_id++;
 	}
 
 	template<typename T> std::shared_ptr<T> GetIDData(const u32 id)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-
-		auto f = m_id_map.find(id);
+		slot_t* slot = FindSlot<T>(id);
 
-		if (f == m_id_map.end() || f->second.GetInfo() != typeid(T))
+		if (!slot)
 		{
 			return nullptr;
 		}
 
-		return f->second.GetData<T>();
+		// register as a reader, so RemoveID() waits before releasing the object
+		u32 state = slot->state.load(std::memory_order_acquire);
+
+		do
+		{
+			if (!(state & s_alive))
+			{
+				return nullptr;
+			}
+		}
+		while (!slot->state.compare_exchange_weak(state, state + 1, std::memory_order_acquire));
+
+		std::shared_ptr<T> result = std::static_pointer_cast<T>(slot->data);
+
+		slot->state.fetch_sub(1, std::memory_order_release);
+
+		return result;
 	}
 
 	bool HasID(const u32 id)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
+		slot_t* slot = FindSlot(id);
 
-		return m_id_map.find(id) != m_id_map.end();
+		return slot && (slot->state.load(std::memory_order_acquire) & s_alive);
 	}
 
 	IDType GetIDType(const u32 id)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
+		slot_t* slot = FindSlot(id);
 
-		auto item = m_id_map.find(id);
-
-		if (item == m_id_map.end())
-		{
-			return TYPE_OTHER;
-		}
-
-		return item->second.GetType();
+		return slot && (slot->state.load(std::memory_order_acquire) & s_alive) ? slot->type : TYPE_OTHER;
 	}
 
 	template<typename T> bool RemoveID(const u32 id)
 	{
 		std::lock_guard<std::mutex> lock(m_mutex);
 
-		auto item = m_id_map.find(id);
+		slot_t* slot = FindSlot<T>(id);
 
-		if (item == m_id_map.end() || item->second.GetInfo() != typeid(T))
+		if (!slot || !(slot->state.fetch_and(~s_alive) & s_alive))
 		{
 			return false;
 		}
 
-		if (item->second.GetType() < TYPE_OTHER)
+		if (slot->type < TYPE_OTHER)
 		{
-			m_types[item->second.GetType()].erase(id);
+			m_types[slot->type].erase(id);
 		}
 
-		m_id_map.erase(item);
+		// wait for readers which registered before the flag was cleared
+		while (slot->state.load(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+
+		slot->data.reset();
 
 		return true;
 	}
@@ -209,3 +327,5 @@ public:
 		}
 	}
 };
+
+template<typename T> std::atomic<u32> IdManager::type_index_t<T>::value(0);
@@ -1,11 +1,62 @@
 #include "stdafx.h"
+#include "rpcs3/Ini.h"
 #include "Utilities/Log.h"
 #include "Memory.h"
 
+//#define MEMORY_ALLOC_BENCHMARK 1
+
 MemoryBase Memory;
 
 std::mutex g_memory_mutex;
 
+// replay random allocation trace on the temporary memory block (enabled by MEMORY_ALLOC_BENCHMARK)
+void AllocationBenchmark()
+{
+#ifdef MEMORY_ALLOC_BENCHMARK
+	const u32 count = 100000; // number of operations
+
+	DynamicMemoryBlock block;
+	block.SetRange(0xf0000000, 0x8000000);
+
+	std::mt19937 rng(0);
+	std::vector<u32> trace; // allocation size and alignment (or zero to free random block)
+
+	for (u32 i = 0; i < count; i++)
+	{
+		trace.push_back(rng() % 3 ? (rng() % 0x10000 + 1) | (rng() % 8 ? 0 : 0x80000000) : 0);
+	}
+
+	std::vector<u32> blocks;
+	size_t max_blocks = 0;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	for (u32 op : trace)
+	{
+		if (op)
+		{
+			if (const u32 addr = block.AllocAlign(op & 0x7fffffff, op & 0x80000000 ? 0x10000 : 1))
+			{
+				blocks.push_back(addr);
+				max_blocks = std::max(max_blocks, blocks.size());
+			}
+		}
+		else if (blocks.size())
+		{
+			std::swap(blocks[rng() % blocks.size()], blocks.back());
+			block.Free(blocks.back());
+			blocks.pop_back();
+		}
+	}
+
+	const auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+	LOG_NOTICE(MEMORY, "Allocation benchmark: %d operations, %d blocks max, %lld us", count, max_blocks, time);
+
+	block.Delete();
+#endif
+}
+
 void MemoryBase::Init(MemoryType type)
 {
 	if (m_inited) return;
@@ -23,6 +74,9 @@ void MemoryBase::Init(MemoryType type)
 		return;
 	}
 
+	vm::reservation_set_mode(static_cast<vm::reservation_mode_t>(Ini.CPUReservationMode.GetValue()));
+	vm::set_huge_pages(Ini.CPUHugePages.GetValue());
+
 	switch (type)
 	{
 	case Memory_PS3:
@@ -170,6 +224,7 @@ MemoryBlock* MemoryBlock::SetRange(const u32 start, const u32 size)
 DynamicMemoryBlockBase::DynamicMemoryBlockBase()
 	: MemoryBlock()
 	, m_max_size(0)
+	, m_used_size(0)
 {
 }
 
@@ -177,14 +232,7 @@ const u32 DynamicMemoryBlockBase::GetUsedSize() const
 {
 	std::lock_guard<std::mutex> lock(g_memory_mutex);
 
-	u32 size = 0;
-
-	for (u32 i = 0; i<m_allocated.size(); ++i)
-	{
-		size += m_allocated[i].size;
-	}
-
-	return size;
+	return m_used_size;
 }
 
 bool DynamicMemoryBlockBase::IsInMyRange(const u32 addr, const u32 size)
@@ -203,6 +251,14 @@ MemoryBlock* DynamicMemoryBlockBase::SetRange(const u32 start, const u32 size)
 		return nullptr;
 	}
 
+	m_free.clear();
+	m_free_by_size.clear();
+
+	if (m_max_size)
+	{
+		InsertFree(start, m_max_size);
+	}
+
 	return this;
 }
 
@@ -211,7 +267,10 @@ void DynamicMemoryBlockBase::Delete()
 	std::lock_guard<std::mutex> lock(g_memory_mutex);
 
 	m_allocated.clear();
+	m_free.clear();
+	m_free_by_size.clear();
 	m_max_size = 0;
+	m_used_size = 0;
 
 	MemoryBlock::Delete();
 }
@@ -232,9 +291,17 @@ bool DynamicMemoryBlockBase::AllocFixed(u32 addr, u32 size)
 
 	std::lock_guard<std::mutex> lock(g_memory_mutex);
 
-	for (u32 i = 0; i<m_allocated.size(); ++i)
+	// find free range containing the start address
+	auto range = m_free.upper_bound(addr);
+
+	if (range == m_free.begin())
+	{
+		return false;
+	}
+
+	if (addr + size > (--range)->first + range->second)
 	{
-		if (addr >= m_allocated[i].addr && addr <= m_allocated[i].addr + m_allocated[i].size - 1) return false;
+		return false;
 	}
 
 	AppendMem(addr, size);
@@ -244,7 +311,62 @@ bool DynamicMemoryBlockBase::AllocFixed(u32 addr, u32 size)
 
 void DynamicMemoryBlockBase::AppendMem(u32 addr, u32 size) /* private */
 {
-	m_allocated.emplace_back(addr, size);
+	// split free range containing the block
+	auto range = --m_free.upper_bound(addr);
+
+	const u32 range_addr = range->first;
+	const u32 range_end = range->first + range->second;
+
+	assert(addr >= range_addr && addr + size <= range_end);
+
+	EraseFree(range);
+
+	if (addr > range_addr)
+	{
+		InsertFree(range_addr, addr - range_addr);
+	}
+
+	if (addr + size < range_end)
+	{
+		InsertFree(addr + size, range_end - (addr + size));
+	}
+
+	m_allocated.emplace(std::piecewise_construct, std::forward_as_tuple(addr), std::forward_as_tuple(addr, size));
+	m_used_size += size;
+}
+
+void DynamicMemoryBlockBase::InsertFree(u32 addr, u32 size) /* private */
+{
+	auto next = m_free.lower_bound(addr);
+
+	// merge with previous free range
+	if (next != m_free.begin())
+	{
+		auto prev = std::prev(next);
+
+		if (prev->first + prev->second == addr)
+		{
+			addr = prev->first;
+			size += prev->second;
+			EraseFree(prev);
+		}
+	}
+
+	// merge with next free range
+	if (next != m_free.end() && addr + size == next->first)
+	{
+		size += next->second;
+		EraseFree(next);
+	}
+
+	m_free.emplace(addr, size);
+	m_free_by_size.emplace(size, addr);
+}
+
+void DynamicMemoryBlockBase::EraseFree(std::map<u32, u32>::iterator range) /* private */
+{
+	m_free_by_size.erase(std::make_pair(range->second, range->first));
+	m_free.erase(range);
 }
 
 u32 DynamicMemoryBlockBase::AllocAlign(u32 size, u32 align)
@@ -258,51 +380,35 @@ u32 DynamicMemoryBlockBase::AllocAlign(u32 size, u32 align)
 	}
 
 	size = PAGE_4K(size);
-	u32 exsize;
 
-	if (align <= 4096)
-	{
-		align = 0;
-		exsize = size;
-	}
-	else
-	{
-		align &= ~4095;
-		exsize = size + align - 1;
-	}
+	// blocks are always page-aligned, clamp first so the extra size below can't underflow
+	align = std::max<u32>(align, 4096) & ~4095;
 
-	std::lock_guard<std::mutex> lock(g_memory_mutex);
+	const u32 exsize = size + align - 4096; // any free range of this size can contain aligned block
 
-	for (u32 addr = MemoryBlock::GetStartAddr(); addr <= MemoryBlock::GetEndAddr() - exsize;)
-	{
-		bool is_good_addr = true;
+	std::lock_guard<std::mutex> lock(g_memory_mutex);
 
-		for (u32 i = 0; i<m_allocated.size(); ++i)
-		{
-			if ((addr >= m_allocated[i].addr && addr <= m_allocated[i].addr + m_allocated[i].size - 1) ||
-				(m_allocated[i].addr >= addr && m_allocated[i].addr <= addr + exsize - 1))
-			{
-				is_good_addr = false;
-				addr = m_allocated[i].addr + m_allocated[i].size;
-				break;
-			}
-		}
+	// find the smallest free range (with the lowest address) which fits
+	// note: this is best fit, the addresses differ from the first fit used before
+	auto found = m_free_by_size.lower_bound(std::make_pair(size, 0u));
 
-		if (!is_good_addr) continue;
+	if (align > 4096 && found != m_free_by_size.end() && ((found->second + (align - 1)) & ~(align - 1)) + size > found->second + found->first)
+	{
+		found = m_free_by_size.lower_bound(std::make_pair(exsize, 0u));
+	}
 
-		if (align)
-		{
-			addr = (addr + (align - 1)) & ~(align - 1);
-		}
+	if (found == m_free_by_size.end())
+	{
+		return 0;
+	}
 
-		//LOG_NOTICE(MEMORY, "AllocAlign(size=0x%x) -> 0x%x", size, addr);
+	const u32 addr = (found->second + (align - 1)) & ~(align - 1);
 
-		AppendMem(addr, size);
+	//LOG_NOTICE(MEMORY, "AllocAlign(size=0x%x) -> 0x%x", size, addr);
 
-		return addr;
-	}
+	AppendMem(addr, size);
 
-	return 0;
+	return addr;
 }
 
 bool DynamicMemoryBlockBase::Alloc()
@@ -314,26 +420,30 @@ bool DynamicMemoryBlockBase::Free(u32 addr)
 {
 	std::lock_guard<std::mutex> lock(g_memory_mutex);
 
-	for (u32 num = 0; num < m_allocated.size(); num++)
+	auto found = m_allocated.find(addr);
+
+	if (found != m_allocated.end())
 	{
-		if (addr == m_allocated[num].addr)
-		{
-			//LOG_NOTICE(MEMORY, "Free(0x%x)", addr);
+		//LOG_NOTICE(MEMORY, "Free(0x%x)", addr);
 
-			m_allocated.erase(m_allocated.begin() + num);
-			return true;
-		}
+		const u32 size = found->second.size;
+
+		m_allocated.erase(found);
+		m_used_size -= size;
+
+		InsertFree(addr, size);
+		return true;
 	}
 
 	LOG_ERROR(MEMORY, "DynamicMemoryBlock::Free(addr=0x%x): failed", addr);
-	for (u32 i = 0; i < m_allocated.size(); i++)
+	for (auto& block : m_allocated)
 	{
-		LOG_NOTICE(MEMORY, "*** Memory Block: addr = 0x%x, size = 0x%x", m_allocated[i].addr, m_allocated[i].size);
+		LOG_NOTICE(MEMORY, "*** Memory Block: addr = 0x%x, size = 0x%x", block.second.addr, block.second.size);
 	}
 	return false;
 }
 
-VirtualMemoryBlock::VirtualMemoryBlock() : MemoryBlock(), m_reserve_size(0)
+VirtualMemoryBlock::VirtualMemoryBlock() : MemoryBlock(), m_reserve_size(0), m_used_size(0)
 {
 }
 
@@ -342,6 +452,10 @@ MemoryBlock* VirtualMemoryBlock::SetRange(const u32 start, const u32 size)
 	range_start = start;
 	range_size = size;
 
+	m_mapped_memory.clear();
+	m_pages.assign(size / 4096, 0);
+	m_used_size = 0;
+
 	return this;
 }
 
@@ -354,62 +468,63 @@ u32 VirtualMemoryBlock::Map(u32 realaddr, u32 size)
 {
 	assert(size);
 
-	for (u32 addr = GetStartAddr(); addr <= GetEndAddr() - GetReservedAmount() - size;)
-	{
-		bool is_good_addr = true;
+	// find the first gap between mapped ranges
+	u32 addr = GetStartAddr();
 
-		// check if address is already mapped
-		for (u32 i = 0; i<m_mapped_memory.size(); ++i)
+	for (auto& mapped : m_mapped_memory)
+	{
+		if (addr + size <= mapped.first)
 		{
-			if ((addr >= m_mapped_memory[i].addr && addr < m_mapped_memory[i].addr + m_mapped_memory[i].size) ||
-				(m_mapped_memory[i].addr >= addr && m_mapped_memory[i].addr < addr + size))
-			{
-				is_good_addr = false;
-				addr = m_mapped_memory[i].addr + m_mapped_memory[i].size;
-				break;
-			}
+			break;
 		}
 
-		if (!is_good_addr) continue;
-
-		m_mapped_memory.emplace_back(addr, realaddr, size);
+		addr = std::max(addr, mapped.first + mapped.second.size);
+	}
 
-		return addr;
+	if (addr > GetEndAddr() - GetReservedAmount() - size || !Map(realaddr, size, addr))
+	{
+		return 0;
 	}
 
-	return 0;
+	return addr;
 }
 
 bool VirtualMemoryBlock::Map(u32 realaddr, u32 size, u32 addr)
 {
-	assert(size);
+	assert(size && ((realaddr | size | addr) & 4095) == 0);
 
 	if (!IsInMyRange(addr, size))
 	{
 		return false;
 	}
 
-	for (u32 i = 0; i<m_mapped_memory.size(); ++i)
+	const u32 first = (addr - GetStartAddr()) / 4096;
+
+	for (u32 i = first; i < first + size / 4096; i++)
 	{
-		if (addr >= m_mapped_memory[i].addr && addr + size - 1 <= m_mapped_memory[i].addr + m_mapped_memory[i].size - 1)
+		if (m_pages[i])
 		{
 			return false;
 		}
 	}
 
-	m_mapped_memory.emplace_back(addr, realaddr, size);
+	for (u32 i = 0; i < size / 4096; i++)
+	{
+		m_pages[first + i] = (realaddr + i * 4096) | 1;
+	}
+
+	m_mapped_memory.emplace(addr, VirtualMemInfo(addr, realaddr, size));
+	m_used_size += size;
 	return true;
 }
 
 bool VirtualMemoryBlock::UnmapRealAddress(u32 realaddr, u32& size)
 {
-	for (u32 i = 0; i<m_mapped_memory.size(); ++i)
+	for (auto& mapped : m_mapped_memory)
 	{
-		if (m_mapped_memory[i].realAddress == realaddr && IsInMyRange(m_mapped_memory[i].addr, m_mapped_memory[i].size))
+		if (mapped.second.realAddress == realaddr && IsInMyRange(mapped.first, mapped.second.size))
 		{
-			size = m_mapped_memory[i].size;
-			m_mapped_memory.erase(m_mapped_memory.begin() + i);
-			return true;
+			return UnmapAddress(mapped.first, size);
 		}
 	}
 
@@ -418,17 +533,22 @@ bool VirtualMemoryBlock::UnmapRealAddress(u32 realaddr, u32& size)
 
 bool VirtualMemoryBlock::UnmapAddress(u32 addr, u32& size)
 {
-	for (u32 i = 0; i<m_mapped_memory.size(); ++i)
+	auto found = m_mapped_memory.find(addr);
+
+	if (found == m_mapped_memory.end() || !IsInMyRange(addr, found->second.size))
 	{
-		if (m_mapped_memory[i].addr == addr && IsInMyRange(m_mapped_memory[i].addr, m_mapped_memory[i].size))
-		{
-			size = m_mapped_memory[i].size;
-			m_mapped_memory.erase(m_mapped_memory.begin() + i);
-			return true;
-		}
+		return false;
 	}
 
-	return false;
+	size = found->second.size;
+
+	const u32 first = (addr - GetStartAddr()) / 4096;
+
+	std::fill(m_pages.begin() + first, m_pages.begin() + first + size / 4096, 0);
+
+	m_mapped_memory.erase(found);
+	m_used_size -= size;
+	return true;
 }
 
 bool VirtualMemoryBlock::Read32(const u32 addr, u32* value)
@@ -449,27 +569,13 @@ bool VirtualMemoryBlock::Write32(const u32 addr, const u32 value)
 	return true;
 }
 
-bool VirtualMemoryBlock::getRealAddr(u32 addr, u32& result)
-{
-	for (u32 i = 0; i<m_mapped_memory.size(); ++i)
-	{
-		if (addr >= m_mapped_memory[i].addr && addr < m_mapped_memory[i].addr + m_mapped_memory[i].size)
-		{
-			result = m_mapped_memory[i].realAddress + (addr - m_mapped_memory[i].addr);
-			return true;
-		}
-	}
-
-	return false;
-}
-
 u32 VirtualMemoryBlock::getMappedAddress(u32 realAddress)
 {
-	for (u32 i = 0; i<m_mapped_memory.size(); ++i)
+	for (auto& mapped : m_mapped_memory)
 	{
-		if (realAddress >= m_mapped_memory[i].realAddress && realAddress < m_mapped_memory[i].realAddress + m_mapped_memory[i].size)
+		if (realAddress >= mapped.second.realAddress && realAddress < mapped.second.realAddress + mapped.second.size)
 		{
-			return m_mapped_memory[i].addr + (realAddress - m_mapped_memory[i].realAddress);
+			return mapped.first + (realAddress - mapped.second.realAddress);
 		}
 	}
 
@@ -479,6 +585,8 @@ u32 VirtualMemoryBlock::getMappedAddress(u32 realAddress)
 void VirtualMemoryBlock::Delete()
 {
 	m_mapped_memory.clear();
+	m_pages.clear();
+	m_used_size = 0;
 
 	MemoryBlock::Delete();
 }
@@ -89,4 +89,7 @@ public:
 
 extern MemoryBase Memory;
 
+// replay random allocation trace on the temporary memory block (enabled by MEMORY_ALLOC_BENCHMARK)
+void AllocationBenchmark();
+
 #include "vm.h"
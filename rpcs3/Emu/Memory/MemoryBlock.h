@@ -104,8 +104,11 @@ public:
 
 class DynamicMemoryBlockBase : public MemoryBlock
 {
-	std::vector<MemBlockInfo> m_allocated; // allocation info
+	std::map<u32, MemBlockInfo> m_allocated; // allocation info (key is the block address)
+	std::map<u32, u32> m_free; // free ranges (key is the range address, value is its size), adjacent ranges are always merged
+	std::set<std::pair<u32, u32>> m_free_by_size; // the same free ranges ordered by size and address
 	u32 m_max_size;
+	u32 m_used_size;
 
 public:
 	DynamicMemoryBlockBase();
@@ -126,12 +129,16 @@ public:
 
 private:
 	void AppendMem(u32 addr, u32 size);
+	void InsertFree(u32 addr, u32 size);
+	void EraseFree(std::map<u32, u32>::iterator range);
 };
 
 class VirtualMemoryBlock : public MemoryBlock
 {
-	std::vector<VirtualMemInfo> m_mapped_memory;
+	std::map<u32, VirtualMemInfo> m_mapped_memory; // mapped ranges (key is the mapped address), 4 KB aligned
+	std::vector<u32> m_pages; // real address of every mapped 4 KB page (with the lowest bit set) or 0 if not mapped
 	u32 m_reserve_size;
+	u32 m_used_size;
 
 public:
 	VirtualMemoryBlock();
@@ -140,6 +147,8 @@ public:
 	virtual bool IsInMyRange(const u32 addr, const u32 size = 1);
 	virtual void Delete();
 
+	virtual const u32 GetUsedSize() const { return m_used_size; }
+
 	// maps real address to virtual address space, returns the mapped address or 0 on failure (if no address is specified the
 	// first mappable space is used)
 	virtual bool Map(u32 realaddr, u32 size, u32 addr);
@@ -166,7 +175,18 @@ public:
 
 	// try to get the real address given a mapped address
 	// return true for success
-	bool getRealAddr(u32 addr, u32& result);
+	bool getRealAddr(u32 addr, u32& result)
+	{
+		const u32 page = (addr - range_start) / 4096;
+
+		if (addr < range_start || page >= m_pages.size() || !m_pages[page])
+		{
+			return false;
+		}
+
+		result = (m_pages[page] & ~4095) | (addr & 4095);
+		return true;
+	}
 
 	u32 RealAddr(u32 addr)
 	{
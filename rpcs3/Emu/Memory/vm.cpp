@@ -8,6 +8,9 @@
 
 #include "Emu/SysCalls/lv2/sys_time.h"
 
+//#define VM_RESERVATION_BENCHMARK 1
+//#define VM_HUGE_PAGES_BENCHMARK 1
+
 #ifdef _WIN32
 #include <Windows.h>
 #else
@@ -16,6 +19,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <fstream>
 
 /* OS X uses MAP_ANON instead of MAP_ANONYMOUS */
 #ifndef MAP_ANONYMOUS
@@ -77,6 +81,115 @@ namespace vm
 
 	std::array<atomic_le_t<u8>, 0x100000000ull / 4096> g_page_info = {}; // information about every page
 
+	// allocation bitmap (bit per page), it can be read without locking
+	std::array<std::atomic<u64>, 0x100000000ull / 4096 / 64> g_pages_allocated;
+
+	// summary levels (bit per 64-page word of g_pages_allocated, 16 MiB per summary word)
+	std::array<std::atomic<u64>, 0x100000000ull / 4096 / 64 / 64> g_pages_full; // all pages in the word are allocated
+	std::array<std::atomic<u64>, 0x100000000ull / 4096 / 64 / 64> g_pages_used; // some pages in the word are allocated
+
+	__forceinline u64 _page_mask(u32 first, u32 count)
+	{
+		return (count >= 64 ? ~0ull : (1ull << count) - 1) << (first % 64);
+	}
+
+	// check if all pages in the range are allocated (lock-free)
+	bool _page_range_allocated(u32 first, u32 count)
+	{
+		while (count)
+		{
+			// skip fully allocated 16 MiB blocks
+			if (first % 4096 == 0 && count >= 4096 && g_pages_full[first / 4096].load(std::memory_order_acquire) == ~0ull)
+			{
+				first += 4096;
+				count -= 4096;
+				continue;
+			}
+
+			const u32 n = std::min<u32>(64 - first % 64, count);
+			const u64 mask = _page_mask(first, n);
+
+			if ((g_pages_allocated[first / 64].load(std::memory_order_acquire) & mask) != mask)
+			{
+				return false;
+			}
+
+			first += n;
+			count -= n;
+		}
+
+		return true;
+	}
+
+	// check if no pages in the range are allocated (lock-free)
+	bool _page_range_free(u32 first, u32 count)
+	{
+		while (count)
+		{
+			// skip empty 16 MiB blocks
+			if (first % 4096 == 0 && count >= 4096 && g_pages_used[first / 4096].load(std::memory_order_acquire) == 0)
+			{
+				first += 4096;
+				count -= 4096;
+				continue;
+			}
+
+			const u32 n = std::min<u32>(64 - first % 64, count);
+
+			if (g_pages_allocated[first / 64].load(std::memory_order_acquire) & _page_mask(first, n))
+			{
+				return false;
+			}
+
+			first += n;
+			count -= n;
+		}
+
+		return true;
+	}
+
+	// mark the range as allocated (g_page_mutex must be locked)
+	void _page_range_set(u32 first, u32 count)
+	{
+		while (count)
+		{
+			const u32 n = std::min<u32>(64 - first % 64, count);
+			const u64 bit = 1ull << (first / 64 % 64);
+
+			// "used" summary is set before the pages and "full" summary after them
+			g_pages_used[first / 4096] |= bit;
+
+			if ((g_pages_allocated[first / 64] |= _page_mask(first, n)) == ~0ull)
+			{
+				g_pages_full[first / 4096] |= bit;
+			}
+
+			first += n;
+			count -= n;
+		}
+	}
+
+	// mark the range as free (g_page_mutex must be locked)
+	void _page_range_clear(u32 first, u32 count)
+	{
+		while (count)
+		{
+			const u32 n = std::min<u32>(64 - first % 64, count);
+			const u64 bit = 1ull << (first / 64 % 64);
+
+			// "full" summary is cleared before the pages and "used" summary after them
+			g_pages_full[first / 4096] &= ~bit;
+
+			if ((g_pages_allocated[first / 64] &= ~_page_mask(first, n)) == 0)
+			{
+				g_pages_used[first / 4096] &= ~bit;
+			}
+
+			first += n;
+			count -= n;
+		}
+	}
+
 	class reservation_mutex_t
 	{
 		std::atomic<NamedThreadBase*> m_owner;
@@ -130,13 +243,90 @@ namespace vm
 
 	};
 
-	std::function<void()> g_reservation_cb = nullptr;
-	NamedThreadBase* g_reservation_owner = nullptr;
+	// reservation granularity (the size of PPU/SPU cache line)
+	const u32 reservation_line = 128;
+
+	// the number of independently locked parts of the reservation table
+	const u32 reservation_shard_count = 256;
+
+	struct reservation_waiter_t
+	{
+		NamedThreadBase* owner;
+		reservation_callback_t callback; // called if the reservation is lost
+		void* arg;
+	};
+
+	struct reservation_line_t
+	{
+		u32 addr;
+		u64 stamp; // unique version of the line, changed when the line is updated or broken (0 if the slot is free)
+		std::vector<reservation_waiter_t> waiters; // threads holding the reservation
+	};
+
+	struct reservation_shard_t
+	{
+		reservation_mutex_t mutex;
+
+		u64 last_stamp = 0;
+
+		// reserved lines; free slots are reused (with their waiter lists), so acquiring a reservation doesn't allocate memory
+		std::vector<reservation_line_t> lines;
+	};
+
+	// every page is assigned to one shard, so the page protection is always changed under the same lock
+	std::array<reservation_shard_t, reservation_shard_count> g_reservations;
 
-	u32 g_reservation_addr = 0;
-	u32 g_reservation_size = 0;
+	// current reservation of the thread (only one reservation per thread is allowed)
+	struct reservation_info_t
+	{
+		NamedThreadBase* owner;
+		u32 addr;
+		u32 size;
+		u64 stamp;
+		u8 data[reservation_line]; // data read by reservation_acquire() (used in reservation_version_stamp mode)
+	};
+
+	thread_local reservation_info_t g_tls_reservation = {};
+
+	reservation_mode_t g_reservation_mode = reservation_page_protection;
+
+	std::atomic<u64> g_reservation_acquired(0);
+	std::atomic<u64> g_reservation_updated(0);
+	std::atomic<u64> g_reservation_lost(0);
+	std::atomic<u64> g_reservation_broken(0);
+
+	__forceinline reservation_shard_t& _reservation_get_shard(u32 addr)
+	{
+		return g_reservations[(addr >> 12) % reservation_shard_count];
+	}
+
+	// find the reserved line (shard must be locked)
+	reservation_line_t* _reservation_find_line(reservation_shard_t& shard, u32 line_addr)
+	{
+		for (auto& line : shard.lines)
+		{
+			if (line.stamp && line.addr == line_addr)
+			{
+				return &line;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// check if the page contains reserved lines (shard must be locked)
+	bool _reservation_page_reserved(reservation_shard_t& shard, u32 addr)
+	{
+		for (auto& line : shard.lines)
+		{
+			if (line.stamp && (line.addr >> 12) == (addr >> 12))
+			{
+				return true;
+			}
+		}
 
-	reservation_mutex_t g_reservation_mutex;
+		return false;
+	}
 
 	void _reservation_set(u32 addr, bool no_access = false)
 	{
@@ -155,58 +345,212 @@ namespace vm
 		//LOG_NOTICE(MEMORY, "VirtualProtect: %f us", (get_time() - stamp0) / 80.f);
 	}
 
-	bool _reservation_break(u32 addr)
+	void _reservation_unset(u32 addr)
 	{
-		if (g_reservation_addr >> 12 == addr >> 12)
-		{
-			//const auto stamp0 = get_time();
+		//const auto stamp0 = get_time();
 
 #ifdef _WIN32
-			DWORD old;
-			if (!VirtualProtect(vm::get_ptr(addr & ~0xfff), 4096, PAGE_READWRITE, &old))
+		DWORD old;
+		if (!VirtualProtect(vm::get_ptr(addr & ~0xfff), 4096, PAGE_READWRITE, &old))
 #else
-			if (mprotect(vm::get_ptr(addr & ~0xfff), 4096, PROT_READ | PROT_WRITE))
+		if (mprotect(vm::get_ptr(addr & ~0xfff), 4096, PROT_READ | PROT_WRITE))
 #endif
+		{
+			throw fmt::format("vm::_reservation_unset() failed (addr=0x%x)", addr);
+		}
+
+		//LOG_NOTICE(MEMORY, "VirtualAlloc: %f us", (get_time() - stamp0) / 80.f);
+	}
+
+	// restore page protection after the temporary no-access state (shard must be locked)
+	void _reservation_restore(reservation_shard_t& shard, u32 addr)
+	{
+		if (_reservation_page_reserved(shard, addr))
+		{
+			_reservation_set(addr);
+		}
+		else
+		{
+			_reservation_unset(addr);
+		}
+	}
+
+	// remove the line from the table, call callbacks except the one of the current reservation owner (shard must be locked)
+	void _reservation_break_line(reservation_shard_t& shard, u32 line_addr, NamedThreadBase* owner = nullptr)
+	{
+		const auto line = _reservation_find_line(shard, line_addr);
+
+		if (!line)
+		{
+			return;
+		}
+
+		for (auto& waiter : line->waiters)
+		{
+			if (waiter.owner != owner)
 			{
-				throw fmt::format("vm::_reservation_break() failed (addr=0x%x)", addr);
+				g_reservation_broken++;
+
+				if (waiter.callback)
+				{
+					waiter.callback(waiter.arg);
+				}
 			}
+		}
 
-			//LOG_NOTICE(MEMORY, "VirtualAlloc: %f us", (get_time() - stamp0) / 80.f);
+		// free the slot
+		line->stamp = 0;
+		line->waiters.clear();
 
-			if (g_reservation_cb)
+		if (g_reservation_mode == reservation_page_protection && !_reservation_page_reserved(shard, line_addr))
+		{
+			_reservation_unset(line_addr);
+		}
+	}
+
+	// break all reservations in the page (shard must be locked)
+	bool _reservation_break(reservation_shard_t& shard, u32 addr)
+	{
+		bool broken = false;
+
+		for (auto& line : shard.lines)
+		{
+			if (line.stamp && (line.addr >> 12) == (addr >> 12))
 			{
-				g_reservation_cb();
-				g_reservation_cb = nullptr;
+				_reservation_break_line(shard, line.addr);
+				broken = true;
 			}
+		}
 
-			g_reservation_owner = nullptr;
-			g_reservation_addr = 0;
-			g_reservation_size = 0;
+		return broken;
+	}
 
-			return true;
+	// write reserved memory if it still contains the data read by reservation_acquire() (used in reservation_version_stamp mode)
+	bool _reservation_compare_and_write(u32 addr, const void* old_data, const void* data, u32 size)
+	{
+		switch (size)
+		{
+		case 1: return InterlockedCompareExchange(vm::get_ptr<volatile u8>(addr), *(u8*)data, *(u8*)old_data) == *(u8*)old_data;
+		case 2: return InterlockedCompareExchange(vm::get_ptr<volatile u16>(addr), *(u16*)data, *(u16*)old_data) == *(u16*)old_data;
+		case 4: return InterlockedCompareExchange(vm::get_ptr<volatile u32>(addr), *(u32*)data, *(u32*)old_data) == *(u32*)old_data;
+		case 8: return InterlockedCompareExchange(vm::get_ptr<volatile u64>(addr), *(u64*)data, *(u64*)old_data) == *(u64*)old_data;
 		}
 
-		return false;
+		// 128-byte line can't be updated atomically, unprotected stores may still interfere
+		if (memcmp(vm::get_ptr(addr), old_data, size))
+		{
+			return false;
+		}
+
+		memcpy(vm::get_ptr(addr), data, size);
+		return true;
+	}
+
+	// remove the reservation of the current thread from the table (its shard must be locked), return true if it was valid
+	bool _reservation_drop(reservation_shard_t& shard)
+	{
+		auto& res = g_tls_reservation;
+
+		const u32 line_addr = res.addr & ~(reservation_line - 1);
+
+		const auto line = _reservation_find_line(shard, line_addr);
+
+		const bool valid = res.stamp && line && line->stamp == res.stamp;
+
+		if (valid)
+		{
+			auto& waiters = line->waiters;
+
+			for (auto it = waiters.begin(); it != waiters.end(); it++)
+			{
+				if (it->owner == res.owner)
+				{
+					waiters.erase(it);
+					break;
+				}
+			}
+
+			if (waiters.empty())
+			{
+				_reservation_break_line(shard, line_addr);
+			}
+		}
+
+		res = {};
+
+		return valid;
+	}
+
+	// drop the reservation of the current thread, locking the appropriate shard
+	bool _reservation_drop()
+	{
+		// the owner may be null (unnamed thread), the stamp is always set
+		if (!g_tls_reservation.stamp)
+		{
+			return false;
+		}
+
+		auto& shard = _reservation_get_shard(g_tls_reservation.addr);
+
+		std::lock_guard<reservation_mutex_t> lock(shard.mutex);
+
+		return _reservation_drop(shard);
 	}
 
 	bool reservation_break(u32 addr)
 	{
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+		auto& shard = _reservation_get_shard(addr);
+
+		std::lock_guard<reservation_mutex_t> lock(shard.mutex);
 
-		return _reservation_break(addr);
+		return _reservation_break(shard, addr);
 	}
 
-	bool reservation_acquire(void* data, u32 addr, u32 size, const std::function<void()>& callback)
+	// break all reservations in the range of pages
+	void _reservation_break_range(u32 addr, u32 size)
 	{
-		//const auto stamp0 = get_time();
+		if (size / 4096 <= reservation_shard_count)
+		{
+			for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
+			{
+				reservation_break(i * 4096);
+			}
 
-		bool broken = false;
+			return;
+		}
+
+		// lock every shard only once for big ranges
+		for (auto& shard : g_reservations)
+		{
+			std::lock_guard<reservation_mutex_t> lock(shard.mutex);
+
+			for (auto& line : shard.lines)
+			{
+				if (line.stamp && line.addr - addr < size)
+				{
+					_reservation_break_line(shard, line.addr);
+				}
+			}
+		}
+	}
+
+	bool reservation_acquire(void* data, u32 addr, u32 size, reservation_callback_t callback, void* arg)
+	{
+		//const auto stamp0 = get_time();
 
 		assert(size == 1 || size == 2 || size == 4 || size == 8 || size == 128);
-		assert((addr + size - 1 & ~0xfff) == (addr & ~0xfff));
+		assert((addr + size - 1 & ~(reservation_line - 1)) == (addr & ~(reservation_line - 1)));
+
+		const auto owner = GetCurrentNamedThread();
+		const u32 line_addr = addr & ~(reservation_line - 1);
+
+		auto& shard = _reservation_get_shard(addr);
+
+		// drop previous reservation of the current thread if it's located in another shard
+		bool broken = &_reservation_get_shard(g_tls_reservation.addr) != &shard && _reservation_drop();
 
 		{
-			std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+			std::lock_guard<reservation_mutex_t> lock(shard.mutex);
 
 			u8 flags = g_page_info[addr >> 12].read_relaxed();
 			if (!(flags & page_writable) || !(flags & page_allocated) || (flags & page_no_reservations))
@@ -214,31 +558,59 @@ namespace vm
 				throw fmt::format("vm::reservation_acquire(addr=0x%x, size=0x%x) failed (invalid page flags: 0x%x)", addr, size, flags);
 			}
 
-			// silent unlocking to prevent priority boost for threads going to break reservation
-			//g_reservation_mutex.do_notify = false;
+			if (g_tls_reservation.stamp)
+			{
+				broken = _reservation_drop(shard);
+			}
+
+			auto line = _reservation_find_line(shard, line_addr);
 
-			// break previous reservation
-			if (g_reservation_owner)
+			if (!line)
 			{
-				broken = _reservation_break(g_reservation_addr);
+				// change memory protection to read-only if the page is not protected yet
+				if (g_reservation_mode == reservation_page_protection && !_reservation_page_reserved(shard, addr))
+				{
+					_reservation_set(addr);
+				}
+
+				// reuse free slot if possible
+				for (auto& slot : shard.lines)
+				{
+					if (!slot.stamp)
+					{
+						line = &slot;
+						break;
+					}
+				}
+
+				if (!line)
+				{
+					shard.lines.emplace_back();
+					line = &shard.lines.back();
+				}
+
+				line->addr = line_addr;
+				line->stamp = ++shard.last_stamp;
 			}
 
-			// change memory protection to read-only
-			_reservation_set(addr);
+			line->waiters.push_back({ owner, callback, arg });
 
 			// may not be necessary
 			_mm_mfence();
 
 			// set additional information
-			g_reservation_addr = addr;
-			g_reservation_size = size;
-			g_reservation_owner = GetCurrentNamedThread();
-			g_reservation_cb = callback;
+			g_tls_reservation.owner = owner;
+			g_tls_reservation.addr = addr;
+			g_tls_reservation.size = size;
+			g_tls_reservation.stamp = line->stamp;
 
 			// copy data
 			memcpy(data, vm::get_ptr(addr), size);
+			memcpy(g_tls_reservation.data, data, size);
 		}
 
+		g_reservation_acquired++;
+
 		return broken;
 	}
 
@@ -250,52 +622,105 @@ namespace vm
 	bool reservation_update(u32 addr, const void* data, u32 size)
 	{
 		assert(size == 1 || size == 2 || size == 4 || size == 8 || size == 128);
-		assert((addr + size - 1 & ~0xfff) == (addr & ~0xfff));
+		assert((addr + size - 1 & ~(reservation_line - 1)) == (addr & ~(reservation_line - 1)));
 
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+		auto& res = g_tls_reservation;
 
-		if (g_reservation_owner != GetCurrentNamedThread() || g_reservation_addr != addr || g_reservation_size != size)
+		if (res.owner != GetCurrentNamedThread() || res.addr != addr || res.size != size)
 		{
 			// atomic update failed
+			g_reservation_lost++;
+			_reservation_drop();
 			return false;
 		}
 
+		auto& shard = _reservation_get_shard(addr);
+
+		std::lock_guard<reservation_mutex_t> lock(shard.mutex);
+
+		const u32 line_addr = addr & ~(reservation_line - 1);
+
+		const auto line = _reservation_find_line(shard, line_addr);
+
+		if (!line || line->stamp != res.stamp)
+		{
+			// atomic update failed (reservation was lost)
+			g_reservation_lost++;
+			res = {};
+			return false;
+		}
+
+		if (g_reservation_mode == reservation_version_stamp)
+		{
+			if (!_reservation_compare_and_write(addr, res.data, data, size))
+			{
+				// atomic update failed (memory was modified by unprotected store)
+				_reservation_break_line(shard, line_addr);
+				g_reservation_lost++;
+				res = {};
+				return false;
+			}
+
+			_reservation_break_line(shard, line_addr, res.owner);
+			res = {};
+
+			// atomic update succeeded
+			g_reservation_updated++;
+			waiter_map_t::notify_line(addr);
+			return true;
+		}
+
 		// change memory protection to no access
 		_reservation_set(addr, true);
 
 		// update memory using privileged access
 		memcpy(vm::priv_ptr(addr), data, size);
 
-		// remove callback to not call it on successful update
-		g_reservation_cb = nullptr;
+		// break reservations of other threads (without calling the own callback), it restores memory protection for the last line in the page
+		_reservation_break_line(shard, line_addr, res.owner);
 
-		// free the reservation and restore memory protection
-		_reservation_break(addr);
+		if (_reservation_page_reserved(shard, addr))
+		{
+			_reservation_set(addr);
+		}
+
+		res = {};
 
 		// atomic update succeeded
+		g_reservation_updated++;
+		waiter_map_t::notify_line(addr);
 		return true;
 	}
 
-	bool reservation_query(u32 addr, u32 size, bool is_writing, std::function<bool()> callback)
+	bool reservation_query(u32 addr, u32 size, bool is_writing, bool(*callback)(void* arg), void* arg)
 	{
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+		auto& shard = _reservation_get_shard(addr);
+
+		std::lock_guard<reservation_mutex_t> lock(shard.mutex);
 
 		if (!check_addr(addr))
 		{
 			return false;
 		}
 
-		// check if current reservation and address may overlap
-		if (g_reservation_addr >> 12 == addr >> 12 && is_writing)
+		// check if some reservation may overlap
+		if (is_writing && g_reservation_mode == reservation_page_protection && _reservation_page_reserved(shard, addr))
 		{
-			if (size && addr + size - 1 >= g_reservation_addr && g_reservation_addr + g_reservation_size - 1 >= addr)
+			bool overlap = false;
+
+			for (u32 line_addr = addr & ~(reservation_line - 1); size && line_addr <= addr + size - 1; line_addr += reservation_line)
 			{
-				// break the reservation if overlap
-				_reservation_break(addr);
+				if (_reservation_find_line(shard, line_addr))
+				{
+					// break the reservation if overlap
+					_reservation_break_line(shard, line_addr);
+					overlap = true;
+				}
 			}
-			else
+
+			if (!overlap)
 			{
-				return callback(); //? true : _reservation_break(addr), true;
+				return callback(arg);
 			}
 		}
 		
@@ -304,60 +729,277 @@ namespace vm
 
 	void reservation_free()
 	{
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
-
-		if (g_reservation_owner == GetCurrentNamedThread())
+		if (g_tls_reservation.owner == GetCurrentNamedThread())
 		{
-			_reservation_break(g_reservation_addr);
+			_reservation_drop();
 		}
 	}
 
-	void reservation_op(u32 addr, u32 size, std::function<void()> proc)
+	void reservation_op(u32 addr, u32 size, void(*proc)(void* arg), void* arg)
 	{
 		assert(size == 1 || size == 2 || size == 4 || size == 8 || size == 128);
-		assert((addr + size - 1 & ~0xfff) == (addr & ~0xfff));
+		assert((addr + size - 1 & ~(reservation_line - 1)) == (addr & ~(reservation_line - 1)));
+
+		// break previous reservation of the current thread
+		_reservation_drop();
 
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+		auto& shard = _reservation_get_shard(addr);
 
-		// break previous reservation
-		if (g_reservation_owner != GetCurrentNamedThread() || g_reservation_addr != addr || g_reservation_size != size)
+		std::lock_guard<reservation_mutex_t> lock(shard.mutex);
+
+		// break reservations of other threads
+		_reservation_break_line(shard, addr & ~(reservation_line - 1));
+
+		if (g_reservation_mode == reservation_version_stamp)
 		{
-			if (g_reservation_owner)
-			{
-				_reservation_break(g_reservation_addr);
-			}
+			proc(arg);
+			waiter_map_t::notify_line(addr);
+			return;
 		}
 
 		// change memory protection to no access
 		_reservation_set(addr, true);
 
-		// set additional information
-		g_reservation_addr = addr;
-		g_reservation_size = size;
-		g_reservation_owner = GetCurrentNamedThread();
-		g_reservation_cb = nullptr;
-
 		// may not be necessary
 		_mm_mfence();
 
 		// do the operation
-		proc();
+		proc(arg);
 
-		// remove the reservation
-		_reservation_break(addr);
+		// restore memory protection
+		_reservation_restore(shard, addr);
+
+		// wake threads waiting on the modified line
+		waiter_map_t::notify_line(addr);
 	}
 
+	void reservation_set_mode(reservation_mode_t mode)
+	{
+		if (mode == g_reservation_mode)
+		{
+			return;
+		}
+
+		for (auto& shard : g_reservations)
+		{
+			std::lock_guard<reservation_mutex_t> lock(shard.mutex);
+
+			for (auto& line : shard.lines)
+			{
+				if (line.stamp)
+				{
+					throw fmt::format("vm::reservation_set_mode(%d) failed (reservations exist)", mode);
+				}
+			}
+		}
+
+		g_reservation_mode = mode;
+	}
+
+	void reservation_benchmark()
+	{
+#ifdef VM_RESERVATION_BENCHMARK
+		const u32 addr = 0xf0000000; // temporarily mapped page
+		const u32 count = 10000; // successful updates per thread
+		const u32 max_threads = std::max<u32>(std::thread::hardware_concurrency(), 2);
+
+		const auto old_mode = g_reservation_mode;
+
+		page_map(addr, 4096, page_readable | page_writable);
+
+		for (auto mode : { reservation_page_protection, reservation_version_stamp })
+		{
+			reservation_set_mode(mode);
+
+			for (u32 threads = 1; threads <= max_threads; threads++)
+			{
+				for (u32 variant = 0; variant < 4; variant++)
+				{
+					const bool shared = (variant & 1) == 0;
+					const bool line = (variant & 2) != 0;
+
+					std::vector<std::unique_ptr<thread_t>> workers;
+
+					std::atomic<u64> lost(0);
+
+					const auto start = std::chrono::high_resolution_clock::now();
+
+					for (u32 i = 0; i < threads; i++)
+					{
+						// increment the same counter or the counter in the separate line
+						const u32 counter = shared ? addr : addr + (i % (4096 / reservation_line)) * reservation_line;
+
+						workers.emplace_back(new thread_t(fmt::format("Reservation Benchmark[%d]", i), true, [counter, count, line, &lost]()
+						{
+							for (u32 done = 0; done < count;)
+							{
+								if (line)
+								{
+									// the same sequence as SPU GETLLAR + PUTLLC (whole line with lost reservation notification)
+									u32 data[reservation_line / sizeof(u32)];
+									reservation_acquire(data, counter, reservation_line, [](void* arg) { (*static_cast<std::atomic<u64>*>(arg))++; }, &lost);
+									data[0]++;
+
+									if (reservation_update(counter, data, reservation_line))
+									{
+										done++;
+									}
+
+									continue;
+								}
+
+								u32 value;
+								reservation_acquire(&value, counter, sizeof(value));
+								value++;
+
+								if (reservation_update(counter, &value, sizeof(value)))
+								{
+									done++;
+								}
+							}
+						}));
+					}
+
+					// join all threads
+					workers.clear();
+
+					const auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+					LOG_NOTICE(MEMORY, "Reservation benchmark (%s, %d thread(s), %s lines, %s): %.0f ops/s, %lld notifications", mode == reservation_page_protection ? "page protection" : "version stamp",
+						threads, shared ? "shared" : "separate", line ? "GETLLAR/PUTLLC" : "LWARX/STWCX", (double)count * threads * 1000000 / std::max<s64>(time, 1), lost.load());
+				}
+			}
+		}
+
+		reservation_set_mode(old_mode);
+
+		page_unmap(addr, 4096);
+#endif
+	}
+
+	// guest memory ranges which are backed by huge pages if enabled
+	const struct { u32 addr, size; } g_huge_page_ranges[] =
+	{
+		{ 0x00000000, 0x30000000 }, // main memory and user memory
+		{ 0xc0000000, 0x10000000 }, // RSX local memory
+	};
+
+	bool set_huge_pages(bool enable)
+	{
+#ifdef MADV_HUGEPAGE
+		for (auto& range : g_huge_page_ranges)
+		{
+			// only affects the pages which are not touched yet, so it should be called before mapping memory
+			if (madvise(vm::get_ptr(range.addr), range.size, enable ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) || madvise(vm::priv_ptr(range.addr), range.size, enable ? MADV_HUGEPAGE : MADV_NOHUGEPAGE))
+			{
+				if (enable)
+				{
+					LOG_WARNING(MEMORY, "Huge pages are not supported by the host (madvise() failed, error %d), using 4 KiB pages", errno);
+				}
+
+				return false;
+			}
+		}
+
+		if (!enable)
+		{
+			return true;
+		}
+
+		// guest memory is a shared mapping, so shmem THP setting is used
+		std::ifstream sysfs("/sys/kernel/mm/transparent_hugepage/shmem_enabled");
+		std::string shmem_enabled;
+
+		if (!std::getline(sysfs, shmem_enabled) || shmem_enabled.find("[never]") != std::string::npos || shmem_enabled.find("[deny]") != std::string::npos)
+		{
+			LOG_WARNING(MEMORY, "Huge pages are disabled for shared memory by the host (shmem_enabled: '%s'), using 4 KiB pages", shmem_enabled);
+			return false;
+		}
+
+		LOG_NOTICE(MEMORY, "Huge pages enabled (shmem_enabled: '%s')", shmem_enabled);
+		return true;
+#else
+		if (enable)
+		{
+			LOG_WARNING(MEMORY, "Huge pages are not supported on this platform, using 4 KiB pages");
+		}
+
+		return !enable;
+#endif
+	}
+
+	void huge_pages_benchmark()
+	{
+#if defined(VM_HUGE_PAGES_BENCHMARK) && defined(MADV_HUGEPAGE)
+		const size_t size = 256 * 1024 * 1024;
+		const u32 count = 50 * 1000 * 1000; // random accesses
+
+		for (bool huge : { false, true })
+		{
+			// shared anonymous mapping is backed by shmem like the guest memory
+			void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+			if (ptr == MAP_FAILED)
+			{
+				LOG_ERROR(MEMORY, "Huge pages benchmark: mmap() failed");
+				return;
+			}
+
+			const bool advised = !madvise(ptr, size, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+
+			memset(ptr, 1, size);
+
+			auto data = static_cast<u8*>(ptr);
+			u32 x = 12345;
+			u32 sum = 0;
+
+			const auto start = std::chrono::steady_clock::now();
+
+			for (u32 i = 0; i < count; i++)
+			{
+				// LCG, dependent loads
+				x = x * 1664525 + 1013904223 + sum;
+				sum += data[x % size];
+			}
+
+			const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+			LOG_NOTICE(MEMORY, "Huge pages benchmark (%s pages%s): %.2f ns per random access (sum=0x%x)", huge ? "huge" : "4 KiB", advised ? "" : ", madvise() failed", (double)time / count, sum);
+
+			munmap(ptr, size);
+		}
+#endif
+	}
+
+	reservation_stats_t reservation_get_stats()
+	{
+		reservation_stats_t stats;
+
+		stats.acquired = g_reservation_acquired.load();
+		stats.updated = g_reservation_updated.load();
+		stats.lost = g_reservation_lost.load();
+		stats.broken = g_reservation_broken.load();
+
+		return stats;
+	}
+
+	// protects page information from concurrent modification (readers use the allocation bitmap without locking)
+	std::mutex g_page_mutex;
+
 	void page_map(u32 addr, u32 size, u8 flags)
 	{
 		assert(size && (size | addr) % 4096 == 0 && flags < page_allocated);
 
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+		std::lock_guard<std::mutex> lock(g_page_mutex);
 
-		for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
+		if (!_page_range_free(addr / 4096, size / 4096))
 		{
-			if (g_page_info[i].read_relaxed())
+			for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
 			{
-				throw fmt::format("vm::page_map(addr=0x%x, size=0x%x, flags=0x%x) failed (already mapped at 0x%x)", addr, size, flags, i * 4096);
+				if (g_page_info[i].read_relaxed())
+				{
+					throw fmt::format("vm::page_map(addr=0x%x, size=0x%x, flags=0x%x) failed (already mapped at 0x%x)", addr, size, flags, i * 4096);
+				}
 			}
 		}
 
@@ -375,15 +1017,15 @@ namespace vm
 			throw fmt::format("vm::page_map(addr=0x%x, size=0x%x, flags=0x%x) failed (API)", addr, size, flags);
 		}
 
+		memset(priv_addr, 0, size); // ???
+
 		for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
 		{
-			if (g_page_info[i].exchange(flags | page_allocated))
-			{
-				throw fmt::format("vm::page_map(addr=0x%x, size=0x%x, flags=0x%x) failed (concurrent access at 0x%x)", addr, size, flags, i * 4096);
-			}
+			g_page_info[i].write_relaxed(flags | page_allocated);
 		}
 
-		memset(priv_addr, 0, size); // ???
+		// publish the pages
+		_page_range_set(addr / 4096, size / 4096);
 	}
 
 	bool page_protect(u32 addr, u32 size, u8 flags_test, u8 flags_set, u8 flags_clear)
@@ -394,13 +1036,21 @@ namespace vm
 
 		flags_test |= page_allocated;
 
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+		std::lock_guard<std::mutex> lock(g_page_mutex);
 
-		for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
+		if (!_page_range_allocated(addr / 4096, size / 4096))
+		{
+			return false;
+		}
+
+		if (flags_test != page_allocated)
 		{
-			if ((g_page_info[i].read_relaxed() & flags_test) != (flags_test | page_allocated))
+			for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
 			{
-				return false;
+				if ((g_page_info[i].read_relaxed() & flags_test) != (flags_test | page_allocated))
+				{
+					return false;
+				}
 			}
 		}
 
@@ -411,7 +1061,12 @@ namespace vm
 
 		for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
 		{
-			_reservation_break(i * 4096);
+			// keep the shard locked until the flags are updated, so reservation_acquire() can't reserve the page in between
+			auto& shard = _reservation_get_shard(i * 4096);
+
+			std::lock_guard<reservation_mutex_t> lock(shard.mutex);
+
+			_reservation_break(shard, i * 4096);
 
 			const u8 f1 = g_page_info[i]._or(flags_set & ~flags_inv) & (page_writable | page_readable);
 			g_page_info[i]._and_not(flags_clear & ~flags_inv);
@@ -425,10 +1080,10 @@ namespace vm
 				DWORD old;
 
 				auto protection = f2 & page_writable ? PAGE_READWRITE : (f2 & page_readable ? PAGE_READONLY : PAGE_NOACCESS);
-				if (!VirtualProtect(real_addr, size, protection, &old))
+				if (!VirtualProtect(real_addr, 4096, protection, &old))
 #else
 				auto protection = f2 & page_writable ? PROT_WRITE | PROT_READ : (f2 & page_readable ? PROT_READ : PROT_NONE);
-				if (mprotect(real_addr, size, protection))
+				if (mprotect(real_addr, 4096, protection))
 #endif
 				{
 					throw fmt::format("vm::page_protect(addr=0x%x, size=0x%x, flags_test=0x%x, flags_set=0x%x, flags_clear=0x%x) failed (API)", addr, size, flags_test, flags_set, flags_clear);
@@ -443,26 +1098,30 @@ namespace vm
 	{
 		assert(size && (size | addr) % 4096 == 0);
 
-		std::lock_guard<reservation_mutex_t> lock(g_reservation_mutex);
+		std::lock_guard<std::mutex> lock(g_page_mutex);
 
-		for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
+		if (!_page_range_allocated(addr / 4096, size / 4096))
 		{
-			if (!(g_page_info[i].read_relaxed() & page_allocated))
+			for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
 			{
-				throw fmt::format("vm::page_unmap(addr=0x%x, size=0x%x) failed (not mapped at 0x%x)", addr, size, i * 4096);
+				if (!(g_page_info[i].read_relaxed() & page_allocated))
+				{
+					throw fmt::format("vm::page_unmap(addr=0x%x, size=0x%x) failed (not mapped at 0x%x)", addr, size, i * 4096);
+				}
 			}
 		}
 
+		// unpublish the pages before they become inaccessible
+		_page_range_clear(addr / 4096, size / 4096);
+
+		// clear the flags first, reservation_acquire() checks them under the shard lock and can't reserve the pages after they are broken
 		for (u32 i = addr / 4096; i < addr / 4096 + size / 4096; i++)
 		{
-			_reservation_break(i * 4096);
-
-			if (!(g_page_info[i].exchange(0) & page_allocated))
-			{
-				throw fmt::format("vm::page_unmap(addr=0x%x, size=0x%x) failed (concurrent access at 0x%x)", addr, size, i * 4096);
-			}
+			g_page_info[i].write_relaxed(0);
 		}
 
+		_reservation_break_range(addr, size);
+
 		void* real_addr = vm::get_ptr(addr);
 		void* priv_addr = vm::priv_ptr(addr);
 
@@ -489,15 +1148,7 @@ namespace vm
 			return false;
 		}
 
-		for (u32 i = addr / 4096; i <= (addr + size - 1) / 4096; i++)
-		{
-			if ((g_page_info[i].read_sync() & page_allocated) != page_allocated)
-			{
-				return false;
-			}
-		}
-		
-		return true;
+		return _page_range_allocated(addr / 4096, (addr + size - 1) / 4096 - addr / 4096 + 1);
 	}
 
 	//TODO
@@ -623,6 +1274,10 @@ namespace vm
 
 	void close()
 	{
+		const auto stats = reservation_get_stats();
+
+		LOG_NOTICE(MEMORY, "Reservations: acquired=%lld, updated=%lld, lost=%lld, broken=%lld", stats.acquired, stats.updated, stats.lost, stats.broken);
+
 		Memory.Close();
 	}
 
@@ -32,21 +32,66 @@ namespace vm
 	static void set_stack_size(u32 size) {}
 	static void initialize_stack() {}
 
-	// break the reservation, return true if it was successfully broken
+	enum reservation_mode_t : u8
+	{
+		reservation_page_protection, // detect conflicting stores by changing page protection (exact, but slow)
+		reservation_version_stamp, // detect conflicting stores by comparing data (no page protection changes)
+	};
+
+	struct reservation_stats_t
+	{
+		u64 acquired; // number of reservations acquired
+		u64 updated; // number of successful atomic updates
+		u64 lost; // number of failed atomic updates
+		u64 broken; // number of reservations broken by other threads
+	};
+
+	// called (with some internal lock held) when the reservation of the thread is lost
+	using reservation_callback_t = void(*)(void* arg);
+
+	// break all reservations in the page, return true if something was broken
 	bool reservation_break(u32 addr);
-	// read memory and reserve it for further atomic update, return true if the previous reservation was broken
-	bool reservation_acquire(void* data, u32 addr, u32 size, const std::function<void()>& callback = nullptr);
+	// read memory and reserve its 128-byte line for further atomic update, return true if the previous reservation of this thread was broken
+	bool reservation_acquire(void* data, u32 addr, u32 size, reservation_callback_t callback = nullptr, void* arg = nullptr);
 	// same as reservation_acquire but does not have the callback argument
 	// used by the PPU LLVM JIT since creating a std::function object in LLVM IR is too complicated
 	bool reservation_acquire_no_cb(void* data, u32 addr, u32 size);
 	// attempt to atomically update reserved memory
 	bool reservation_update(u32 addr, const void* data, u32 size);
 	// for internal use
-	bool reservation_query(u32 addr, u32 size, bool is_writing, std::function<bool()> callback);
+	bool reservation_query(u32 addr, u32 size, bool is_writing, bool(*callback)(void* arg), void* arg);
 	// for internal use
 	void reservation_free();
 	// perform complete operation
-	void reservation_op(u32 addr, u32 size, std::function<void()> proc);
+	void reservation_op(u32 addr, u32 size, void(*proc)(void* arg), void* arg);
+
+	// call reservation_query with any functor (without creating std::function)
+	template<typename F> inline bool reservation_query(u32 addr, u32 size, bool is_writing, F&& callback)
+	{
+		using func_t = typename std::remove_reference<F>::type;
+
+		return reservation_query(addr, size, is_writing, [](void* arg) -> bool { return (*static_cast<func_t*>(arg))(); }, &callback);
+	}
+
+	// call reservation_op with any functor (without creating std::function)
+	template<typename F> inline void reservation_op(u32 addr, u32 size, F&& proc)
+	{
+		using func_t = typename std::remove_reference<F>::type;
+
+		reservation_op(addr, size, [](void* arg) { (*static_cast<func_t*>(arg))(); }, &proc);
+	}
+
+	// select the way of detecting conflicting stores (only allowed if there are no reservations)
+	void reservation_set_mode(reservation_mode_t mode);
+	// measure atomic update throughput for the different number of threads (enabled by VM_RESERVATION_BENCHMARK)
+	void reservation_benchmark();
+	// get reservation counters
+	reservation_stats_t reservation_get_stats();
+
+	// back main memory and RSX local memory with transparent huge pages (returns false if 4 KiB pages are used)
+	bool set_huge_pages(bool enable);
+	// measure random access latency with and without huge pages (enabled by VM_HUGE_PAGES_BENCHMARK)
+	void huge_pages_benchmark();
 
 	// for internal use
 	void page_map(u32 addr, u32 size, u8 flags);
@@ -3,6 +3,7 @@
 #include "Emu/RSX/RSXFragmentProgram.h"
 #include "Emu/RSX/RSXVertexProgram.h"
 #include "Utilities/Log.h"
+#include "Utilities/Thread.h"
 
 
 enum class SHADER_TYPE
@@ -193,8 +194,12 @@ namespace ProgramHashUtil
 * - a typedef PipelineProperties to a type that encapsulate various state info relevant to program compilation (alpha test, primitive type,...)
 * - a	typedef ExtraData type that will be passed to the buildProgram function.
 * It should also contains the following function member :
-* - static void RecompileFragmentProgram(RSXFragmentProgram *RSXFP, FragmentProgramData& fragmentProgramData, size_t ID);
-* - static void RecompileVertexProgram(RSXVertexProgram *RSXVP, VertexProgramData& vertexProgramData, size_t ID);
+* - static void DecompileFragmentProgram(RSXFragmentProgram *RSXFP, const void *ucode, FragmentProgramData& fragmentProgramData);
+* - static void DecompileVertexProgram(RSXVertexProgram *RSXVP, VertexProgramData& vertexProgramData);
+*   Both may be called from decompiler worker threads and must not use the graphics API.
+* - static void CompileFragmentProgram(const void *ucode, FragmentProgramData& fragmentProgramData, size_t ID);
+* - static void CompileVertexProgram(const std::vector<u32> &data, VertexProgramData& vertexProgramData, size_t ID);
+* - static void CreateFallbackFragmentProgram(FragmentProgramData& fragmentProgramData);
 * - static PipelineData *BuildProgram(VertexProgramData &vertexProgramData, FragmentProgramData &fragmentProgramData, const PipelineProperties &pipelineProperties, const ExtraData& extraData);
 * - void DeleteProgram(PipelineData *ptr);
 */
@@ -237,12 +242,128 @@ private:
 
 	std::unordered_map<PSOKey, typename BackendTraits::PipelineData*, PSOKeyHash, PSOKeyCompare> m_cachePSO;
 
-	typename BackendTraits::FragmentProgramData& SearchFp(RSXFragmentProgram* rsx_fp, bool& found)
+	// Asynchronous decompilation: new programs are decompiled by a fixed number of worker threads and
+	// compiled on the render thread once done. Draws using them are skipped or use the fallback fragment program.
+	struct DecompileJob
+	{
+		RSXVertexProgram vp;
+		RSXFragmentProgram fp;
+		std::vector<u32> fpUcode; // copy of the microcode, guest memory may be modified during decompilation
+		void *fpShadowCopy;
+		typename BackendTraits::VertexProgramData *vpData; // set for vertex programs
+		typename BackendTraits::FragmentProgramData *fpData; // set for fragment programs
+		std::chrono::high_resolution_clock::time_point queueTime;
+	};
+
+	static const u32 maxQueuedPrograms = 64; // new programs are decompiled synchronously if the queue is full
+
+	std::vector<std::unique_ptr<thread_t>> m_workers;
+	std::mutex m_jobsLock;
+	std::condition_variable m_jobsCv;
+	std::deque<DecompileJob> m_jobs;
+	std::vector<DecompileJob> m_finishedJobs;
+	bool m_exitWorkers;
+	bool m_useFallback;
+	std::unordered_set<const void*> m_pendingPrograms; // program data of queued jobs, used by the render thread only
+	typename BackendTraits::FragmentProgramData m_fallbackFS;
+
+public:
+	struct DecompilerStats
+	{
+		u32 queueDepth; // programs queued or being decompiled
+		u64 decompiled; // programs decompiled by the workers
+		u64 totalLatency; // time from queueing to compilation in microseconds
+		u64 maxLatency;
+		u64 pendingDraws; // draws which used programs still being decompiled
+	};
+
+private:
+	DecompilerStats m_stats;
+
+	bool QueueJob(DecompileJob& job)
+	{
+		if (m_workers.empty() || m_stats.queueDepth >= maxQueuedPrograms)
+		{
+			return false;
+		}
+
+		m_pendingPrograms.insert(job.vpData ? (const void*)job.vpData : (const void*)job.fpData);
+		m_stats.queueDepth++;
+		job.queueTime = std::chrono::high_resolution_clock::now();
+
+		{
+			std::lock_guard<std::mutex> lock(m_jobsLock);
+			m_jobs.push_back(std::move(job));
+		}
+
+		m_jobsCv.notify_one();
+		return true;
+	}
+
+	void WorkerTask()
+	{
+		while (true)
+		{
+			std::unique_lock<std::mutex> lock(m_jobsLock);
+			m_jobsCv.wait(lock, [this]() { return m_exitWorkers || !m_jobs.empty(); });
+
+			if (m_exitWorkers)
+			{
+				break;
+			}
+
+			DecompileJob job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			lock.unlock();
+
+			if (job.vpData)
+				BackendTraits::DecompileVertexProgram(&job.vp, *job.vpData);
+			else
+				BackendTraits::DecompileFragmentProgram(&job.fp, job.fpUcode.data(), *job.fpData);
+
+			lock.lock();
+			m_finishedJobs.push_back(std::move(job));
+		}
+	}
+
+	// compile programs decompiled by the workers
+	void CompileFinishedJobs()
+	{
+		std::vector<DecompileJob> finished;
+
+		{
+			std::lock_guard<std::mutex> lock(m_jobsLock);
+			finished.swap(m_finishedJobs);
+		}
+
+		for (auto &job : finished)
+		{
+			if (job.vpData)
+			{
+				BackendTraits::CompileVertexProgram(job.vp.data, *job.vpData, m_currentShaderId++);
+				m_pendingPrograms.erase(job.vpData);
+			}
+			else
+			{
+				BackendTraits::CompileFragmentProgram(job.fpShadowCopy, *job.fpData, m_currentShaderId++);
+				m_pendingPrograms.erase(job.fpData);
+			}
+
+			const u64 latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - job.queueTime).count();
+			m_stats.queueDepth--;
+			m_stats.decompiled++;
+			m_stats.totalLatency += latency;
+			m_stats.maxLatency = std::max(m_stats.maxLatency, latency);
+		}
+	}
+
+	typename BackendTraits::FragmentProgramData& SearchFp(RSXFragmentProgram* rsx_fp, bool& found, bool& pending)
 	{
 		typename binary2FS::iterator It = m_cacheFS.find(vm::get_ptr<void>(rsx_fp->addr));
 		if (It != m_cacheFS.end())
 		{
 			found = true;
+			pending = m_pendingPrograms.count(&It->second) != 0;
 			return  It->second;
 		}
 		found = false;
@@ -251,23 +372,55 @@ private:
 		void *fpShadowCopy = malloc(actualFPSize);
 		memcpy(fpShadowCopy, vm::get_ptr<u8>(rsx_fp->addr), actualFPSize);
 		typename BackendTraits::FragmentProgramData &newShader = m_cacheFS[fpShadowCopy];
-		BackendTraits::RecompileFragmentProgram(rsx_fp, newShader, m_currentShaderId++);
+
+		DecompileJob job;
+		job.fp = *rsx_fp;
+		// The copy ends with an instruction flagged as the last one, in case the decompiler doesn't skip
+		// an inlined constant the same way as getFPBinarySize (it would read past the program otherwise).
+		job.fpUcode.resize(actualFPSize / sizeof(u32) + 4);
+		memcpy(job.fpUcode.data(), fpShadowCopy, actualFPSize);
+		job.fpUcode[actualFPSize / sizeof(u32)] = 0x100;
+		job.fpShadowCopy = fpShadowCopy;
+		job.vpData = nullptr;
+		job.fpData = &newShader;
+
+		pending = QueueJob(job);
+
+		if (!pending)
+		{
+			BackendTraits::DecompileFragmentProgram(rsx_fp, vm::get_ptr<void>(rsx_fp->addr), newShader);
+			BackendTraits::CompileFragmentProgram(fpShadowCopy, newShader, m_currentShaderId++);
+		}
 
 		return newShader;
 	}
 
-	typename BackendTraits::VertexProgramData& SearchVp(RSXVertexProgram* rsx_vp, bool &found)
+	typename BackendTraits::VertexProgramData& SearchVp(RSXVertexProgram* rsx_vp, bool &found, bool& pending)
 	{
 		typename binary2VS::iterator It = m_cacheVS.find(rsx_vp->data);
 		if (It != m_cacheVS.end())
 		{
 			found = true;
+			pending = m_pendingPrograms.count(&It->second) != 0;
 			return It->second;
 		}
 		found = false;
 		LOG_WARNING(RSX, "VP not found in buffer!");
 		typename BackendTraits::VertexProgramData& newShader = m_cacheVS[rsx_vp->data];
-		BackendTraits::RecompileVertexProgram(rsx_vp, newShader, m_currentShaderId++);
+
+		DecompileJob job;
+		job.vp = *rsx_vp;
+		job.fpShadowCopy = nullptr;
+		job.vpData = &newShader;
+		job.fpData = nullptr;
+
+		pending = QueueJob(job);
+
+		if (!pending)
+		{
+			BackendTraits::DecompileVertexProgram(rsx_vp, newShader);
+			BackendTraits::CompileVertexProgram(rsx_vp->data, newShader, m_currentShaderId++);
+		}
 
 		return newShader;
 	}
@@ -286,9 +439,18 @@ private:
 	}
 
 public:
-	ProgramStateCache() : m_currentShaderId(0) {}
+	ProgramStateCache()
+		: m_currentShaderId(0)
+		, m_exitWorkers(false)
+		, m_useFallback(false)
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
 	~ProgramStateCache()
 	{
+		StopDecompilerWorkers();
+
 		for (auto pair : m_cachePSO)
 			BackendTraits::DeleteProgram(pair.second);
 		for (auto pair : m_cacheFS)
@@ -303,9 +465,33 @@ public:
 		)
 	{
 		typename BackendTraits::PipelineData *result = nullptr;
-		bool fpFound, vpFound;
-		typename BackendTraits::VertexProgramData &vertexProg = SearchVp(vertexShader, vpFound);
-		typename BackendTraits::FragmentProgramData &fragmentProg = SearchFp(fragmentShader, fpFound);
+		bool fpFound, vpFound, fpPending, vpPending;
+
+		CompileFinishedJobs();
+
+		typename BackendTraits::VertexProgramData &vertexProg = SearchVp(vertexShader, vpFound, vpPending);
+		typename BackendTraits::FragmentProgramData *fragmentProgPtr = &SearchFp(fragmentShader, fpFound, fpPending);
+
+		if (vpPending || fpPending)
+		{
+			m_stats.pendingDraws++;
+
+			// the vertex program is always needed, only the fragment program can be replaced
+			if (vpPending || !m_useFallback)
+			{
+				return nullptr;
+			}
+
+			if (!m_fallbackFS.id)
+			{
+				BackendTraits::CreateFallbackFragmentProgram(m_fallbackFS);
+			}
+
+			fragmentProgPtr = &m_fallbackFS;
+			fpFound = true;
+		}
+
+		typename BackendTraits::FragmentProgramData &fragmentProg = *fragmentProgPtr;
 
 		if (fpFound && vpFound)
 		{
@@ -326,11 +512,129 @@ public:
 		return result;
 	}
 
+	/**
+	* Insert programs restored by the backend (from a disk cache for instance) before they are used by a draw.
+	* found is set if the program is already known, otherwise the returned data has to be filled by the caller.
+	*/
+	typename BackendTraits::VertexProgramData& AddVertexProgram(const std::vector<u32>& data, bool& found)
+	{
+		typename binary2VS::iterator It = m_cacheVS.find(data);
+		if (It != m_cacheVS.end())
+		{
+			found = true;
+			return It->second;
+		}
+		found = false;
+		m_currentShaderId++;
+		return m_cacheVS[data];
+	}
+
+	typename BackendTraits::FragmentProgramData& AddFragmentProgram(const void* data, bool& found)
+	{
+		typename binary2FS::iterator It = m_cacheFS.find(const_cast<void*>(data));
+		if (It != m_cacheFS.end())
+		{
+			found = true;
+			return It->second;
+		}
+		found = false;
+		m_currentShaderId++;
+		size_t actualFPSize = ProgramHashUtil::FragmentProgramUtil::getFPBinarySize(const_cast<void*>(data));
+		void *fpShadowCopy = malloc(actualFPSize);
+		memcpy(fpShadowCopy, data, actualFPSize);
+		return m_cacheFS[fpShadowCopy];
+	}
+
+	void AddPipeline(
+		typename BackendTraits::VertexProgramData &vertexProg,
+		typename BackendTraits::FragmentProgramData &fragmentProg,
+		const typename BackendTraits::PipelineProperties &pipelineProperties,
+		const typename BackendTraits::ExtraData& extraData
+		)
+	{
+		if (GetProg({ vertexProg.id, fragmentProg.id, pipelineProperties }) == nullptr)
+		{
+			Add(BackendTraits::BuildProgram(vertexProg, fragmentProg, pipelineProperties, extraData), { vertexProg.id, fragmentProg.id, pipelineProperties });
+		}
+	}
+
+	/**
+	* Decompile new programs on worker threads. While a program is decompiled getGraphicPipelineState returns
+	* nullptr (the draw should be skipped), or uses the fallback fragment program if useFallback is set.
+	*/
+	void StartDecompilerWorkers(bool useFallback)
+	{
+		StopDecompilerWorkers();
+
+		const u32 num_workers = std::min(std::max(std::thread::hardware_concurrency() / 2, 1u), 4u);
+
+		m_exitWorkers = false;
+		m_useFallback = useFallback;
+
+		for (u32 i = 0; i < num_workers; i++)
+		{
+			m_workers.emplace_back(new thread_t(fmt::Format("Shader Decompiler Worker %u", i), true, [this]() { WorkerTask(); }));
+		}
+	}
+
+	void StopDecompilerWorkers()
+	{
+		if (m_workers.empty())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_jobsLock);
+			m_exitWorkers = true;
+		}
+
+		m_jobsCv.notify_all();
+
+		for (auto &worker : m_workers)
+		{
+			worker->join();
+		}
+
+		m_workers.clear();
+
+		CompileFinishedJobs();
+
+		// programs which were not decompiled are removed to be decompiled again on next use
+		for (auto &job : m_jobs)
+		{
+			if (job.vpData)
+			{
+				m_pendingPrograms.erase(job.vpData);
+				m_cacheVS.erase(job.vp.data);
+			}
+			else
+			{
+				m_pendingPrograms.erase(job.fpData);
+				m_cacheFS.erase(job.fpShadowCopy);
+				free(job.fpShadowCopy);
+			}
+		}
+
+		m_stats.queueDepth -= (u32)m_jobs.size();
+		m_jobs.clear();
+	}
+
+	const DecompilerStats& getDecompilerStats() const
+	{
+		return m_stats;
+	}
+
 	const std::vector<size_t> &getFragmentConstantOffsetsCache(const RSXFragmentProgram *fragmentShader) const
 	{
 		typename binary2FS::const_iterator It = m_cacheFS.find(vm::get_ptr<void>(fragmentShader->addr));
 		if (It != m_cacheFS.end())
+		{
+			// the program data belongs to a worker until it is decompiled (the fallback program has no constants)
+			if (m_pendingPrograms.count(&It->second))
+				return dummyFragmentConstantCache;
 			return It->second.FragmentConstantOffsetCache;
+		}
 		LOG_ERROR(RSX, "Can't retrieve constant offset cache");
 		return dummyFragmentConstantCache;
 	}
@@ -86,6 +86,203 @@ void GLvbo::Create(u32 count)
 	GLBufferObject::Create(GL_ARRAY_BUFFER, count);
 }
 
+GLStreamBuffer::GLStreamBuffer()
+	: m_id(0)
+	, m_size(0)
+	, m_pos(0)
+	, m_flush_pos(0)
+	, m_generation(0)
+	, m_ptr(nullptr)
+	, m_used(0)
+{
+	memset(m_fences, 0, sizeof(m_fences));
+}
+
+GLStreamBuffer::~GLStreamBuffer()
+{
+	Delete();
+}
+
+void GLStreamBuffer::Create(u32 size)
+{
+	if(IsCreated()) return;
+
+	glGenBuffers(1, &m_id);
+	glBindBuffer(GL_ARRAY_BUFFER, m_id);
+
+	m_size = size;
+	m_pos = 0;
+	m_flush_pos = 0;
+	m_generation++;
+
+#ifdef GL_MAP_PERSISTENT_BIT
+	if(glBufferStorage && glMapBufferRange)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+		m_ptr = (u8*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	}
+#endif
+
+	if(!m_ptr)
+	{
+		glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		m_staging.resize(size);
+	}
+}
+
+void GLStreamBuffer::Delete()
+{
+	if(!IsCreated()) return;
+
+	if(m_ptr)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_id);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		m_ptr = nullptr;
+	}
+
+	for(u32 i = 0; i < segment_count; i++)
+	{
+		ReleaseFence(i);
+	}
+
+	m_used = 0;
+
+	glDeleteBuffers(1, &m_id);
+	m_id = 0;
+	m_staging.clear();
+}
+
+void GLStreamBuffer::Bind(u32 type) const
+{
+	glBindBuffer(type, m_id);
+}
+
+bool GLStreamBuffer::IsCreated() const
+{
+	return m_id != 0;
+}
+
+void GLStreamBuffer::Reserve(u32 size)
+{
+	if(size > m_size)
+	{
+		// grow the buffer, all previous allocations become invalid
+		const u32 new_size = std::max(size, m_size * 2);
+		Delete();
+		Create(new_size);
+	}
+
+	if(m_pos + size > m_size)
+	{
+		Flush();
+
+		m_pos = 0;
+		m_flush_pos = 0;
+		m_generation++;
+	}
+}
+
+u8* GLStreamBuffer::Alloc(u32 size, u32 alignment, u32& offset)
+{
+	u32 pos = (m_pos + alignment - 1) & ~(alignment - 1);
+
+	if(pos + size > m_size)
+	{
+		// only happens if the draw didn't reserve enough space
+		Reserve(size + alignment);
+		pos = 0;
+	}
+
+	if(m_ptr && size)
+	{
+		const u32 segment_size = m_size / segment_count;
+
+		for(u32 i = pos / segment_size; i <= std::min((pos + size - 1) / segment_size, segment_count - 1); i++)
+		{
+			// the segment is entered for the first time since the wrap, wait until the draws of the previous pass are done
+			if(i * segment_size >= m_pos)
+			{
+				WaitSegment(i);
+			}
+
+			m_used |= 1 << i;
+		}
+	}
+
+	m_pos = pos + size;
+	offset = pos;
+
+	return (m_ptr ? m_ptr : m_staging.data()) + pos;
+}
+
+void GLStreamBuffer::MarkUsed(u32 offset, u32 size)
+{
+	if(!m_ptr || !size) return;
+
+	const u32 segment_size = m_size / segment_count;
+
+	for(u32 i = offset / segment_size; i <= std::min((offset + size - 1) / segment_size, segment_count - 1); i++)
+	{
+		m_used |= 1 << i;
+	}
+}
+
+void GLStreamBuffer::Fence()
+{
+	if(!m_ptr || !m_used) return;
+
+	const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	for(u32 i = 0; i < segment_count; i++)
+	{
+		if(!(m_used & (1 << i))) continue;
+
+		ReleaseFence(i);
+		m_fences[i] = fence;
+	}
+
+	m_used = 0;
+}
+
+void GLStreamBuffer::ReleaseFence(u32 segment)
+{
+	const GLsync fence = m_fences[segment];
+
+	if(!fence) return;
+
+	m_fences[segment] = nullptr;
+
+	for(auto other : m_fences)
+	{
+		if(other == fence) return;
+	}
+
+	glDeleteSync(fence);
+}
+
+void GLStreamBuffer::WaitSegment(u32 segment)
+{
+	if(GLsync fence = m_fences[segment])
+	{
+		while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+		ReleaseFence(segment);
+	}
+}
+
+void GLStreamBuffer::Flush()
+{
+	if(!m_ptr && m_pos > m_flush_pos)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_id);
+		glBufferSubData(GL_ARRAY_BUFFER, m_flush_pos, m_pos - m_flush_pos, m_staging.data() + m_flush_pos);
+	}
+
+	m_flush_pos = m_pos;
+}
+
 GLvao::GLvao() : m_id(0)
 {
 }
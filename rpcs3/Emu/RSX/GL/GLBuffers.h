@@ -32,6 +32,54 @@ struct GLvbo : public GLBufferObject
 	void Create(u32 count = 1);
 };
 
+// Ring buffer for data written once per draw. It is persistently mapped if GL_ARB_buffer_storage is supported,
+// otherwise written data is kept in system memory and uploaded by Flush().
+class GLStreamBuffer
+{
+protected:
+	// the mapped buffer is split into segments, each one is fenced after the draws reading it were issued
+	static const u32 segment_count = 4;
+
+	GLuint m_id;
+	u32 m_size;
+	u32 m_pos;
+	u32 m_flush_pos;
+	u32 m_generation;
+	u8* m_ptr;
+	std::vector<u8> m_staging;
+	GLsync m_fences[segment_count]; // a fence may be shared by several segments
+	u32 m_used; // segments read by draws which were not fenced yet
+
+	void ReleaseFence(u32 segment);
+	void WaitSegment(u32 segment);
+
+public:
+	GLStreamBuffer();
+	~GLStreamBuffer();
+
+	void Create(u32 size);
+	void Delete();
+	void Bind(u32 type) const;
+	bool IsCreated() const;
+
+	// make sure size bytes can be allocated without wrapping or growing, must be called before the first Alloc() of a draw
+	void Reserve(u32 size);
+	// reserve size bytes, returns the pointer for writing and the offset in the buffer
+	u8* Alloc(u32 size, u32 alignment, u32& offset);
+	// mark previously allocated data as read by the draw being prepared
+	void MarkUsed(u32 offset, u32 size);
+	// fence the segments read by the draws issued since the previous call
+	void Fence();
+	// make data written after the previous call visible to GL
+	void Flush();
+
+	// incremented when previously allocated data may be overwritten
+	u32 GetGeneration() const
+	{
+		return m_generation;
+	}
+};
+
 class GLvao
 {
 protected:
@@ -102,7 +102,7 @@ std::string GLFragmentDecompilerThread::AddConst()
 		return name;
 	}
 
-	auto data = vm::ptr<u32>::make(m_addr + m_size + 4 * sizeof(u32));
+	auto data = (const be_t<u32>*)m_ucode + (m_size + 4 * sizeof(u32)) / sizeof(u32);
 
 	m_offset = 2 * 4 * sizeof(u32);
 	u32 x = 0;//GetData(data[0]);
@@ -273,7 +273,7 @@ template<typename T> std::string GLFragmentDecompilerThread::GetSRC(T src)
 
 	case 1: //input
 	{
-		static const std::string reg_table[] =
+		static const char* const reg_table[] =
 		{
 			"gl_Position",
 			"diff_color", "spec_color",
@@ -360,7 +360,7 @@ std::string GLFragmentDecompilerThread::BuildCode()
 
 void GLFragmentDecompilerThread::Task()
 {
-	auto data = vm::ptr<u32>::make(m_addr);
+	auto data = (const be_t<u32>*)m_ucode;
 	m_size = 0;
 	m_location = 0;
 	m_loop_count = 0;
@@ -649,7 +649,12 @@ void GLFragmentProgram::Wait()
 
 void GLFragmentProgram::Decompile(RSXFragmentProgram& prog)
 {
-	GLFragmentDecompilerThread decompiler(shader, parr, prog.addr, prog.size, prog.ctrl);
+	Decompile(prog, vm::get_ptr<void>(prog.addr));
+}
+
+void GLFragmentProgram::Decompile(RSXFragmentProgram& prog, const void* ucode)
+{
+	GLFragmentDecompilerThread decompiler(shader, parr, ucode, prog.size, prog.ctrl);
 	decompiler.Task();
 }
 
@@ -667,7 +672,7 @@ void GLFragmentProgram::DecompileAsync(RSXFragmentProgram& prog)
 		m_decompiler_thread = nullptr;
 	}
 
-	m_decompiler_thread = new GLFragmentDecompilerThread(shader, parr, prog.addr, prog.size, prog.ctrl);
+	m_decompiler_thread = new GLFragmentDecompilerThread(shader, parr, vm::get_ptr<void>(prog.addr), prog.size, prog.ctrl);
 	m_decompiler_thread->Start();
 }
 
@@ -8,7 +8,7 @@ struct GLFragmentDecompilerThread : public ThreadBase
 	std::string main;
 	std::string& m_shader;
 	GLParamArray& m_parr;
-	u32 m_addr;
+	const void* m_ucode;
 	u32& m_size;
 	u32 m_const_index;
 	u32 m_offset;
@@ -19,11 +19,11 @@ struct GLFragmentDecompilerThread : public ThreadBase
 	std::vector<u32> m_end_offsets;
 	std::vector<u32> m_else_offsets;
 
-	GLFragmentDecompilerThread(std::string& shader, GLParamArray& parr, u32 addr, u32& size, u32 ctrl)
+	GLFragmentDecompilerThread(std::string& shader, GLParamArray& parr, const void* ucode, u32& size, u32 ctrl)
 		: ThreadBase("Fragment Shader Decompiler Thread")
 		, m_shader(shader)
 		, m_parr(parr)
-		, m_addr(addr)
+		, m_ucode(ucode)
 		, m_size(size) 
 		, m_const_index(0)
 		, m_location(0)
@@ -73,6 +73,14 @@ public:
 	 */
 	void Decompile(RSXFragmentProgram& prog);
 
+	/**
+	 * Decompile fragment shader microcode from host memory (a copy of the PS3's Memory for instance).
+	 * This function doesn't call OpenGL and may be used from any thread.
+	 * @param prog RSXShaderProgram specifying the shader control, its size is updated
+	 * @param ucode fragment program microcode, must stay valid during decompilation
+	 */
+	void Decompile(RSXFragmentProgram& prog, const void* ucode);
+
 	/**
 	* Asynchronously decompile a fragment shader located in the PS3's Memory.
 	* When this function is called you must call Wait() before GetShaderText() will return valid data.
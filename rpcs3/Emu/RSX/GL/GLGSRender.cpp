@@ -5,6 +5,8 @@
 #include "Utilities/Log.h"
 #include "Emu/Memory/Memory.h"
 #include "Emu/System.h"
+#include "Emu/RSX/RSXTextureDecode.h"
+#include "Emu/RSX/RSXVertexFetch.h"
 #include "GLGSRender.h"
 
 GetGSFrameCb GetGSFrame = nullptr;
@@ -115,7 +117,24 @@ void GLTexture::Init(RSXTexture& tex)
 	bool is_swizzled = !(tex.GetFormat() & CELL_GCM_TEXTURE_LN);
 
 	auto pixels = vm::get_ptr<const u8>(texaddr);
-	u8 *unswizzledPixels;
+
+	// conversion buffers (only used by the RSX thread)
+	static std::vector<u8> s_unswizzled;
+	static std::vector<u8> s_converted;
+
+	const bool is_pow2 = !(tex.GetWidth() & (tex.GetWidth() - 1)) && !(tex.GetHeight() & (tex.GetHeight() - 1));
+
+	if (is_swizzled && is_pow2 && !IsCompressedFormat(format) &&
+		format != (~(CELL_GCM_TEXTURE_LN | CELL_GCM_TEXTURE_UN) & CELL_GCM_TEXTURE_COMPRESSED_B8R8_G8R8) &&
+		format != (~(CELL_GCM_TEXTURE_LN | CELL_GCM_TEXTURE_UN) & CELL_GCM_TEXTURE_COMPRESSED_R8B8_R8G8))
+	{
+		const u32 texel_size = GetTexelSize(format);
+
+		s_unswizzled.resize(tex.GetWidth() * tex.GetHeight() * texel_size);
+		UnswizzleTexture(s_unswizzled.data(), pixels, tex.GetWidth(), tex.GetHeight(), texel_size);
+		pixels = s_unswizzled.data();
+	}
+
 	static const GLint glRemapStandard[4] = { GL_ALPHA, GL_RED, GL_GREEN, GL_BLUE };
 	// NOTE: This must be in ARGB order in all forms below.
 	const GLint *glRemap = glRemapStandard;
@@ -172,35 +191,14 @@ void GLTexture::Init(RSXTexture& tex)
 
 	case CELL_GCM_TEXTURE_A8R8G8B8:
 	{
-		if (is_swizzled)
-		{
-			u32 *src, *dst;
-			u32 log2width, log2height;
-
-			unswizzledPixels = (u8*)malloc(tex.GetWidth() * tex.GetHeight() * 4);
-			src = (u32*)pixels;
-			dst = (u32*)unswizzledPixels;
-
-			log2width = log(tex.GetWidth()) / log(2);
-			log2height = log(tex.GetHeight()) / log(2);
-
-			for (int i = 0; i < tex.GetHeight(); i++)
-			{
-				for (int j = 0; j < tex.GetWidth(); j++)
-				{
-					dst[(i*tex.GetHeight()) + j] = src[LinearToSwizzleAddress(j, i, 0, log2width, log2height, 0)];
-				}
-			}
-		}
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8, is_swizzled ? unswizzledPixels : pixels);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8, pixels);
 		checkForGlError("GLTexture::Init() -> glTexImage2D(CELL_GCM_TEXTURE_A8R8G8B8)");
 		break;
 	}
 
 	case CELL_GCM_TEXTURE_COMPRESSED_DXT1: // Compressed 4x4 pixels into 8 bytes
 	{
-		u32 size = ((tex.GetWidth() + 3) / 4) * ((tex.GetHeight() + 3) / 4) * 8;
+		const u32 size = GetTextureDataSize(format, tex.GetWidth(), tex.GetHeight(), tex.m_pitch, !is_swizzled);
 
 		glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, tex.GetWidth(), tex.GetHeight(), 0, size, pixels);
 		checkForGlError("GLTexture::Init() -> glCompressedTexImage2D(CELL_GCM_TEXTURE_COMPRESSED_DXT1)");
@@ -209,7 +207,7 @@ void GLTexture::Init(RSXTexture& tex)
 
 	case CELL_GCM_TEXTURE_COMPRESSED_DXT23: // Compressed 4x4 pixels into 16 bytes
 	{
-		u32 size = ((tex.GetWidth() + 3) / 4) * ((tex.GetHeight() + 3) / 4) * 16;
+		const u32 size = GetTextureDataSize(format, tex.GetWidth(), tex.GetHeight(), tex.m_pitch, !is_swizzled);
 
 		glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, tex.GetWidth(), tex.GetHeight(), 0, size, pixels);
 		checkForGlError("GLTexture::Init() -> glCompressedTexImage2D(CELL_GCM_TEXTURE_COMPRESSED_DXT23)");
@@ -218,7 +216,7 @@ void GLTexture::Init(RSXTexture& tex)
 
 	case CELL_GCM_TEXTURE_COMPRESSED_DXT45: // Compressed 4x4 pixels into 16 bytes
 	{
-		u32 size = ((tex.GetWidth() + 3) / 4) * ((tex.GetHeight() + 3) / 4) * 16;
+		const u32 size = GetTextureDataSize(format, tex.GetWidth(), tex.GetHeight(), tex.m_pitch, !is_swizzled);
 
 		glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, tex.GetWidth(), tex.GetHeight(), 0, size, pixels);
 		checkForGlError("GLTexture::Init() -> glCompressedTexImage2D(CELL_GCM_TEXTURE_COMPRESSED_DXT45)");
@@ -237,22 +235,11 @@ void GLTexture::Init(RSXTexture& tex)
 
 	case CELL_GCM_TEXTURE_R6G5B5:
 	{
-		// TODO: Probably need to actually unswizzle if is_swizzled.
-		const u32 numPixels = tex.GetWidth() * tex.GetHeight();
-		unswizzledPixels = (u8 *)malloc(numPixels * 4);
-		// TODO: Speed.
-		for (u32 i = 0; i < numPixels; ++i) {
-			u16 c = reinterpret_cast<const be_t<u16> *>(pixels)[i];
-			unswizzledPixels[i * 4 + 0] = Convert6To8((c >> 10) & 0x3F);
-			unswizzledPixels[i * 4 + 1] = Convert5To8((c >> 5) & 0x1F);
-			unswizzledPixels[i * 4 + 2] = Convert5To8((c >> 0) & 0x1F);
-			unswizzledPixels[i * 4 + 3] = 255;
-		}
+		s_converted.resize(tex.GetWidth() * tex.GetHeight() * 4);
+		ConvertR6G5B5(s_converted.data(), pixels, tex.GetWidth() * tex.GetHeight());
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, unswizzledPixels);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, s_converted.data());
 		checkForGlError("GLTexture::Init() -> glTexImage2D(CELL_GCM_TEXTURE_R6G5B5)");
-
-		free(unswizzledPixels);
 		break;
 	}
 
@@ -405,53 +392,21 @@ void GLTexture::Init(RSXTexture& tex)
 
 	case ~(CELL_GCM_TEXTURE_LN | CELL_GCM_TEXTURE_UN) & CELL_GCM_TEXTURE_COMPRESSED_B8R8_G8R8:
 	{
-		const u32 numPixels = tex.GetWidth() * tex.GetHeight();
-		unswizzledPixels = (u8 *)malloc(numPixels * 4);
-		// TODO: Speed.
-		for (u32 i = 0; i < numPixels; i += 2)
-		{
-			unswizzledPixels[i * 4 + 0 + 0] = pixels[i * 2 + 3];
-			unswizzledPixels[i * 4 + 0 + 1] = pixels[i * 2 + 2];
-			unswizzledPixels[i * 4 + 0 + 2] = pixels[i * 2 + 0];
-			unswizzledPixels[i * 4 + 0 + 3] = 255;
-
-			// The second pixel is the same, except for red.
-			unswizzledPixels[i * 4 + 4 + 0] = pixels[i * 2 + 1];
-			unswizzledPixels[i * 4 + 4 + 1] = pixels[i * 2 + 2];
-			unswizzledPixels[i * 4 + 4 + 2] = pixels[i * 2 + 0];
-			unswizzledPixels[i * 4 + 4 + 3] = 255;
-		}
+		s_converted.resize(tex.GetWidth() * tex.GetHeight() * 4);
+		ConvertB8R8_G8R8(s_converted.data(), pixels, tex.GetWidth() * tex.GetHeight() & ~1);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, unswizzledPixels);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, s_converted.data());
 		checkForGlError("GLTexture::Init() -> glTexImage2D(CELL_GCM_TEXTURE_COMPRESSED_B8R8_G8R8 & ~(CELL_GCM_TEXTURE_LN | CELL_GCM_TEXTURE_UN)");
-
-		free(unswizzledPixels);
 		break;
 	}
 
 	case ~(CELL_GCM_TEXTURE_LN | CELL_GCM_TEXTURE_UN) & CELL_GCM_TEXTURE_COMPRESSED_R8B8_R8G8:
 	{
-		const u32 numPixels = tex.GetWidth() * tex.GetHeight();
-		unswizzledPixels = (u8 *)malloc(numPixels * 4);
-		// TODO: Speed.
-		for (u32 i = 0; i < numPixels; i += 2)
-		{
-			unswizzledPixels[i * 4 + 0 + 0] = pixels[i * 2 + 2];
-			unswizzledPixels[i * 4 + 0 + 1] = pixels[i * 2 + 3];
-			unswizzledPixels[i * 4 + 0 + 2] = pixels[i * 2 + 1];
-			unswizzledPixels[i * 4 + 0 + 3] = 255;
-
-			// The second pixel is the same, except for red.
-			unswizzledPixels[i * 4 + 4 + 0] = pixels[i * 2 + 0];
-			unswizzledPixels[i * 4 + 4 + 1] = pixels[i * 2 + 3];
-			unswizzledPixels[i * 4 + 4 + 2] = pixels[i * 2 + 1];
-			unswizzledPixels[i * 4 + 4 + 3] = 255;
-		}
+		s_converted.resize(tex.GetWidth() * tex.GetHeight() * 4);
+		ConvertR8B8_R8G8(s_converted.data(), pixels, tex.GetWidth() * tex.GetHeight() & ~1);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, unswizzledPixels);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.GetWidth(), tex.GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, s_converted.data());
 		checkForGlError("GLTexture::Init() -> glTexImage2D(CELL_GCM_TEXTURE_COMPRESSED_R8B8_R8G8 & ~(CELL_GCM_TEXTURE_LN | CELL_GCM_TEXTURE_UN)");
-
-		free(unswizzledPixels);
 		break;
 	}
 
@@ -488,6 +443,11 @@ void GLTexture::Init(RSXTexture& tex)
 
 	checkForGlError("GLTexture::Init() -> remap");
 
+	InitParameters(tex);
+}
+
+void GLTexture::InitParameters(RSXTexture& tex)
+{
 	static const int gl_tex_zfunc[] =
 	{
 		GL_NEVER,
@@ -548,11 +508,6 @@ void GLTexture::Init(RSXTexture& tex)
 	checkForGlError("GLTexture::Init() -> max anisotropy");
 
 	//Unbind();
-
-	if (is_swizzled && format == CELL_GCM_TEXTURE_A8R8G8B8)
-	{
-		free(unswizzledPixels);
-	}
 }
 
 void GLTexture::Save(RSXTexture& tex, const std::string& name)
@@ -636,6 +591,187 @@ void GLTexture::Delete()
 	}
 }
 
+GLTextureCache::GLTextureCache()
+	: m_epoch(1)
+	, m_frame(0)
+	, m_frame_hits(0)
+	, m_frame_misses(0)
+	, m_frame_rehashes(0)
+	, m_frame_upload_bytes(0)
+	, m_hits(0)
+	, m_misses(0)
+	, m_rehashes(0)
+	, m_upload_bytes(0)
+{
+}
+
+u32 GLTextureCache::GetTextureSize(const RSXTexture& tex)
+{
+	// Only the first level is read, mipmaps are generated by GL
+	const u32 format = tex.GetFormat() & ~(CELL_GCM_TEXTURE_LN | CELL_GCM_TEXTURE_UN);
+
+	return GetTextureDataSize(format, tex.GetWidth(), tex.GetHeight(), tex.m_pitch, (tex.GetFormat() & CELL_GCM_TEXTURE_LN) != 0);
+}
+
+u64 GLTextureCache::HashData(const u8* data, u32 size)
+{
+	// FNV-1a over 64-bit words, the tail is folded in bytewise
+	u64 hash = 0xcbf29ce484222325ull;
+
+	const u64* words = (const u64*)data;
+
+	for (u32 i = 0; i < size / 8; i++)
+	{
+		hash = (hash ^ words[i]) * 0x100000001b3ull;
+	}
+
+	for (u32 i = size & ~7; i < size; i++)
+	{
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+void GLTextureCache::Bind(RSXTexture& tex)
+{
+	if (tex.GetLocation() > 1)
+	{
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return;
+	}
+
+	const u32 addr = GetAddress(tex.GetOffset(), tex.GetLocation());
+	const u32 size = GetTextureSize(tex);
+
+	const key_t key = { addr, tex.GetFormat(), tex.GetWidth(), tex.GetHeight() };
+
+	entry_t& entry = m_entries[key];
+
+	bool upload = false;
+
+	if (!entry.tex.IsCreated() ||
+		entry.mipmap != tex.GetMipmap() ||
+		entry.pitch != tex.m_pitch ||
+		entry.remap != tex.GetRemap() ||
+		entry.size != size)
+	{
+		entry.mipmap = tex.GetMipmap();
+		entry.pitch = tex.m_pitch;
+		entry.remap = tex.GetRemap();
+		entry.size = size;
+		entry.hash = HashData(vm::get_ptr<const u8>(addr), size);
+		entry.checked = m_epoch;
+		upload = true;
+	}
+	else if (entry.checked != m_epoch)
+	{
+		const u64 hash = HashData(vm::get_ptr<const u8>(addr), size);
+
+		upload = hash != entry.hash;
+		entry.hash = hash;
+		entry.checked = m_epoch;
+
+		if (!upload)
+		{
+			m_frame_rehashes++;
+		}
+	}
+
+	entry.used = m_frame;
+
+	if (upload)
+	{
+		if (!entry.tex.IsCreated())
+		{
+			entry.tex.Create();
+		}
+
+		entry.tex.Init(tex);
+
+		m_frame_misses++;
+		m_frame_upload_bytes += size;
+	}
+	else
+	{
+		entry.tex.Bind();
+		entry.tex.InitParameters(tex);
+
+		m_frame_hits++;
+	}
+}
+
+void GLTextureCache::Invalidate(u32 addr, u32 size)
+{
+	for (auto& entry : m_entries)
+	{
+		if (entry.first.addr < addr + size && addr < entry.first.addr + entry.second.size)
+		{
+			entry.second.checked = 0;
+		}
+	}
+}
+
+void GLTextureCache::OnFlip()
+{
+	if (Ini.RSXLogging.GetValue())
+	{
+		LOG_NOTICE(RSX, "Texture cache: %lld hits (%lld rehashed), %lld misses, %lld bytes uploaded (%d entries)", m_frame_hits, m_frame_rehashes, m_frame_misses, m_frame_upload_bytes, (u32)m_entries.size());
+	}
+
+	m_hits += m_frame_hits;
+	m_misses += m_frame_misses;
+	m_rehashes += m_frame_rehashes;
+	m_upload_bytes += m_frame_upload_bytes;
+	m_frame_hits = 0;
+	m_frame_misses = 0;
+	m_frame_rehashes = 0;
+	m_frame_upload_bytes = 0;
+
+	for (auto it = m_entries.begin(); it != m_entries.end();)
+	{
+		if (m_frame - it->second.used > max_unused_frames)
+		{
+			it->second.tex.Delete();
+			it = m_entries.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	m_frame++;
+
+	// Frame boundary, everything is rehashed on next use
+	Invalidate();
+}
+
+void GLTextureCache::Clear()
+{
+	m_hits += m_frame_hits;
+	m_misses += m_frame_misses;
+	m_rehashes += m_frame_rehashes;
+	m_upload_bytes += m_frame_upload_bytes;
+	m_frame_hits = 0;
+	m_frame_misses = 0;
+	m_frame_rehashes = 0;
+	m_frame_upload_bytes = 0;
+
+	if (m_hits || m_misses)
+	{
+		// a rehashed hit saves the upload but still reads the whole texture
+		LOG_NOTICE(RSX, "Texture cache: %lld hits (%lld rehashed, %lld free), %lld misses (%.1f%% hit rate), %lld bytes uploaded", m_hits, m_rehashes, m_hits - std::min(m_hits, m_rehashes), m_misses, m_hits * 100.0 / (m_hits + m_misses), m_upload_bytes);
+	}
+
+	for (auto& entry : m_entries)
+	{
+		entry.second.tex.Delete();
+	}
+
+	m_entries.clear();
+}
+
 void PostDrawObj::Draw()
 {
 	static bool s_is_initialized = false;
@@ -825,67 +961,90 @@ void GLGSRender::Close()
 
 void GLGSRender::EnableVertexData(bool indexed_draw)
 {
+	// Vertex arrays are fetched from guest memory directly into the stream buffer. Indexed draws fetch
+	// the range of used indices, which are rebased by glDrawElementsBaseVertex.
+	const u32 first = indexed_draw ? m_indexed_array.index_min : m_draw_array_first;
+	const u32 count = indexed_draw ? m_indexed_array.index_max - m_indexed_array.index_min + 1 : m_draw_array_count;
+
+	m_vao.Create();
+	m_vao.Bind();
+	checkForGlError("initializing vao");
+
+	m_stream_buffer.Create(64 * 1024 * 1024);
+	m_stream_buffer.Bind(GL_ARRAY_BUFFER);
+
 	static u32 offset_list[m_vertex_count];
-	u32 cur_offset = 0;
 
-	const u32 data_offset = indexed_draw ? 0 : m_draw_array_first;
+	// reserve the space for the whole draw first, growing or wrapping the buffer later would invalidate the offsets already taken
+	u32 reserve_size = indexed_draw ? (u32)m_indexed_array.m_data.size() + 16 : 0;
 
 	for (u32 i = 0; i < m_vertex_count; ++i)
 	{
-		if (0)
-		{
-			u32 data_format = methodRegisters[NV4097_SET_VERTEX_DATA_ARRAY_FORMAT + i * 4];
-			u16 frequency = data_format >> 16;
-			u8 stride = (data_format >> 8) & 0xff;
-			u8 size = (data_format >> 4) & 0xf;
-			u8 type = data_format & 0xf;
-
-			u32 type_size = 1;
-			switch (type)
-			{
-			case CELL_GCM_VERTEX_S1:    type_size = 2; break;
-			case CELL_GCM_VERTEX_F:     type_size = 4; break;
-			case CELL_GCM_VERTEX_SF:    type_size = 2; break;
-			case CELL_GCM_VERTEX_UB:    type_size = 1; break;
-			case CELL_GCM_VERTEX_S32K:  type_size = 2; break;
-			case CELL_GCM_VERTEX_CMP:   type_size = 4; break;
-			case CELL_GCM_VERTEX_UB256: type_size = 1; break;
-
-			default:
-				LOG_ERROR(RSX, "RSXVertexData::GetTypeSize: Bad vertex data type (%d)!", type);
-				break;
-			}
+		const RSXVertexData& vd = m_vertex_data[i];
 
-			int item_size = size * type_size;
-		}
+		if (!vd.IsEnabled() || !vd.addr) continue;
 
-		offset_list[i] = cur_offset;
+		reserve_size += count * GetVertexTypeSize(vd.type) * vd.size + 16;
+	}
 
-		if (!m_vertex_data[i].IsEnabled()) continue;
-		const size_t item_size = m_vertex_data[i].GetTypeSize() * m_vertex_data[i].size;
-		const size_t data_size = m_vertex_data[i].data.size() - data_offset * item_size;
-		const u32 pos = m_vdata.size();
+	m_stream_buffer.Reserve(reserve_size);
 
-		cur_offset += data_size;
-		m_vdata.resize(m_vdata.size() + data_size);
-		memcpy(&m_vdata[pos], &m_vertex_data[i].data[data_offset * item_size], data_size);
-	}
+	for (u32 i = 0; i < m_vertex_count; ++i)
+	{
+		const RSXVertexData& vd = m_vertex_data[i];
 
-	m_vao.Create();
-	m_vao.Bind();
-	checkForGlError("initializing vao");
+		if (!vd.IsEnabled() || !vd.addr) continue;
+
+		const u32 type_size = GetVertexTypeSize(vd.type);
+		const u32 elem_size = type_size * vd.size;
+		const u32 src_addr = vd.addr + m_vertex_data_base_offset + vd.stride * (first + m_vertex_data_base_index);
+		const u8* src = vm::get_ptr<const u8>(src_addr);
+
+		vertex_stream_t& stream = m_vertex_streams[i];
 
-	m_vbo.Create(indexed_draw ? 2 : 1);
-	m_vbo.Bind(0);
-	m_vbo.SetData(m_vdata.data(), m_vdata.size());
+		if (stream.generation == m_stream_buffer.GetGeneration() &&
+			stream.addr == src_addr &&
+			stream.stride == vd.stride &&
+			stream.type == vd.type &&
+			stream.size == vd.size &&
+			stream.count == count &&
+			stream.epoch == m_vertex_epoch)
+		{
+			m_stream_buffer.MarkUsed(stream.offset, count * elem_size);
+			m_vertex_bytes_reused += count * elem_size;
+		}
+		else
+		{
+			u32 offset;
+			u8* dst = m_stream_buffer.Alloc(count * elem_size, 16, offset);
+
+			ConvertVertexData(dst, src, count, vd.stride, type_size, vd.size);
+
+			stream.addr = src_addr;
+			stream.stride = vd.stride;
+			stream.type = vd.type;
+			stream.size = vd.size;
+			stream.count = count;
+			stream.epoch = m_vertex_epoch;
+			stream.offset = offset;
+			stream.generation = m_stream_buffer.GetGeneration();
+
+			m_vertex_bytes_converted += count * elem_size;
+		}
+
+		offset_list[i] = stream.offset;
+	}
 
 	if (indexed_draw)
 	{
-		m_vbo.Bind(GL_ELEMENT_ARRAY_BUFFER, 1);
-		m_vbo.SetData(GL_ELEMENT_ARRAY_BUFFER, m_indexed_array.m_data.data(), m_indexed_array.m_data.size());
+		u8* dst = m_stream_buffer.Alloc((u32)m_indexed_array.m_data.size(), 16, m_index_offset);
+		memcpy(dst, m_indexed_array.m_data.data(), m_indexed_array.m_data.size());
+
+		m_stream_buffer.Bind(GL_ELEMENT_ARRAY_BUFFER);
 	}
 
-	checkForGlError("initializing vbo");
+	m_stream_buffer.Flush();
+	checkForGlError("initializing stream buffer");
 
 #if	DUMP_VERTEX_DATA
 	rFile dump("VertexDataArray.dump", rFile::write);
@@ -896,6 +1055,7 @@ void GLGSRender::EnableVertexData(bool indexed_draw)
 		if (!m_vertex_data[i].IsEnabled()) continue;
 
 #if	DUMP_VERTEX_DATA
+		m_vertex_data[i].Load(first, count, m_vertex_data_base_offset, m_vertex_data_base_index);
 		dump.Write(wxString::Format("VertexData[%d]:\n", i));
 		switch (m_vertex_data[i].type)
 		{
@@ -1032,7 +1192,6 @@ void GLGSRender::EnableVertexData(bool indexed_draw)
 
 void GLGSRender::DisableVertexData()
 {
-	m_vdata.clear();
 	for (u32 i = 0; i < m_vertex_count; ++i)
 	{
 		if (!m_vertex_data[i].IsEnabled()) continue;
@@ -1146,8 +1305,9 @@ bool GLGSRender::LoadProgram()
 		return false;
 	}
 
+	// nullptr while the programs are decompiled asynchronously
 	GLProgram *result = m_prog_buffer.getGraphicPipelineState(m_cur_vertex_prog, m_cur_fragment_prog, nullptr, nullptr);
-	m_program.id = result->id;
+	m_program.id = result ? result->id : 0;
 	m_program.Use();
 
 	return true;
@@ -1167,6 +1327,13 @@ void GLGSRender::WriteBuffers()
 	{
 		WriteColorBuffers();
 	}
+
+	if (Ini.GSDumpDepthBuffer.GetValue() || Ini.GSDumpColorBuffers.GetValue())
+	{
+		// Buffers were written back to guest memory, cached textures and vertex arrays may alias them
+		m_texture_cache.Invalidate();
+		m_vertex_epoch++;
+	}
 }
 
 void GLGSRender::WriteDepthBuffer()
@@ -1401,6 +1568,18 @@ void GLGSRender::OnInitThread()
 	glGenTextures(1, &g_flip_tex);
 	glGenBuffers(6, g_pbo); // 4 for color buffers + 1 for depth buffer + 1 for flip()
 
+	memset(m_vertex_streams, 0, sizeof(m_vertex_streams));
+	m_vertex_epoch = 1;
+	m_vertex_bytes_converted = 0;
+	m_vertex_bytes_reused = 0;
+
+	m_prog_buffer.Preload();
+
+	if (Ini.GSShaderDecompiler.GetValue())
+	{
+		m_prog_buffer.StartDecompilerWorkers(Ini.GSShaderDecompiler.GetValue() == 2);
+	}
+
 #ifdef _WIN32
 	glSwapInterval(Ini.GSVSyncEnable.GetValue() ? 1 : 0);
 #endif
@@ -1416,26 +1595,53 @@ void GLGSRender::OnExitThread()
 	glDisable(GL_TEXTURE_2D);
 	glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
 
+	m_texture_cache.Clear();
+
+	LOG_NOTICE(RSX, "Vertex fetch: %lld bytes converted, %lld bytes reused", m_vertex_bytes_converted, m_vertex_bytes_reused);
+
+	m_prog_buffer.StopDecompilerWorkers();
+	GLShaderCache::Flush();
+
+	const auto& stats = m_prog_buffer.getDecompilerStats();
+	if (stats.decompiled)
+	{
+		LOG_NOTICE(RSX, "Shader decompiler: %lld programs decompiled asynchronously (average latency %.2f ms, max %.2f ms), %lld draws with pending programs",
+			stats.decompiled, stats.totalLatency / 1000.0 / stats.decompiled, stats.maxLatency / 1000.0, stats.pendingDraws);
+	}
+
 	m_program.Delete();
 	m_rbo.Delete();
 	m_fbo.Delete();
-	m_vbo.Delete();
+	m_stream_buffer.Delete();
 	m_vao.Delete();
 }
 
+void GLGSRender::LoadVertexData(u32 first, u32 count)
+{
+	// vertex arrays are fetched into the stream buffer by EnableVertexData()
+}
+
 void GLGSRender::OnReset()
 {
 	m_program.UnUse();
 
-	if (m_vbo.IsCreated())
-	{
-		m_vbo.UnBind();
-		m_vbo.Delete();
-	}
-
+	m_stream_buffer.Delete();
 	m_vao.Delete();
 }
 
+void GLGSRender::OnMemoryWritten(u32 addr, u32 size)
+{
+	m_texture_cache.Invalidate(addr, size);
+	m_vertex_epoch++;
+}
+
+void GLGSRender::OnCommandsSubmitted()
+{
+	// textures and vertex arrays could be written by the PPU before the commands using them were submitted
+	m_texture_cache.Invalidate();
+	m_vertex_epoch++;
+}
+
 void GLGSRender::InitDrawBuffers()
 {
 	if (!m_fbo.IsCreated() || RSXThread::m_width != last_width || RSXThread::m_height != last_height || last_depth_format != m_surface_depth_format)
@@ -1663,6 +1869,12 @@ void GLGSRender::ExecCMD()
 		return;
 	}
 
+	// skip the draw until its programs are decompiled
+	if (!m_program.IsCreated())
+	{
+		return;
+	}
+
 	InitDrawBuffers();
 
 	if (m_set_color_mask)
@@ -1941,12 +2153,9 @@ void GLGSRender::ExecCMD()
 
 		glActiveTexture(GL_TEXTURE0 + i);
 		checkForGlError("glActiveTexture");
-		m_gl_textures[i].Create();
-		m_gl_textures[i].Bind();
-		checkForGlError(fmt::Format("m_gl_textures[%d].Bind", i));
+		m_texture_cache.Bind(m_textures[i]);
+		checkForGlError(fmt::Format("m_texture_cache.Bind(m_textures[%d])", i));
 		m_program.SetTex(i);
-		m_gl_textures[i].Init(m_textures[i]);
-		checkForGlError(fmt::Format("m_gl_textures[%d].Init", i));
 	}
 
 	for (u32 i = 0; i < m_textures_count; ++i)
@@ -1955,21 +2164,13 @@ void GLGSRender::ExecCMD()
 
 		glActiveTexture(GL_TEXTURE0 + m_textures_count + i);
 		checkForGlError("glActiveTexture");
-		m_gl_vertex_textures[i].Create();
-		m_gl_vertex_textures[i].Bind();
-		checkForGlError(fmt::Format("m_gl_vertex_textures[%d].Bind", i));
+		m_texture_cache.Bind(m_vertex_textures[i]);
+		checkForGlError(fmt::Format("m_texture_cache.Bind(m_vertex_textures[%d])", i));
 		m_program.SetVTex(i);
-		m_gl_vertex_textures[i].Init(m_vertex_textures[i]);
-		checkForGlError(fmt::Format("m_gl_vertex_textures[%d].Init", i));
 	}
 
 	m_vao.Bind();
 
-	if (m_indexed_array.m_count)
-	{
-		LoadVertexData(m_indexed_array.index_min, m_indexed_array.index_max - m_indexed_array.index_min + 1);
-	}
-
 	if (m_indexed_array.m_count || m_draw_array_count)
 	{
 		EnableVertexData(m_indexed_array.m_count ? true : false);
@@ -1983,12 +2184,12 @@ void GLGSRender::ExecCMD()
 		switch(m_indexed_array.m_type)
 		{
 		case CELL_GCM_DRAW_INDEX_ARRAY_TYPE_32:
-			glDrawElements(m_draw_mode - 1, m_indexed_array.m_count, GL_UNSIGNED_INT, nullptr);
+			glDrawElementsBaseVertex(m_draw_mode - 1, m_indexed_array.m_count, GL_UNSIGNED_INT, reinterpret_cast<void*>(m_index_offset), -(GLint)m_indexed_array.index_min);
 			checkForGlError("glDrawElements #4");
 			break;
 
 		case CELL_GCM_DRAW_INDEX_ARRAY_TYPE_16:
-			glDrawElements(m_draw_mode - 1, m_indexed_array.m_count, GL_UNSIGNED_SHORT, nullptr);
+			glDrawElementsBaseVertex(m_draw_mode - 1, m_indexed_array.m_count, GL_UNSIGNED_SHORT, reinterpret_cast<void*>(m_index_offset), -(GLint)m_indexed_array.index_min);
 			checkForGlError("glDrawElements #2");
 			break;
 
@@ -2009,6 +2210,9 @@ void GLGSRender::ExecCMD()
 		DisableVertexData();
 	}
 
+	// the draws reading the stream buffer were issued
+	m_stream_buffer.Fence();
+
 	WriteBuffers();
 }
 
@@ -2134,6 +2338,16 @@ void GLGSRender::Flip()
 
 	m_frame->Flip(m_context);
 
+	m_texture_cache.OnFlip();
+
+	GLShaderCache::Flush();
+
+	if (Ini.RSXLogging.GetValue())
+	{
+		const auto& stats = m_prog_buffer.getDecompilerStats();
+		LOG_NOTICE(RSX, "Shader decompiler: %d programs queued, %lld decompiled, %lld draws with pending programs", stats.queueDepth, stats.decompiled, stats.pendingDraws);
+	}
+
 	// Restore scissor
 	if (m_set_scissor_horizontal && m_set_scissor_vertical)
 	{
@@ -2142,33 +2356,3 @@ void GLGSRender::Flip()
 	}
 
 }
-
-u32 LinearToSwizzleAddress(u32 x, u32 y, u32 z, u32 log2_width, u32 log2_height, u32 log2_depth)
-{
-	u32 offset = 0;
-	u32 shift_count = 0;
-	while (log2_width | log2_height | log2_depth){
-		if (log2_width)
-		{
-			offset |= (x & 0x01) << shift_count;
-			x >>= 1;
-			++shift_count;
-			--log2_width;
-		}
-		if (log2_height)
-		{
-			offset |= (y & 0x01) << shift_count;
-			y >>= 1;
-			++shift_count;
-			--log2_height;
-		}
-		if (log2_depth)
-		{
-			offset |= (z & 0x01) << shift_count;
-			z >>= 1;
-			++shift_count;
-			--log2_depth;
-		}
-	}
-	return offset;
-}
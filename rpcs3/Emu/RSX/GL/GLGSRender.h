@@ -18,7 +18,6 @@
 extern GLenum g_last_gl_error;
 void printGlError(GLenum err, const char* situation);
 void printGlError(GLenum err, const std::string& situation);
-u32 LinearToSwizzleAddress(u32 x, u32 y, u32 z, u32 log2_width, u32 log2_height, u32 log2_depth);
 
 
 class GLTexture
@@ -32,6 +31,11 @@ public:
 
 	void Create();
 
+	bool IsCreated() const
+	{
+		return m_id != 0;
+	}
+
 	int GetGlWrap(int wrap);
 
 	float GetMaxAniso(int aniso);
@@ -56,6 +60,9 @@ public:
 
 	void Init(RSXTexture& tex);
 
+	// Sampler state only, the image itself is left untouched
+	void InitParameters(RSXTexture& tex);
+
 	void Save(RSXTexture& tex, const std::string& name);
 
 	void Save(RSXTexture& tex);
@@ -67,6 +74,84 @@ public:
 	void Delete();
 };
 
+// Keeps uploaded textures alive between draws. Entries are keyed by guest address, format and
+// dimensions and validated against a hash of the texture data, so guest writes trigger a re-upload.
+class GLTextureCache
+{
+	struct key_t
+	{
+		u32 addr;
+		u8 format;
+		u16 width;
+		u16 height;
+
+		bool operator ==(const key_t& right) const
+		{
+			return addr == right.addr && format == right.format && width == right.width && height == right.height;
+		}
+	};
+
+	struct key_hash_t
+	{
+		size_t operator()(const key_t& key) const
+		{
+			// address in the high half, format in the top byte of the low half, dimensions folded into the remaining 24 bits
+			const u64 dims = ((u64)key.width << 12 ^ key.height) & 0xffffff;
+
+			return std::hash<u64>()(((u64)key.addr << 32) | ((u64)key.format << 24) | dims);
+		}
+	};
+
+	struct entry_t
+	{
+		GLTexture tex;
+		u16 mipmap;
+		u32 pitch;
+		u32 remap;
+		u32 size;
+		u64 hash;
+		u32 checked; // epoch of the last hash check
+		u32 used; // frame of the last use
+	};
+
+	std::unordered_map<key_t, entry_t, key_hash_t> m_entries;
+	u32 m_epoch;
+	u32 m_frame;
+
+	u64 m_frame_hits;
+	u64 m_frame_misses;
+	u64 m_frame_rehashes; // hits which had to hash the texture data again
+	u64 m_frame_upload_bytes;
+	u64 m_hits;
+	u64 m_misses;
+	u64 m_rehashes;
+	u64 m_upload_bytes;
+
+public:
+	// Entries not used for this many frames are released
+	static const u32 max_unused_frames = 120;
+
+	GLTextureCache();
+
+	// Bind the texture to the active texture unit, uploading it if required
+	void Bind(RSXTexture& tex);
+
+	// Force the data of every entry to be rehashed on next use (call after the guest memory may have changed)
+	void Invalidate()
+	{
+		m_epoch++;
+	}
+
+	// Force entries overlapping the memory range to be rehashed on next use
+	void Invalidate(u32 addr, u32 size);
+
+	void OnFlip();
+	void Clear();
+
+	static u32 GetTextureSize(const RSXTexture& tex);
+	static u64 HashData(const u8* data, u32 size);
+};
+
 class PostDrawObj
 {
 protected:
@@ -139,7 +224,6 @@ class GLGSRender //TODO: find out why this used to inherit from wxWindow
 	/*,*/ public GSRender
 {
 private:
-	std::vector<u8> m_vdata;
 	std::vector<PostDrawObj> m_post_draw_objs;
 
 	GLProgram m_program;
@@ -150,11 +234,29 @@ private:
 	GLFragmentProgram m_fragment_prog;
 	GLVertexProgram m_vertex_prog;
 
-	GLTexture m_gl_textures[m_textures_count];
-	GLTexture m_gl_vertex_textures[m_textures_count];
+	GLTextureCache m_texture_cache;
+
+	// last converted range of every vertex array, reused until new commands are submitted, memory is written by a transfer or the stream buffer wraps
+	struct vertex_stream_t
+	{
+		u32 addr;
+		u32 stride;
+		u32 type;
+		u32 size;
+		u32 count;
+		u32 epoch;
+		u32 offset;
+		u32 generation;
+	};
+
+	vertex_stream_t m_vertex_streams[m_vertex_count];
+	u32 m_vertex_epoch;
+	u64 m_vertex_bytes_converted;
+	u64 m_vertex_bytes_reused;
+	u32 m_index_offset;
 
 	GLvao m_vao;
-	GLvbo m_vbo;
+	GLStreamBuffer m_stream_buffer;
 	GLrbo m_rbo;
 	GLfbo m_fbo;
 
@@ -194,7 +296,10 @@ protected:
 	virtual void OnInitThread();
 	virtual void OnExitThread();
 	virtual void OnReset();
+	virtual void LoadVertexData(u32 first, u32 count);
 	virtual void ExecCMD(u32 cmd);
 	virtual void ExecCMD();
 	virtual void Flip();
+	virtual void OnMemoryWritten(u32 addr, u32 size);
+	virtual void OnCommandsSubmitted();
 };
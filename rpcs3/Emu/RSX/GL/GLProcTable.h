@@ -7,6 +7,11 @@ OPENGL_PROC(PFNGLBUFFERSUBDATAPROC, BufferSubData);
 OPENGL_PROC(PFNGLGETBUFFERSUBDATAPROC, GetBufferSubData);
 OPENGL_PROC(PFNGLMAPBUFFERPROC, MapBuffer);
 OPENGL_PROC(PFNGLUNMAPBUFFERPROC, UnmapBuffer);
+OPENGL_PROC(PFNGLMAPBUFFERRANGEPROC, MapBufferRange);
+OPENGL_PROC(PFNGLBUFFERSTORAGEPROC, BufferStorage);
+OPENGL_PROC(PFNGLFENCESYNCPROC, FenceSync);
+OPENGL_PROC(PFNGLCLIENTWAITSYNCPROC, ClientWaitSync);
+OPENGL_PROC(PFNGLDELETESYNCPROC, DeleteSync);
 OPENGL_PROC(PFNGLGETBUFFERPARAMETERIVPROC, GetBufferParameteriv);
 OPENGL_PROC(PFNGLGETBUFFERPOINTERVPROC, GetBufferPointerv);
 OPENGL_PROC(PFNGLBLENDFUNCSEPARATEPROC, BlendFuncSeparate);
@@ -28,6 +33,9 @@ OPENGL_PROC(PFNGLBINDATTRIBLOCATIONPROC, BindAttribLocation);
 OPENGL_PROC(PFNGLGETUNIFORMLOCATIONPROC, GetUniformLocation);
 OPENGL_PROC(PFNGLGETPROGRAMIVPROC, GetProgramiv);
 OPENGL_PROC(PFNGLGETPROGRAMINFOLOGPROC, GetProgramInfoLog);
+OPENGL_PROC(PFNGLGETPROGRAMBINARYPROC, GetProgramBinary);
+OPENGL_PROC(PFNGLPROGRAMBINARYPROC, ProgramBinary);
+OPENGL_PROC(PFNGLPROGRAMPARAMETERIPROC, ProgramParameteri);
 OPENGL_PROC(PFNGLVERTEXATTRIB4BVPROC, VertexAttrib4bv);
 OPENGL_PROC(PFNGLVERTEXATTRIB4UBVPROC, VertexAttrib4ubv);
 OPENGL_PROC(PFNGLVERTEXATTRIB1SPROC, VertexAttrib1s);
@@ -96,6 +104,7 @@ OPENGL_PROC(PFNGLFRAMEBUFFERTEXTURE3DPROC, FramebufferTexture3D);
 OPENGL_PROC(PFNGLFRAMEBUFFERRENDERBUFFERPROC, FramebufferRenderbuffer);
 OPENGL_PROC(PFNGLBLITFRAMEBUFFERPROC, BlitFramebuffer);
 OPENGL_PROC(PFNGLDRAWBUFFERSPROC, DrawBuffers);
+OPENGL_PROC(PFNGLDRAWELEMENTSBASEVERTEXPROC, DrawElementsBaseVertex);
 OPENGL_PROC(PFNGLPRIMITIVERESTARTINDEXPROC, PrimitiveRestartIndex);
 
 #ifndef __GNUG__
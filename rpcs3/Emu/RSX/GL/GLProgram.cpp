@@ -41,6 +41,10 @@ void GLProgram::Create(const u32 vp, const u32 fp)
 	glAttachShader(id, vp);
 	glAttachShader(id, fp);
 
+	// allow the shader cache to store the linked binary
+	if (glProgramParameteri)
+		glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	glLinkProgram(id);
 
 	GLint linkStatus = GL_FALSE;
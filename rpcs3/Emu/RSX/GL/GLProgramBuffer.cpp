@@ -1,5 +1,482 @@
 #include "stdafx.h"
+#include "rpcs3/Ini.h"
 #include "Utilities/Log.h"
+#include "Utilities/File.h"
 #include "Emu/Memory/Memory.h"
+#include "Emu/System.h"
+#include "GLGSRender.h"
 
-//#include "GLProgramBuffer.h"
\ No newline at end of file
+// Cache file layouts (all values are u32, strings are stored as length + characters):
+//   vp_<ucode hash>.bin:                    magic, version, number of words, microcode, GLSL
+//   fp_<ucode hash>.bin:                    magic, version, microcode size, microcode, GLSL, number of constant offsets, offsets...
+//   prog_<vp GLSL hash>_<fp GLSL hash>.bin: magic, version, binary format, binary size, binary (empty if not supported by the driver)
+static const u32 s_shader_cache_magic = 0x43505352; // "RSPC"
+static const u32 s_shader_cache_version = 1; // increase when the decompilers change, older entries are ignored
+
+static std::string s_shader_cache_path; // empty if the cache is disabled
+static bool s_program_binaries = false;
+
+// entries are written by GLShaderCache::Flush() instead of during draws
+static std::vector<std::pair<std::string, std::vector<u8>>> s_pending_files;
+static std::vector<std::pair<GLuint, std::string>> s_pending_programs; // program and path
+
+namespace
+{
+	struct cache_writer
+	{
+		std::vector<u8> data;
+
+		cache_writer()
+		{
+			write_u32(s_shader_cache_magic);
+			write_u32(s_shader_cache_version);
+		}
+
+		void write(const void* src, size_t size)
+		{
+			data.insert(data.end(), (const u8*)src, (const u8*)src + size);
+		}
+
+		void write_u32(u32 value)
+		{
+			write(&value, sizeof(u32));
+		}
+
+		void write_string(const std::string& str)
+		{
+			write_u32((u32)str.size());
+			write(str.data(), str.size());
+		}
+
+		void queue(const std::string& path)
+		{
+			s_pending_files.emplace_back(path, std::move(data));
+		}
+
+		void save(const std::string& path) const
+		{
+			fs::file f(path, o_write | o_create | o_trunc);
+
+			if (!f || f.write(data.data(), data.size()) != data.size())
+			{
+				LOG_ERROR(RSX, "Shader cache: failed to write '%s'", path.c_str());
+			}
+		}
+	};
+
+	struct cache_reader
+	{
+		std::vector<u8> data;
+		size_t pos;
+
+		// read the whole file and check the header
+		bool open(const std::string& path)
+		{
+			fs::file f(path);
+			pos = 0;
+
+			if (!f)
+			{
+				return false;
+			}
+
+			data.resize(f.size());
+
+			u32 magic, version;
+
+			if (f.read(data.data(), data.size()) != data.size() || !read_u32(magic) || !read_u32(version))
+			{
+				LOG_WARNING(RSX, "Shader cache: failed to read '%s'", path.c_str());
+				return false;
+			}
+
+			return magic == s_shader_cache_magic && version == s_shader_cache_version;
+		}
+
+		const u8* read(size_t size)
+		{
+			if (size > data.size() - pos)
+			{
+				return nullptr;
+			}
+
+			pos += size;
+			return data.data() + pos - size;
+		}
+
+		bool read_u32(u32& value)
+		{
+			const u8* src = read(sizeof(u32));
+			if (src) memcpy(&value, src, sizeof(u32));
+			return src != nullptr;
+		}
+
+		bool read_string(std::string& str)
+		{
+			u32 size;
+			const u8* src;
+
+			if (!read_u32(size) || !(src = read(size)))
+			{
+				return false;
+			}
+
+			str.assign((const char*)src, size);
+			return true;
+		}
+	};
+
+	std::string get_program_path(const GLVertexProgram& vp, const GLFragmentProgram& fp)
+	{
+		return fmt::Format("%s/prog_%016llX_%016llX.bin", s_shader_cache_path.c_str(), GLShaderCache::HashSource(vp.shader), GLShaderCache::HashSource(fp.shader));
+	}
+
+	bool load_vertex_program(const std::string& path, std::vector<u32>& data, std::string& shader)
+	{
+		cache_reader r;
+		u32 count;
+		const u8* ucode;
+
+		if (!r.open(path) || !r.read_u32(count) || !(ucode = r.read(count * sizeof(u32))) || !r.read_string(shader))
+		{
+			return false;
+		}
+
+		data.assign((const u32*)ucode, (const u32*)ucode + count);
+		return true;
+	}
+
+	bool load_fragment_program(const std::string& path, std::vector<u8>& data, std::string& shader, std::vector<size_t>& offsets)
+	{
+		cache_reader r;
+		u32 size, count;
+		const u8* ucode;
+
+		if (!r.open(path) || !r.read_u32(size) || !(ucode = r.read(size)) || !r.read_string(shader) || !r.read_u32(count))
+		{
+			return false;
+		}
+
+		// the microcode must end with an instruction flagged as the last one, as in guest memory
+		bool end = false;
+		u32 pos = 0;
+
+		while (!end && pos + 16 <= size)
+		{
+			const u32* inst = (const u32*)(ucode + pos);
+			end = (inst[0] >> 8) & 0x1;
+			pos += 16;
+
+			// skip constants
+			if (ProgramHashUtil::FragmentProgramUtil::isConstant(inst[1]) ||
+				ProgramHashUtil::FragmentProgramUtil::isConstant(inst[2]) ||
+				ProgramHashUtil::FragmentProgramUtil::isConstant(inst[3]))
+				pos += 16;
+		}
+
+		if (!end || pos != size)
+		{
+			return false;
+		}
+
+		data.assign(ucode, ucode + size);
+		offsets.resize(count);
+
+		for (auto& offset : offsets)
+		{
+			u32 value;
+			if (!r.read_u32(value)) return false;
+			offset = value;
+		}
+
+		return true;
+	}
+}
+
+bool GLShaderCache::Init()
+{
+	s_shader_cache_path.clear();
+	s_program_binaries = false;
+	s_pending_files.clear();
+	s_pending_programs.clear();
+
+	if (!Ini.GSShaderCache.GetValue())
+	{
+		return false;
+	}
+
+	std::string dir = Emu.GetEmulatorPath().empty() ? std::string("shader_cache") : Emu.GetEmulatorPath() + "/shader_cache";
+
+	if (!Emu.GetTitleID().empty())
+	{
+		dir += "/" + Emu.GetTitleID();
+	}
+
+	if (!fs::is_dir(dir) && !fs::create_path(dir))
+	{
+		LOG_ERROR(RSX, "Shader cache: failed to create '%s'", dir.c_str());
+		return false;
+	}
+
+	s_shader_cache_path = dir;
+
+	GLint formats = 0;
+
+	if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+
+	s_program_binaries = formats > 0;
+
+	LOG_NOTICE(RSX, "Shader cache: '%s' (program binaries %s)", dir.c_str(), s_program_binaries ? "enabled" : "not supported");
+	return true;
+}
+
+u64 GLShaderCache::HashSource(const std::string& source)
+{
+	// 64-bit Fowler/Noll/Vo FNV-1a hash code
+	u64 hash = 0xCBF29CE484222325ULL;
+
+	for (char c : source)
+	{
+		hash = (hash ^ (u8)c) * 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+void GLShaderCache::SaveVertexProgram(const std::vector<u32>& data, const GLVertexProgram& program)
+{
+	if (s_shader_cache_path.empty())
+	{
+		return;
+	}
+
+	cache_writer w;
+	w.write_u32((u32)data.size());
+	w.write(data.data(), data.size() * sizeof(u32));
+	w.write_string(program.shader);
+	w.queue(fmt::Format("%s/vp_%016llX.bin", s_shader_cache_path.c_str(), (u64)ProgramHashUtil::HashVertexProgram()(data)));
+}
+
+void GLShaderCache::SaveFragmentProgram(const void* data, const GLFragmentProgram& program)
+{
+	if (s_shader_cache_path.empty())
+	{
+		return;
+	}
+
+	const u32 size = (u32)ProgramHashUtil::FragmentProgramUtil::getFPBinarySize(const_cast<void*>(data));
+
+	cache_writer w;
+	w.write_u32(size);
+	w.write(data, size);
+	w.write_string(program.shader);
+	w.write_u32((u32)program.FragmentConstantOffsetCache.size());
+
+	for (size_t offset : program.FragmentConstantOffsetCache)
+	{
+		w.write_u32((u32)offset);
+	}
+
+	w.queue(fmt::Format("%s/fp_%016llX.bin", s_shader_cache_path.c_str(), (u64)ProgramHashUtil::HashFragmentProgram()(data)));
+}
+
+bool GLShaderCache::LoadProgram(GLProgram& program, const GLVertexProgram& vp, const GLFragmentProgram& fp)
+{
+	if (!s_program_binaries)
+	{
+		return false;
+	}
+
+	cache_reader r;
+	u32 format, size;
+	const u8* binary;
+
+	if (!r.open(get_program_path(vp, fp)) || !r.read_u32(format) || !r.read_u32(size) || !size || !(binary = r.read(size)))
+	{
+		return false;
+	}
+
+	program.id = glCreateProgram();
+	glProgramBinary(program.id, format, binary, size);
+
+	// binaries are rejected after driver or hardware changes
+	GLint status = GL_FALSE;
+	glGetProgramiv(program.id, GL_LINK_STATUS, &status);
+
+	if (status != GL_TRUE)
+	{
+		LOG_WARNING(RSX, "Shader cache: program binary rejected by the driver");
+		program.Delete();
+		return false;
+	}
+
+	return true;
+}
+
+void GLShaderCache::SaveProgram(const GLProgram& program, const GLVertexProgram& vp, const GLFragmentProgram& fp)
+{
+	if (s_shader_cache_path.empty() || !program.IsCreated())
+	{
+		return;
+	}
+
+	// the binary is read by Flush(), the program is alive until the program buffer is cleared
+	s_pending_programs.emplace_back(program.id, get_program_path(vp, fp));
+}
+
+void GLShaderCache::Flush()
+{
+	for (auto& program : s_pending_programs)
+	{
+		const std::string& path = program.second;
+
+		cache_writer w;
+
+		if (!s_program_binaries)
+		{
+			// only the shader pair is recorded to be linked at boot
+			if (!fs::is_file(path))
+			{
+				w.write_u32(0);
+				w.write_u32(0);
+				w.save(path);
+			}
+
+			continue;
+		}
+
+		GLint status = GL_FALSE, length = 0;
+		glGetProgramiv(program.first, GL_LINK_STATUS, &status);
+		glGetProgramiv(program.first, GL_PROGRAM_BINARY_LENGTH, &length);
+
+		if (status != GL_TRUE || length <= 0)
+		{
+			continue;
+		}
+
+		std::vector<u8> binary(length);
+		GLsizei written = 0;
+		GLenum format = 0;
+		glGetProgramBinary(program.first, length, &written, &format, binary.data());
+
+		w.write_u32(format);
+		w.write_u32(written);
+		w.write(binary.data(), written);
+		w.save(path);
+	}
+
+	for (auto& file : s_pending_files)
+	{
+		fs::file f(file.first, o_write | o_create | o_trunc);
+
+		if (!f || f.write(file.second.data(), file.second.size()) != file.second.size())
+		{
+			LOG_ERROR(RSX, "Shader cache: failed to write '%s'", file.first.c_str());
+		}
+	}
+
+	s_pending_programs.clear();
+	s_pending_files.clear();
+}
+
+std::string GLShaderCache::GetPath()
+{
+	return s_shader_cache_path;
+}
+
+void GLProgramBuffer::Preload()
+{
+	if (!GLShaderCache::Init())
+	{
+		return;
+	}
+
+	const std::string path = GLShaderCache::GetPath();
+
+	// loaded programs by GLSL source hash
+	std::unordered_map<u64, GLVertexProgram*> vertex_programs;
+	std::unordered_map<u64, GLFragmentProgram*> fragment_programs;
+	std::vector<std::string> pipelines;
+
+	fs::dir dir(path);
+	std::string name;
+	fs::stat_t info;
+
+	for (bool found = dir.get_first(name, info); found; found = dir.get_next(name, info))
+	{
+		if (info.is_directory)
+		{
+			continue;
+		}
+
+		if (!name.compare(0, 3, "vp_"))
+		{
+			std::vector<u32> data;
+			std::string shader;
+
+			if (!load_vertex_program(path + "/" + name, data, shader))
+			{
+				LOG_WARNING(RSX, "Shader cache: '%s' ignored", name.c_str());
+				continue;
+			}
+
+			bool known;
+			GLVertexProgram& vp = AddVertexProgram(data, known);
+
+			if (!known)
+			{
+				vp.shader = shader;
+				vp.Compile();
+			}
+
+			vertex_programs[GLShaderCache::HashSource(vp.shader)] = &vp;
+		}
+		else if (!name.compare(0, 3, "fp_"))
+		{
+			std::vector<u8> data;
+			std::vector<size_t> offsets;
+			std::string shader;
+
+			if (!load_fragment_program(path + "/" + name, data, shader, offsets))
+			{
+				LOG_WARNING(RSX, "Shader cache: '%s' ignored", name.c_str());
+				continue;
+			}
+
+			bool known;
+			GLFragmentProgram& fp = AddFragmentProgram(data.data(), known);
+
+			if (!known)
+			{
+				fp.shader = shader;
+				fp.Compile();
+				fp.FragmentConstantOffsetCache = offsets;
+			}
+
+			fragment_programs[GLShaderCache::HashSource(fp.shader)] = &fp;
+		}
+		else if (!name.compare(0, 5, "prog_") && name.size() == 42)
+		{
+			pipelines.push_back(name);
+		}
+	}
+
+	u32 linked = 0;
+
+	for (auto& pipeline : pipelines)
+	{
+		const auto vp = vertex_programs.find(strtoull(pipeline.c_str() + 5, nullptr, 16));
+		const auto fp = fragment_programs.find(strtoull(pipeline.c_str() + 22, nullptr, 16));
+
+		if (vp != vertex_programs.end() && fp != fragment_programs.end())
+		{
+			AddPipeline(*vp->second, *fp->second, nullptr, nullptr);
+			linked++;
+		}
+	}
+
+	LOG_NOTICE(RSX, "Shader cache: %d vertex programs, %d fragment programs, %d programs loaded", (u32)vertex_programs.size(), (u32)fragment_programs.size(), linked);
+}
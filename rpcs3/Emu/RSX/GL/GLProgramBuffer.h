@@ -2,6 +2,31 @@
 #include "GLProgram.h"
 #include "../Common/ProgramStateCache.h"
 #include "Utilities/File.h"
+#include "rpcs3/Ini.h"
+
+// On-disk cache of decompiled programs (GLSL with the data the decompiler extracts) and of linked program binaries.
+// Vertex and fragment programs are stored with their microcode and keyed on the ProgramHashUtil hashes, linked
+// programs are keyed on the pair of GLSL source hashes. Everything found for the current title is loaded at boot.
+class GLShaderCache
+{
+public:
+	// set up the cache directory of the current title, returns false if the cache is disabled
+	static bool Init();
+
+	static u64 HashSource(const std::string& source);
+
+	static void SaveVertexProgram(const std::vector<u32>& data, const GLVertexProgram& program);
+	static void SaveFragmentProgram(const void* data, const GLFragmentProgram& program);
+
+	// create the program from the cached binary of the shader pair
+	static bool LoadProgram(GLProgram& program, const GLVertexProgram& vp, const GLFragmentProgram& fp);
+	static void SaveProgram(const GLProgram& program, const GLVertexProgram& vp, const GLFragmentProgram& fp);
+
+	// write the entries saved since the last call (on flip and exit, from the thread owning the GL context)
+	static void Flush();
+
+	static std::string GetPath();
+};
 
 struct GLTraits
 {
@@ -12,41 +37,88 @@ struct GLTraits
 	typedef void* ExtraData;
 
 	static
-	void RecompileFragmentProgram(RSXFragmentProgram *RSXFP, FragmentProgramData& fragmentProgramData, size_t ID)
+	void DecompileFragmentProgram(RSXFragmentProgram *RSXFP, const void *ucode, FragmentProgramData& fragmentProgramData)
+	{
+		fragmentProgramData.Decompile(*RSXFP, ucode);
+	}
+
+	static
+	void CompileFragmentProgram(const void *ucode, FragmentProgramData& fragmentProgramData, size_t ID)
 	{
-		fragmentProgramData.Decompile(*RSXFP);
 		fragmentProgramData.Compile();
 		//checkForGlError("m_fragment_prog.Compile");
 
-		// TODO: This shouldn't use current dir
-		fs::file("./FragmentProgram.txt", o_write | o_create | o_trunc).write(fragmentProgramData.shader.c_str(), fragmentProgramData.shader.size());
+		GLShaderCache::SaveFragmentProgram(ucode, fragmentProgramData);
+
+		if (Ini.GSLogPrograms.GetValue())
+		{
+			// TODO: This shouldn't use current dir
+			fs::file("./FragmentProgram.txt", o_write | o_create | o_trunc).write(fragmentProgramData.shader.c_str(), fragmentProgramData.shader.size());
+		}
 	}
 
 	static
-	void RecompileVertexProgram(RSXVertexProgram *RSXVP, VertexProgramData& vertexProgramData, size_t ID)
+	void DecompileVertexProgram(RSXVertexProgram *RSXVP, VertexProgramData& vertexProgramData)
 	{
 		vertexProgramData.Decompile(*RSXVP);
+	}
+
+	static
+	void CompileVertexProgram(const std::vector<u32> &data, VertexProgramData& vertexProgramData, size_t ID)
+	{
 		vertexProgramData.Compile();
 		//checkForGlError("m_vertex_prog.Compile");
 
-		// TODO: This shouldn't use current dir
-		fs::file("./VertexProgram.txt", o_write | o_create | o_trunc).write(vertexProgramData.shader.c_str(), vertexProgramData.shader.size());
+		GLShaderCache::SaveVertexProgram(data, vertexProgramData);
+
+		if (Ini.GSLogPrograms.GetValue())
+		{
+			// TODO: This shouldn't use current dir
+			fs::file("./VertexProgram.txt", o_write | o_create | o_trunc).write(vertexProgramData.shader.c_str(), vertexProgramData.shader.size());
+		}
+	}
+
+	// used while the fragment program of a draw is being decompiled
+	static
+	void CreateFallbackFragmentProgram(FragmentProgramData& fragmentProgramData)
+	{
+		fragmentProgramData.shader =
+			"#version 420\n"
+			"\n"
+			"layout (location = 0) out vec4 ocol0;\n"
+			"\n"
+			"void main()\n"
+			"{\n"
+			"\tocol0 = vec4(0.0, 0.0, 0.0, 1.0);\n"
+			"}\n";
+
+		fragmentProgramData.Compile();
 	}
 
 	static
 	PipelineData *BuildProgram(VertexProgramData &vertexProgramData, FragmentProgramData &fragmentProgramData, const PipelineProperties &pipelineProperties, const ExtraData& extraData)
 	{
 		GLProgram *result = new GLProgram();
-		result->Create(vertexProgramData.id, fragmentProgramData.id);
-		//checkForGlError("m_program.Create");
+
+		if (!GLShaderCache::LoadProgram(*result, vertexProgramData, fragmentProgramData))
+		{
+			result->Create(vertexProgramData.id, fragmentProgramData.id);
+			//checkForGlError("m_program.Create");
+
+			GLShaderCache::SaveProgram(*result, vertexProgramData, fragmentProgramData);
+		}
+
 		result->Use();
 
 		LOG_NOTICE(RSX, "*** prog id = %d", result->id);
 		LOG_NOTICE(RSX, "*** vp id = %d", vertexProgramData.id);
 		LOG_NOTICE(RSX, "*** fp id = %d", fragmentProgramData.id);
 
-		LOG_NOTICE(RSX, "*** vp shader = \n%s", vertexProgramData.shader.c_str());
-		LOG_NOTICE(RSX, "*** fp shader = \n%s", fragmentProgramData.shader.c_str());
+		if (Ini.GSLogPrograms.GetValue())
+		{
+			LOG_NOTICE(RSX, "*** vp shader = \n%s", vertexProgramData.shader.c_str());
+			LOG_NOTICE(RSX, "*** fp shader = \n%s", fragmentProgramData.shader.c_str());
+		}
 
 		return result;
 	}
@@ -60,4 +132,7 @@ struct GLTraits
 
 class GLProgramBuffer : public ProgramStateCache<GLTraits>
 {
+public:
+	// compile and link programs of the current title stored in the shader cache
+	void Preload();
 };
@@ -177,26 +177,20 @@ public:
 	{
 		std::unordered_map<char, char> swizzle;
 
-		static std::unordered_map<int, char> pos_to_swizzle =
-		{
-			{ 0, 'x' },
-			{ 1, 'y' },
-			{ 2, 'z' },
-			{ 3, 'w' }
-		};
+		static const char pos_to_swizzle[4] = { 'x', 'y', 'z', 'w' };
 
-		for (auto &i : pos_to_swizzle)
+		for (int i = 0; i < 4; ++i)
 		{
-			swizzle[i.second] = swizzles[0].length() > i.first ? swizzles[0][i.first] : 0;
+			swizzle[pos_to_swizzle[i]] = swizzles[0].length() > i ? swizzles[0][i] : 0;
 		}
 
 		for (int i = 1; i < swizzles.size(); ++i)
 		{
 			std::unordered_map<char, char> new_swizzle;
 
-			for (auto &sw : pos_to_swizzle)
+			for (int j = 0; j < 4; ++j)
 			{
-				new_swizzle[sw.second] = swizzle[swizzles[i].length() <= sw.first ? '\0' : swizzles[i][sw.first]];
+				new_swizzle[pos_to_swizzle[j]] = swizzle[swizzles[i].length() <= j ? '\0' : swizzles[i][j]];
 			}
 
 			swizzle = new_swizzle;
@@ -205,10 +199,10 @@ public:
 		swizzles.clear();
 		std::string new_swizzle;
 
-		for (auto &i : pos_to_swizzle)
+		for (int i = 0; i < 4; ++i)
 		{
-			if (swizzle[i.second] != '\0')
-				new_swizzle += swizzle[i.second];
+			if (swizzle[pos_to_swizzle[i]] != '\0')
+				new_swizzle += swizzle[pos_to_swizzle[i]];
 		}
 
 		swizzles.push_back(new_swizzle);
@@ -58,7 +58,7 @@ std::string GLVertexDecompilerThread::GetDST(bool isSca)
 
 std::string GLVertexDecompilerThread::GetSRC(const u32 n)
 {
-	static const std::string reg_table[] =
+	static const char* const reg_table[] =
 	{
 		"in_pos", "in_weight", "in_normal",
 		"in_diff_color", "in_spec_color",
@@ -97,7 +97,7 @@ std::string GLVertexDecompilerThread::GetSRC(const u32 n)
 		break;
 	}
 
-	static const std::string f = "xyzw";
+	static const char f[] = "xyzw";
 
 	std::string swizzle;
 
@@ -386,7 +386,8 @@ std::string GLVertexDecompilerThread::BuildFuncBody(const FuncInfo& func)
 	return result;
 }
 
-std::string GLVertexDecompilerThread::BuildCode()
+// Output registers, kept at namespace scope to be initialized before decompilers run on worker threads
+namespace
 {
 	struct reg_info
 	{
@@ -397,7 +398,7 @@ std::string GLVertexDecompilerThread::BuildCode()
 		bool need_cast;
 	};
 
-	static const reg_info reg_table[] =
+	const reg_info output_reg_table[] =
 	{
 		{ "gl_Position", false, "dst_reg0", "", false },
 		{ "diff_color", true, "dst_reg1", "", false },
@@ -423,10 +424,13 @@ std::string GLVertexDecompilerThread::BuildCode()
 		{ "tc8", true, "dst_reg15", "", false },
 		{ "tc9", true, "dst_reg6", "", false }  // In this line, dst_reg6 is correct since dst_reg goes from 0 to 15.
 	};
+}
 
+std::string GLVertexDecompilerThread::BuildCode()
+{
 	std::string f;
 
-	for (auto &i : reg_table)
+	for (auto &i : output_reg_table)
 	{
 		if (m_parr.HasParam(PARAM_NONE, "vec4", i.src_reg))
 		{
@@ -497,7 +501,7 @@ std::string GLVertexDecompilerThread::BuildCode()
 		f += fmt::Format("\nvoid %s()\n{\n%s}\n", m_funcs[i].name.c_str(), BuildFuncBody(m_funcs[i]).c_str());
 	}
 
-	static const std::string& prot =
+	static const char prot[] =
 		"#version 420\n"
 		"\n"
 		"uniform mat4 scaleOffsetMat = mat4(1.0);\n"
@@ -505,7 +509,7 @@ std::string GLVertexDecompilerThread::BuildCode()
 		"%s\n"
 		"%s";
 
-	return fmt::Format(prot.c_str(), p.c_str(), fp.c_str(), f.c_str());
+	return fmt::Format(prot, p.c_str(), fp.c_str(), f.c_str());
 }
 
 void GLVertexDecompilerThread::Task()
@@ -0,0 +1,399 @@
+#include "stdafx.h"
+#include "Utilities/Log.h"
+#include "Emu/Memory/Memory.h"
+#include "GCM.h"
+#include "RSXTextureDecode.h"
+
+#include <tmmintrin.h>
+
+//#define RSX_TEXTURE_DECODE_BENCHMARK 1
+
+u32 GetTexelSize(u32 format)
+{
+	switch (format)
+	{
+	case CELL_GCM_TEXTURE_B8:
+		return 1;
+
+	case CELL_GCM_TEXTURE_A8R8G8B8:
+	case CELL_GCM_TEXTURE_DEPTH24_D8:
+	case CELL_GCM_TEXTURE_DEPTH24_D8_FLOAT:
+	case CELL_GCM_TEXTURE_Y16_X16:
+	case CELL_GCM_TEXTURE_X32_FLOAT:
+	case CELL_GCM_TEXTURE_D8R8G8B8:
+	case CELL_GCM_TEXTURE_Y16_X16_FLOAT:
+		return 4;
+
+	case CELL_GCM_TEXTURE_COMPRESSED_DXT1:
+	case CELL_GCM_TEXTURE_W16_Z16_Y16_X16_FLOAT:
+		return 8;
+
+	case CELL_GCM_TEXTURE_COMPRESSED_DXT23:
+	case CELL_GCM_TEXTURE_COMPRESSED_DXT45:
+	case CELL_GCM_TEXTURE_W32_Z32_Y32_X32_FLOAT:
+		return 16;
+	}
+
+	return 2;
+}
+
+bool IsCompressedFormat(u32 format)
+{
+	return format == CELL_GCM_TEXTURE_COMPRESSED_DXT1 || format == CELL_GCM_TEXTURE_COMPRESSED_DXT23 || format == CELL_GCM_TEXTURE_COMPRESSED_DXT45;
+}
+
+u32 GetTextureDataSize(u32 format, u32 width, u32 height, u32 pitch, bool is_linear)
+{
+	const u32 texel_size = GetTexelSize(format);
+
+	if (IsCompressedFormat(format))
+	{
+		return ((width + 3) / 4) * ((height + 3) / 4) * texel_size;
+	}
+
+	// linear textures may be padded, keep the whole pitch in range
+	if (is_linear && height && pitch > width * texel_size)
+	{
+		return pitch * (height - 1) + width * texel_size;
+	}
+
+	return width * height * texel_size;
+}
+
+u32 Log2Dimension(u32 value)
+{
+	return value ? 31 - cntlz32(value) : 0;
+}
+
+u32 LinearToSwizzleAddress(u32 x, u32 y, u32 z, u32 log2_width, u32 log2_height, u32 log2_depth)
+{
+	u32 offset = 0;
+	u32 shift_count = 0;
+	while (log2_width | log2_height | log2_depth){
+		if (log2_width)
+		{
+			offset |= (x & 0x01) << shift_count;
+			x >>= 1;
+			++shift_count;
+			--log2_width;
+		}
+		if (log2_height)
+		{
+			offset |= (y & 0x01) << shift_count;
+			y >>= 1;
+			++shift_count;
+			--log2_height;
+		}
+		if (log2_depth)
+		{
+			offset |= (z & 0x01) << shift_count;
+			z >>= 1;
+			++shift_count;
+			--log2_depth;
+		}
+	}
+	return offset;
+}
+
+namespace
+{
+	// Swizzled offset is separable (offset(x, y) == offset(x, 0) | offset(0, y)), so the offset of the next
+	// coordinate is obtained by adding the step with the carry propagated through the bits of other axes.
+	__forceinline u32 next_offset(u32 offset, u32 mask, u32 step)
+	{
+		return ((offset | ~mask) + step) & mask;
+	}
+
+	template<typename T> void unswizzle_scalar(T* dst, const T* src, u32 width, u32 height, u32 log2w, u32 log2h)
+	{
+		const u32 mask_x = LinearToSwizzleAddress(width - 1, 0, 0, log2w, log2h, 0);
+		const u32 mask_y = LinearToSwizzleAddress(0, height - 1, 0, log2w, log2h, 0);
+		const u32 step_x = LinearToSwizzleAddress(1, 0, 0, log2w, log2h, 0);
+		const u32 step_y = LinearToSwizzleAddress(0, 1, 0, log2w, log2h, 0);
+
+		for (u32 y = 0, oy = 0; y < height; y++, oy = next_offset(oy, mask_y, step_y))
+		{
+			T* row = dst + y * width;
+
+			for (u32 x = 0, ox = 0; x < width; x++, ox = next_offset(ox, mask_x, step_x))
+			{
+				row[x] = src[ox | oy];
+			}
+		}
+	}
+
+	// Both kernels require width >= 4 and height >= 2, then every 8 consecutive texels form 4x2 block:
+	// (0,0) (1,0) (0,1) (1,1) (2,0) (3,0) (2,1) (3,1)
+
+	void unswizzle_16_sse2(u16* dst, const u16* src, u32 width, u32 height, u32 log2w, u32 log2h)
+	{
+		const u32 mask_x = LinearToSwizzleAddress(width - 1, 0, 0, log2w, log2h, 0);
+		const u32 mask_y = LinearToSwizzleAddress(0, height - 1, 0, log2w, log2h, 0);
+		const u32 step_x = LinearToSwizzleAddress(4, 0, 0, log2w, log2h, 0);
+		const u32 step_y = LinearToSwizzleAddress(0, 2, 0, log2w, log2h, 0);
+
+		for (u32 y = 0, oy = 0; y < height; y += 2, oy = next_offset(oy, mask_y, step_y))
+		{
+			u16* row0 = dst + y * width;
+			u16* row1 = row0 + width;
+
+			for (u32 x = 0, ox = 0; x < width; x += 4, ox = next_offset(ox, mask_x, step_x))
+			{
+				const __m128i block = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src + (ox | oy))), _MM_SHUFFLE(3, 1, 2, 0));
+
+				_mm_storel_epi64((__m128i*)(row0 + x), block);
+				_mm_storel_epi64((__m128i*)(row1 + x), _mm_unpackhi_epi64(block, block));
+			}
+		}
+	}
+
+	void unswizzle_32_sse2(u32* dst, const u32* src, u32 width, u32 height, u32 log2w, u32 log2h)
+	{
+		const u32 mask_x = LinearToSwizzleAddress(width - 1, 0, 0, log2w, log2h, 0);
+		const u32 mask_y = LinearToSwizzleAddress(0, height - 1, 0, log2w, log2h, 0);
+		const u32 step_x = LinearToSwizzleAddress(4, 0, 0, log2w, log2h, 0);
+		const u32 step_y = LinearToSwizzleAddress(0, 2, 0, log2w, log2h, 0);
+
+		for (u32 y = 0, oy = 0; y < height; y += 2, oy = next_offset(oy, mask_y, step_y))
+		{
+			u32* row0 = dst + y * width;
+			u32* row1 = row0 + width;
+
+			for (u32 x = 0, ox = 0; x < width; x += 4, ox = next_offset(ox, mask_x, step_x))
+			{
+				const __m128i lo = _mm_loadu_si128((const __m128i*)(src + (ox | oy)));
+				const __m128i hi = _mm_loadu_si128((const __m128i*)(src + (ox | oy) + 4));
+
+				_mm_storeu_si128((__m128i*)(row0 + x), _mm_unpacklo_epi64(lo, hi));
+				_mm_storeu_si128((__m128i*)(row1 + x), _mm_unpackhi_epi64(lo, hi));
+			}
+		}
+	}
+
+	// expand two texels per 32-bit word using the shuffle mask, alpha is forced to 255
+	void convert_packed_ssse3(u8* dst, const u8* src, u32 count, __m128i mask_lo, __m128i mask_hi)
+	{
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+		u32 i = 0;
+
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i data = _mm_loadu_si128((const __m128i*)(src + i * 2));
+
+			_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(data, mask_lo), alpha));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_or_si128(_mm_shuffle_epi8(data, mask_hi), alpha));
+		}
+
+		for (; i < count; i += 2)
+		{
+			const __m128i data = _mm_cvtsi32_si128(*(const u32*)(src + i * 2));
+
+			_mm_storel_epi64((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(data, mask_lo), alpha));
+		}
+	}
+}
+
+void UnswizzleTexture(void* dst, const void* src, u32 width, u32 height, u32 texel_size)
+{
+	if (!width || !height)
+	{
+		return;
+	}
+
+	const u32 log2w = Log2Dimension(width);
+	const u32 log2h = Log2Dimension(height);
+	const bool use_sse2 = log2w >= 2 && log2h >= 1;
+
+	switch (texel_size)
+	{
+	case 1: unswizzle_scalar((u8*)dst, (const u8*)src, width, height, log2w, log2h); break;
+	case 2: use_sse2 ? unswizzle_16_sse2((u16*)dst, (const u16*)src, width, height, log2w, log2h) : unswizzle_scalar((u16*)dst, (const u16*)src, width, height, log2w, log2h); break;
+	case 4: use_sse2 ? unswizzle_32_sse2((u32*)dst, (const u32*)src, width, height, log2w, log2h) : unswizzle_scalar((u32*)dst, (const u32*)src, width, height, log2w, log2h); break;
+	case 8: unswizzle_scalar((u64*)dst, (const u64*)src, width, height, log2w, log2h); break;
+	case 16: unswizzle_scalar((u128*)dst, (const u128*)src, width, height, log2w, log2h); break;
+	default: LOG_ERROR(RSX, "UnswizzleTexture(): unsupported texel size (%d)", texel_size);
+	}
+}
+
+void ConvertR6G5B5(u8* dst, const u8* src, u32 count)
+{
+	const __m128i mask6 = _mm_set1_epi16(0x3f);
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	const __m128i alpha = _mm_set1_epi16((s16)0xff00);
+
+	u32 i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + i * 2));
+		c = _mm_or_si128(_mm_slli_epi16(c, 8), _mm_srli_epi16(c, 8));
+
+		// replicate high bits to the low bits (as Convert6To8 and Convert5To8 do)
+		const __m128i r = _mm_and_si128(_mm_srli_epi16(c, 10), mask6);
+		const __m128i g = _mm_and_si128(_mm_srli_epi16(c, 5), mask5);
+		const __m128i b = _mm_and_si128(c, mask5);
+		const __m128i r8 = _mm_or_si128(_mm_slli_epi16(r, 2), _mm_srli_epi16(r, 4));
+		const __m128i g8 = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+		const __m128i b8 = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+		const __m128i rg = _mm_or_si128(r8, _mm_slli_epi16(g8, 8));
+		const __m128i ba = _mm_or_si128(b8, alpha);
+
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+	}
+
+	for (; i < count; i++)
+	{
+		const u16 c = (src[i * 2] << 8) | src[i * 2 + 1];
+		const u8 r = (c >> 10) & 0x3f;
+		const u8 g = (c >> 5) & 0x1f;
+		const u8 b = c & 0x1f;
+
+		dst[i * 4 + 0] = (r << 2) | (r >> 4);
+		dst[i * 4 + 1] = (g << 3) | (g >> 2);
+		dst[i * 4 + 2] = (b << 3) | (b >> 2);
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+void ConvertB8R8_G8R8(u8* dst, const u8* src, u32 count)
+{
+	// source bytes: B R1 G R0
+	convert_packed_ssse3(dst, src, count,
+		_mm_setr_epi8(3, 2, 0, -1, 1, 2, 0, -1, 7, 6, 4, -1, 5, 6, 4, -1),
+		_mm_setr_epi8(11, 10, 8, -1, 9, 10, 8, -1, 15, 14, 12, -1, 13, 14, 12, -1));
+}
+
+void ConvertR8B8_R8G8(u8* dst, const u8* src, u32 count)
+{
+	// source bytes: R1 B R0 G
+	convert_packed_ssse3(dst, src, count,
+		_mm_setr_epi8(2, 3, 1, -1, 0, 3, 1, -1, 6, 7, 5, -1, 4, 7, 5, -1),
+		_mm_setr_epi8(10, 11, 9, -1, 8, 11, 9, -1, 14, 15, 13, -1, 12, 15, 13, -1));
+}
+
+void TextureDecodeBenchmark()
+{
+#ifdef RSX_TEXTURE_DECODE_BENCHMARK
+	const u32 width = 1024;
+	const u32 height = 1024;
+	const u32 repeat = 16;
+
+	std::vector<u8> src(width * height * 4);
+	std::vector<u8> dst(width * height * 4);
+	std::vector<u8> ref(width * height * 4);
+
+	std::mt19937 rng(0);
+
+	for (auto& v : src)
+	{
+		v = (u8)rng();
+	}
+
+	auto measure = [&](const char* name, u32 bytes, u32 out_bytes, std::function<void()> reference, std::function<void()> optimized)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for (u32 i = 0; i < repeat; i++)
+		{
+			reference();
+		}
+
+		const auto ref_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		ref.swap(dst);
+
+		start = std::chrono::high_resolution_clock::now();
+
+		for (u32 i = 0; i < repeat; i++)
+		{
+			optimized();
+		}
+
+		const auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (memcmp(dst.data(), ref.data(), out_bytes))
+		{
+			LOG_ERROR(RSX, "Texture decode benchmark: %s: result mismatch", name);
+		}
+
+		LOG_NOTICE(RSX, "Texture decode benchmark: %s: reference %.1f MB/s, optimized %.1f MB/s", name,
+			ref_time ? (double)bytes * repeat / ref_time : 0.0, time ? (double)bytes * repeat / time : 0.0);
+	};
+
+	for (u32 texel_size : { 2, 4 })
+	{
+		const u32 log2w = Log2Dimension(width);
+		const u32 log2h = Log2Dimension(height);
+
+		measure(texel_size == 2 ? "unswizzle 16-bit" : "unswizzle 32-bit", width * height * texel_size, width * height * texel_size, [&]()
+		{
+			for (u32 y = 0; y < height; y++)
+			{
+				for (u32 x = 0; x < width; x++)
+				{
+					memcpy(&dst[(y * width + x) * texel_size], &src[LinearToSwizzleAddress(x, y, 0, log2w, log2h, 0) * texel_size], texel_size);
+				}
+			}
+		}, [&]()
+		{
+			UnswizzleTexture(dst.data(), src.data(), width, height, texel_size);
+		});
+	}
+
+	const u32 count = width * height / 2;
+
+	measure("R6G5B5", count * 2, count * 4, [&]()
+	{
+		for (u32 i = 0; i < count; i++)
+		{
+			const u16 c = (src[i * 2] << 8) | src[i * 2 + 1];
+			dst[i * 4 + 0] = (((c >> 10) & 0x3f) << 2) | (((c >> 10) & 0x3f) >> 4);
+			dst[i * 4 + 1] = (((c >> 5) & 0x1f) << 3) | (((c >> 5) & 0x1f) >> 2);
+			dst[i * 4 + 2] = ((c & 0x1f) << 3) | ((c & 0x1f) >> 2);
+			dst[i * 4 + 3] = 255;
+		}
+	}, [&]()
+	{
+		ConvertR6G5B5(dst.data(), src.data(), count);
+	});
+
+	measure("B8R8_G8R8", count * 2, count * 4, [&]()
+	{
+		for (u32 i = 0; i < count; i += 2)
+		{
+			dst[i * 4 + 0] = src[i * 2 + 3];
+			dst[i * 4 + 1] = src[i * 2 + 2];
+			dst[i * 4 + 2] = src[i * 2 + 0];
+			dst[i * 4 + 3] = 255;
+			dst[i * 4 + 4] = src[i * 2 + 1];
+			dst[i * 4 + 5] = src[i * 2 + 2];
+			dst[i * 4 + 6] = src[i * 2 + 0];
+			dst[i * 4 + 7] = 255;
+		}
+	}, [&]()
+	{
+		ConvertB8R8_G8R8(dst.data(), src.data(), count);
+	});
+
+	measure("R8B8_R8G8", count * 2, count * 4, [&]()
+	{
+		for (u32 i = 0; i < count; i += 2)
+		{
+			dst[i * 4 + 0] = src[i * 2 + 2];
+			dst[i * 4 + 1] = src[i * 2 + 3];
+			dst[i * 4 + 2] = src[i * 2 + 1];
+			dst[i * 4 + 3] = 255;
+			dst[i * 4 + 4] = src[i * 2 + 0];
+			dst[i * 4 + 5] = src[i * 2 + 3];
+			dst[i * 4 + 6] = src[i * 2 + 1];
+			dst[i * 4 + 7] = 255;
+		}
+	}, [&]()
+	{
+		ConvertR8B8_R8G8(dst.data(), src.data(), count);
+	});
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Conversion of RSX texture data to layouts accepted by the host graphics API (renderer-independent).
+// Format arguments are given without CELL_GCM_TEXTURE_LN and CELL_GCM_TEXTURE_UN flags.
+
+// size of one texel in bytes (size of 4x4 block for DXT formats)
+u32 GetTexelSize(u32 format);
+
+// size of the first level of the texture data in bytes
+u32 GetTextureDataSize(u32 format, u32 width, u32 height, u32 pitch, bool is_linear);
+
+// true if the format is block-compressed (DXT data is passed to the host as is)
+bool IsCompressedFormat(u32 format);
+
+// floor(log2(value))
+u32 Log2Dimension(u32 value);
+
+u32 LinearToSwizzleAddress(u32 x, u32 y, u32 z, u32 log2_width, u32 log2_height, u32 log2_depth);
+
+// convert swizzled (Morton order) 2D texture to linear order, width and height must be powers of two, texel_size is 1, 2, 4, 8 or 16
+void UnswizzleTexture(void* dst, const void* src, u32 width, u32 height, u32 texel_size);
+
+// expand big-endian R6G5B5 texels to RGBA8
+void ConvertR6G5B5(u8* dst, const u8* src, u32 count);
+
+// expand COMPRESSED_B8R8_G8R8 texels (two per 32-bit word) to RGBA8, count must be even
+void ConvertB8R8_G8R8(u8* dst, const u8* src, u32 count);
+
+// expand COMPRESSED_R8B8_R8G8 texels (two per 32-bit word) to RGBA8, count must be even
+void ConvertR8B8_R8G8(u8* dst, const u8* src, u32 count);
+
+// measure decoding throughput and compare results with the reference implementation (enabled by RSX_TEXTURE_DECODE_BENCHMARK)
+void TextureDecodeBenchmark();
@@ -5,6 +5,7 @@
 #include "Emu/System.h"
 #include "Emu/RSX/GSManager.h"
 #include "Emu/RSX/RSXDMA.h"
+#include "Emu/RSX/RSXVertexFetch.h"
 #include "RSXThread.h"
 
 #include "Emu/SysCalls/Callback.h"
@@ -123,54 +124,12 @@ void RSXVertexData::Load(u32 start, u32 count, u32 baseOffset, u32 baseIndex = 0
 
 	data.resize((start + count) * tsize * size);
 
-	for (u32 i = start; i < start + count; ++i)
-	{
-		auto src = vm::get_ptr<const u8>(addr + baseOffset + stride * (i + baseIndex));
-		u8* dst = &data[i * tsize * size];
-
-		switch (tsize)
-		{
-		case 1:
-		{
-			memcpy(dst, src, size);
-			break;
-		}
-
-		case 2:
-		{
-			const u16* c_src = (const u16*)src;
-			u16* c_dst = (u16*)dst;
-			for (u32 j = 0; j < size; ++j) *c_dst++ = re16(*c_src++);
-			break;
-		}
-
-		case 4:
-		{
-			const u32* c_src = (const u32*)src;
-			u32* c_dst = (u32*)dst;
-			for (u32 j = 0; j < size; ++j) *c_dst++ = re32(*c_src++);
-			break;
-		}
-		}
-	}
+	ConvertVertexData(&data[start * tsize * size], vm::get_ptr<const u8>(addr + baseOffset + stride * (start + baseIndex)), count, stride, tsize, size);
 }
 
 u32 RSXVertexData::GetTypeSize()
 {
-	switch (type)
-	{
-	case CELL_GCM_VERTEX_S1:    return 2;
-	case CELL_GCM_VERTEX_F:     return 4;
-	case CELL_GCM_VERTEX_SF:    return 2;
-	case CELL_GCM_VERTEX_UB:    return 1;
-	case CELL_GCM_VERTEX_S32K:  return 2;
-	case CELL_GCM_VERTEX_CMP:   return 4;
-	case CELL_GCM_VERTEX_UB256: return 1;
-
-	default:
-		LOG_ERROR(RSX, "RSXVertexData::GetTypeSize: Bad vertex data type (%d)!", type);
-		return 1;
-	}
+	return GetVertexTypeSize(type);
 }
 
 u32 RSXThread::OutOfArgsCount(const uint x, const u32 cmd, const u32 count, const u32 args_addr)
@@ -218,7 +177,7 @@ void RSXThread::DoCmd(const u32 fcmd, const u32 cmd, const u32 args_addr, const
 
 	u32 index = 0;
 
-	m_used_gcm_commands.insert(cmd);
+	m_used_gcm_commands.set(cmd);
 
 	switch (cmd)
 	{
@@ -262,6 +221,7 @@ void RSXThread::DoCmd(const u32 fcmd, const u32 cmd, const u32 args_addr, const
 		{
 			m_set_semaphore_offset = false;
 			vm::write32(m_label_addr + m_semaphore_offset, ARGS(0));
+			waiter_map_t::notify_line(m_label_addr + m_semaphore_offset);
 		}
 		break;
 	}
@@ -275,6 +235,7 @@ void RSXThread::DoCmd(const u32 fcmd, const u32 cmd, const u32 args_addr, const
 			value = (value & 0xff00ff00) | ((value & 0xff) << 16) | ((value >> 16) & 0xff);
 
 			vm::write32(m_label_addr + m_semaphore_offset, value);
+			waiter_map_t::notify_line(m_label_addr + m_semaphore_offset);
 		}
 		break;
 	}
@@ -1834,6 +1795,7 @@ void RSXThread::DoCmd(const u32 fcmd, const u32 cmd, const u32 args_addr, const
 		vm::write64(m_local_mem_addr + offset + 0x0, timestamp);
 		vm::write32(m_local_mem_addr + offset + 0x8, value);
 		vm::write32(m_local_mem_addr + offset + 0xc, 0);
+		waiter_map_t::notify_range(m_local_mem_addr + offset, 16);
 		break;
 	}
 
@@ -1964,6 +1926,7 @@ void RSXThread::DoCmd(const u32 fcmd, const u32 cmd, const u32 args_addr, const
 		if (lineCount == 1 && !inPitch && !outPitch && !notify)
 		{
 			memcpy(vm::get_ptr<void>(GetAddress(outOffset, 0)), vm::get_ptr<void>(GetAddress(inOffset, 0)), lineLength);
+			OnMemoryWritten(GetAddress(outOffset, 0), lineLength);
 		}
 		else
 		{
@@ -2196,7 +2159,8 @@ void RSXThread::DoCmd(const u32 fcmd, const u32 cmd, const u32 args_addr, const
 		const u16 v = ARGS(3) >> 16; // inY (currently ignored)
 
 		u8* pixels_src = vm::get_ptr<u8>(GetAddress(offset, m_context_dma_img_src - 0xfeed0000));
-		u8* pixels_dst = vm::get_ptr<u8>(GetAddress(m_dst_offset, m_context_dma_img_dst - 0xfeed0000));
+		const u32 dst_addr = GetAddress(m_dst_offset, m_context_dma_img_dst - 0xfeed0000);
+		u8* pixels_dst = vm::get_ptr<u8>(dst_addr);
 
 		if (m_context_surface == CELL_GCM_CONTEXT_SWIZZLE2D)
 		{
@@ -2278,10 +2242,13 @@ void RSXThread::DoCmd(const u32 fcmd, const u32 cmd, const u32 args_addr, const
 					}
 				}
 			}
+
+			OnMemoryWritten(dst_addr, m_color_conv_out_w * m_color_conv_out_h * out_bpp);
 		}
 		else
 		{
 			memcpy(pixels_dst, pixels_src, out_w * out_h * out_bpp);
+			OnMemoryWritten(dst_addr, out_w * out_h * out_bpp);
 		}
 
 		break;
@@ -2466,7 +2433,6 @@ void RSXThread::End()
 
 void RSXThread::Task()
 {
-	u8 inc;
 	LOG_NOTICE(RSX, "RSX thread started");
 
 	OnInitThread();
@@ -2500,6 +2466,35 @@ void RSXThread::Task()
 		}
 	});
 
+	// cached translation of the current command buffer page
+	u32 fifo_page = ~0;
+	const be_t<u32>* fifo_ptr = nullptr;
+
+	auto fetch = [&](u32 addr) -> u32
+	{
+		if (addr >> 12 != fifo_page)
+		{
+			u32 real_addr;
+
+			if (!Memory.RSXIOMem.getRealAddr(addr & ~0xfff, real_addr))
+			{
+				throw fmt::Format("RSX FIFO: RSXIO memory not mapped (addr=0x%x)", addr);
+			}
+
+			fifo_page = addr >> 12;
+			fifo_ptr = vm::get_ptr<const be_t<u32>>(real_addr);
+		}
+
+		return fifo_ptr[(addr & 0xfff) / 4];
+	};
+
+	const u64 fifo_start_time = get_system_time();
+	u64 fifo_batches = 0;
+
+	m_fifo_cmd_count = 0;
+
+	u32 last_put = ~0;
+
 	while (!TestDestroy()) try
 	{
 		if (Emu.IsStopped())
@@ -2509,10 +2504,8 @@ void RSXThread::Task()
 		}
 		std::lock_guard<std::mutex> lock(m_cs_main);
 
-		inc = 1;
-
 		u32 get = m_ctrl->get.read_sync();
-		u32 put = m_ctrl->put.read_sync();
+		const u32 put = m_ctrl->put.read_sync();
 
 		if (put == get || !Emu.IsRunning())
 		{
@@ -2528,65 +2521,81 @@ void RSXThread::Task()
 			continue;
 		}
 
-		const u32 cmd = ReadIO32(get);
-		const u32 count = (cmd >> 18) & 0x7ff;
+		// the mapping could be changed while the FIFO was idle
+		fifo_page = ~0;
 
-		if (Ini.RSXLogging.GetValue())
-		{
-			LOG_NOTICE(Log::RSX, "%s (cmd=0x%x)", GetMethodName(cmd & 0xffff).c_str(), cmd);
-		}
-	
-		if (cmd & CELL_GCM_METHOD_FLAG_JUMP)
+		if (put != last_put)
 		{
-			u32 offs = cmd & 0x1fffffff;
-			//LOG_WARNING(RSX, "rsx jump(0x%x) #addr=0x%x, cmd=0x%x, get=0x%x, put=0x%x", offs, m_ioAddress + get, cmd, get, put);
-			m_ctrl->get.exchange(be_t<u32>::make(offs));
-			continue;
-		}
-		if (cmd & CELL_GCM_METHOD_FLAG_CALL)
-		{
-			m_call_stack.push(get + 4);
-			u32 offs = cmd & ~3;
-			//LOG_WARNING(RSX, "rsx call(0x%x) #0x%x - 0x%x", offs, cmd, get);
-			m_ctrl->get.exchange(be_t<u32>::make(offs));
-			continue;
-		}
-		if (cmd == CELL_GCM_METHOD_FLAG_RETURN)
-		{
-			u32 get = m_call_stack.top();
-			m_call_stack.pop();
-			//LOG_WARNING(RSX, "rsx return(0x%x)", get);
-			m_ctrl->get.exchange(be_t<u32>::make(get));
-			continue;
-		}
-		if (cmd & CELL_GCM_METHOD_FLAG_NON_INCREMENT)
-		{
-			//LOG_WARNING(RSX, "rsx non increment cmd! 0x%x", cmd);
-			inc = 0;
+			last_put = put;
+			OnCommandsSubmitted();
 		}
 
-		if (cmd == 0) //nop
+		// process commands up to the current put pointer, get pointer is published once per batch
+		for (u32 n = 0; get != put && n < 4096 && !Emu.IsStopped(); n++)
 		{
-			m_ctrl->get.atomic_op([](be_t<u32>& value)
+			const u32 cmd = fetch(get);
+			const u32 count = (cmd >> 18) & 0x7ff;
+
+			if (Ini.RSXLogging.GetValue())
 			{
-				value += 4;
-			});
-			continue;
-		}
+				LOG_NOTICE(Log::RSX, "%s (cmd=0x%x)", GetMethodName(cmd & 0xffff).c_str(), cmd);
+			}
 
-		auto args = vm::ptr<u32>::make((u32)Memory.RSXIOMem.RealAddr(get + 4));
+			if (cmd & CELL_GCM_METHOD_FLAG_JUMP)
+			{
+				u32 offs = cmd & 0x1fffffff;
+				//LOG_WARNING(RSX, "rsx jump(0x%x) #addr=0x%x, cmd=0x%x, get=0x%x, put=0x%x", offs, m_ioAddress + get, cmd, get, put);
 
-		for (u32 i = 0; i < count; i++)
-		{
-			methodRegisters[(cmd & 0xffff) + (i * 4 * inc)] = ARGS(i);
-		}
+				if (offs == get)
+				{
+					break; // jump to itself, let PPU see the current position
+				}
 
-		DoCmd(cmd, cmd & 0x3ffff, args.addr(), count);
+				get = offs;
+				continue;
+			}
+			if (cmd & CELL_GCM_METHOD_FLAG_CALL)
+			{
+				m_call_stack.push(get + 4);
+				u32 offs = cmd & ~3;
+				//LOG_WARNING(RSX, "rsx call(0x%x) #0x%x - 0x%x", offs, cmd, get);
+				get = offs;
+				continue;
+			}
+			if (cmd == CELL_GCM_METHOD_FLAG_RETURN)
+			{
+				get = m_call_stack.top();
+				m_call_stack.pop();
+				//LOG_WARNING(RSX, "rsx return(0x%x)", get);
+				continue;
+			}
 
-		m_ctrl->get.atomic_op([count](be_t<u32>& value)
-		{
-			value += (count + 1) * 4;
-		});
+			if (cmd == 0) //nop
+			{
+				get += 4;
+				continue;
+			}
+
+			const u32 inc = cmd & CELL_GCM_METHOD_FLAG_NON_INCREMENT ? 0 : 4;
+			const u32 reg = cmd & 0xffff;
+
+			// arguments are located after the command header
+			const u32 args_addr = (u32)Memory.RSXIOMem.RealAddr(get + 4);
+			const be_t<u32>* args = vm::get_ptr<const be_t<u32>>(args_addr);
+
+			for (u32 i = 0; i < count; i++)
+			{
+				methodRegisters[reg + i * inc] = args[i];
+			}
+
+			DoCmd(cmd, cmd & 0x3ffff, args_addr, count);
+
+			get += (count + 1) * 4;
+			m_fifo_cmd_count++;
+		}
+
+		m_ctrl->get.exchange(be_t<u32>::make(get));
+		fifo_batches++;
 	}
 	catch (const std::string& e)
 	{
@@ -2599,6 +2608,9 @@ void RSXThread::Task()
 		Emu.Pause();
 	}
 
+	const double fifo_time = (get_system_time() - fifo_start_time) / 1000000.0;
+
+	LOG_NOTICE(RSX, "RSX FIFO: %lld commands in %lld batches, %.0f commands/s", m_fifo_cmd_count, fifo_batches, fifo_time ? m_fifo_cmd_count / fifo_time : 0.0);
 	LOG_NOTICE(RSX, "RSX thread ended");
 
 	OnExitThread();
@@ -2616,7 +2628,7 @@ void RSXThread::Init(const u32 ioAddress, const u32 ioSize, const u32 ctrlAddres
 	m_cur_fragment_prog = nullptr;
 	m_cur_fragment_prog_num = 0;
 
-	m_used_gcm_commands.clear();
+	m_used_gcm_commands.reset();
 
 	OnInit();
 	ThreadBase::Start();
@@ -5,6 +5,7 @@
 #include "RSXFragmentProgram.h"
 
 #include <stack>
+#include <bitset>
 #include "Utilities/SSemaphore.h"
 #include "Utilities/Thread.h"
 #include "Utilities/Timer.h"
@@ -442,7 +443,9 @@ public:
 	u8 m_begin_end;
 	bool m_read_buffer;
 
-	std::set<u32> m_used_gcm_commands;
+	std::bitset<0x40000> m_used_gcm_commands;
+
+	u64 m_fifo_cmd_count; // methods executed by the FIFO front-end
 
 protected:
 	RSXThread()
@@ -649,7 +652,18 @@ protected:
 	virtual void ExecCMD(u32 cmd) = 0;
 	virtual void Flip() = 0;
 
-	void LoadVertexData(u32 first, u32 count)
+	// guest memory was written by a transfer method (NV0039, NV3089)
+	virtual void OnMemoryWritten(u32 addr, u32 size)
+	{
+	}
+
+	// the PPU has submitted new commands, memory they use may have been written before
+	virtual void OnCommandsSubmitted()
+	{
+	}
+
+	// convert vertex arrays of the draw call into RSXVertexData::data (renderers may fetch them directly instead)
+	virtual void LoadVertexData(u32 first, u32 count)
 	{
 		for (u32 i = 0; i < m_vertex_count; ++i)
 		{
@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "Utilities/Log.h"
+#include "Emu/Memory/Memory.h"
+#include "GCM.h"
+#include "RSXVertexFetch.h"
+
+#include <tmmintrin.h>
+
+//#define RSX_VERTEX_FETCH_BENCHMARK 1
+
+u32 GetVertexTypeSize(u32 type)
+{
+	switch (type)
+	{
+	case CELL_GCM_VERTEX_S1:    return 2;
+	case CELL_GCM_VERTEX_F:     return 4;
+	case CELL_GCM_VERTEX_SF:    return 2;
+	case CELL_GCM_VERTEX_UB:    return 1;
+	case CELL_GCM_VERTEX_S32K:  return 2;
+	case CELL_GCM_VERTEX_CMP:   return 4;
+	case CELL_GCM_VERTEX_UB256: return 1;
+	}
+
+	LOG_ERROR(RSX, "GetVertexTypeSize: Bad vertex data type (%d)!", type);
+	return 1;
+}
+
+namespace
+{
+	__forceinline __m128i get_swap_mask(u32 type_size)
+	{
+		switch (type_size)
+		{
+		case 2: return _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+		case 4: return _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+		}
+
+		return _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	}
+
+	__forceinline void swap_scalar(u8* dst, const u8* src, u32 bytes, u32 type_size)
+	{
+		if (type_size == 1)
+		{
+			memcpy(dst, src, bytes);
+		}
+		else if (type_size == 2)
+		{
+			for (u32 i = 0; i < bytes; i += 2)
+			{
+				*(u16*)(dst + i) = re16(*(const u16*)(src + i));
+			}
+		}
+		else
+		{
+			for (u32 i = 0; i < bytes; i += 4)
+			{
+				*(u32*)(dst + i) = re32(*(const u32*)(src + i));
+			}
+		}
+	}
+}
+
+void ConvertVertexData(u8* dst, const u8* src, u32 count, u32 stride, u32 type_size, u32 size)
+{
+	const u32 elem_size = type_size * size;
+
+	if (!count || !elem_size)
+	{
+		return;
+	}
+
+	if (type_size == 1 && stride == elem_size)
+	{
+		memcpy(dst, src, count * elem_size);
+		return;
+	}
+
+	const __m128i mask = get_swap_mask(type_size);
+
+	// tightly packed stream is swapped as a whole
+	if (stride == elem_size)
+	{
+		const u32 bytes = count * elem_size;
+
+		u32 i = 0;
+
+		for (; i + 16 <= bytes; i += 16)
+		{
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), mask));
+		}
+
+		swap_scalar(dst + i, src + i, bytes - i, type_size);
+		return;
+	}
+
+	// Interleaved stream: every element (up to 16 bytes) is swapped with one shuffle. The excess bytes of 16-byte loads
+	// and stores stay inside of the source range and the destination slot of the next vertex (overwritten on next step).
+	const u32 src_size = stride * (count - 1) + elem_size;
+	const u32 dst_size = elem_size * count;
+
+	u32 i = 0;
+
+	for (; i < count && stride * i + 16 <= src_size && elem_size * i + 16 <= dst_size; i++)
+	{
+		_mm_storeu_si128((__m128i*)(dst + elem_size * i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + stride * i)), mask));
+	}
+
+	for (; i < count; i++)
+	{
+		swap_scalar(dst + elem_size * i, src + stride * i, elem_size, type_size);
+	}
+}
+
+void VertexFetchBenchmark()
+{
+#ifdef RSX_VERTEX_FETCH_BENCHMARK
+	const u32 count = 1 << 20; // vertices
+	const u32 repeat = 16;
+	const u32 size = 4; // components
+
+	static const char* const type_names[] = { "S1", "F", "SF", "UB", "S32K", "CMP", "UB256" };
+
+	std::vector<u8> src(count * 32);
+	std::vector<u8> dst(count * 16);
+	std::vector<u8> ref(count * 16);
+
+	std::mt19937 rng(0);
+
+	for (auto& v : src)
+	{
+		v = (u8)rng();
+	}
+
+	for (u32 type = CELL_GCM_VERTEX_S1; type <= CELL_GCM_VERTEX_UB256; type++)
+	{
+		const u32 tsize = GetVertexTypeSize(type);
+
+		for (u32 stride : { tsize * size, 32u })
+		{
+			// previous implementation of RSXVertexData::Load
+			auto start = std::chrono::high_resolution_clock::now();
+
+			for (u32 r = 0; r < repeat; r++)
+			{
+				for (u32 i = 0; i < count; ++i)
+				{
+					const u8* s = &src[stride * i];
+					u8* d = &ref[i * tsize * size];
+
+					switch (tsize)
+					{
+					case 1: memcpy(d, s, size); break;
+					case 2: for (u32 j = 0; j < size; ++j) ((u16*)d)[j] = re16(((const u16*)s)[j]); break;
+					case 4: for (u32 j = 0; j < size; ++j) ((u32*)d)[j] = re32(((const u32*)s)[j]); break;
+					}
+				}
+			}
+
+			const auto ref_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+			start = std::chrono::high_resolution_clock::now();
+
+			for (u32 r = 0; r < repeat; r++)
+			{
+				ConvertVertexData(dst.data(), src.data(), count, stride, tsize, size);
+			}
+
+			const auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+			if (memcmp(dst.data(), ref.data(), count * tsize * size))
+			{
+				LOG_ERROR(RSX, "Vertex fetch benchmark: %s (stride %d): result mismatch", type_names[type - 1], stride);
+			}
+
+			LOG_NOTICE(RSX, "Vertex fetch benchmark: %s x%d (stride %d): reference %.1f Mvertices/s, optimized %.1f Mvertices/s", type_names[type - 1], size, stride,
+				ref_time ? (double)count * repeat / ref_time : 0.0, time ? (double)count * repeat / time : 0.0);
+		}
+	}
+#endif
+}
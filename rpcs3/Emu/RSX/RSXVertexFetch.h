@@ -0,0 +1,12 @@
+#pragma once
+
+// Conversion of RSX vertex attribute streams to host layout (renderer-independent)
+
+// size of one component of CELL_GCM_VERTEX_* type in bytes
+u32 GetVertexTypeSize(u32 type);
+
+// convert count vertices (big-endian components, given stride) to tightly packed little-endian elements
+void ConvertVertexData(u8* dst, const u8* src, u32 count, u32 stride, u32 type_size, u32 size);
+
+// measure vertices per second for each vertex type and compare results with the reference implementation (enabled by RSX_VERTEX_FETCH_BENCHMARK)
+void VertexFetchBenchmark();
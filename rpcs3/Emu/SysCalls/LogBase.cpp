@@ -9,17 +9,24 @@ bool LogBase::CheckLogging() const
 	return Ini.HLELogging.GetValue() || m_logging;
 }
 
+const LogBase::LogTypeInfo LogBase::s_log_types[] =
+{
+	{ Log::LogSeverityNotice, ": " }, // LogNotice
+	{ Log::LogSeveritySuccess, ": " }, // LogSuccess
+	{ Log::LogSeverityWarning, ": " }, // LogWarning
+	{ Log::LogSeverityError, " error: " }, // LogError
+	{ Log::LogSeverityError, " error: " }, // LogFatal
+	{ Log::LogSeverityError, " TODO: " }, // LogTodo
+};
+
 void LogBase::LogOutput(LogType type, const std::string& text) const
 {
-	switch (type)
+	if (type == LogFatal)
 	{
-	case LogNotice: LOG_NOTICE(HLE, GetName() + ": " + text); break;
-	case LogSuccess: LOG_SUCCESS(HLE, GetName() + ": " + text); break;
-	case LogWarning: LOG_WARNING(HLE, GetName() + ": " + text); break;
-	case LogError: LOG_ERROR(HLE, GetName() + " error: " + text); break;
-	case LogTodo: LOG_ERROR(HLE, GetName() + " TODO: " + text); break;
-	case LogFatal: throw GetName() + " error: " + text;
+		throw GetName() + s_log_types[type].separator + text;
 	}
+
+	log_message(Log::HLE, s_log_types[type].severity, GetName() + s_log_types[type].separator + text);
 }
 
 hle::error::error(s32 errorCode, const char* errorText)
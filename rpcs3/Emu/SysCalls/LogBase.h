@@ -1,4 +1,5 @@
 #pragma once
+#include "Utilities/Log.h"
 
 class LogBase
 {
@@ -15,12 +16,29 @@ class LogBase
 		LogTodo,
 	};
 
+	// severity and separator between the module name and the text, indexed by LogType
+	struct LogTypeInfo
+	{
+		Log::LogSeverity severity;
+		const char* separator;
+	};
+
+	static const LogTypeInfo s_log_types[];
+
 	void LogOutput(LogType type, const std::string& text) const;
 
 	template<typename... Targs>
 	__noinline void LogPrepare(LogType type, const char* fmt, Targs... args) const
 	{
-		LogOutput(type, fmt::Format(fmt, args...));
+		// formatting is deferred to the log consumer thread (fatal errors throw the formatted text)
+		if (type == LogFatal)
+		{
+			LogOutput(type, fmt::Format(fmt, args...));
+		}
+		else
+		{
+			log_record_prefixed(Log::HLE, s_log_types[type].severity, GetName().c_str(), s_log_types[type].separator, fmt, args...);
+		}
 	}
 
 public:
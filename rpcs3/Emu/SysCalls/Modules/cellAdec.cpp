@@ -573,6 +573,7 @@ s32 cellAdecClose(u32 handle)
 
 	adec->is_closed = true;
 	adec->job.try_push(AdecTask(adecClose));
+	squeue_notify_all(); // wake threads waiting in the queues
 
 	while (!adec->is_finished)
 	{
@@ -424,6 +424,9 @@ s32 cellAudioInit()
 			//LOG_NOTICE(HLE, "Audio perf: start=%d (access=%d, AddData=%d, events=%d, dump=%d)",
 			//stamp0 - m_config.start_time, stamp1 - stamp0, stamp2 - stamp1, stamp3 - stamp2, get_system_time() - stamp3);
 		}
+
+		// wake the internal audio thread (its exit condition is met)
+		out_queue.notify();
 	});
 
 	return CELL_OK;
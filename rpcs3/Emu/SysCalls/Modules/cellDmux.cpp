@@ -868,6 +868,7 @@ s32 cellDmuxClose(u32 handle)
 
 	dmux->is_closed = true;
 	dmux->job.try_push(DemuxerTask(dmuxClose));
+	squeue_notify_all(); // wake threads waiting in the queues
 
 	while (!dmux->is_finished)
 	{
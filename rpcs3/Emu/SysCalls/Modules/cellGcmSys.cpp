@@ -1104,6 +1104,7 @@ s32 _cellGcmSetFlipCommandWithWaitLabel(vm::ptr<CellGcmContextData> ctx, u32 id,
 
 	s32 res = cellGcmSetPrepareFlip(ctx, id);
 	vm::write32(gcm_info.label_addr + 0x10 * label_index, label_value);
+	waiter_map_t::notify_line(gcm_info.label_addr + 0x10 * label_index);
 	return res < 0 ? CELL_GCM_ERROR_FAILURE : CELL_OK;
 }
 
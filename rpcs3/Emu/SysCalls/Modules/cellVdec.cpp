@@ -598,6 +598,7 @@ s32 cellVdecClose(u32 handle)
 
 	vdec->is_closed = true;
 	vdec->job.try_push(VdecTask(vdecClose));
+	squeue_notify_all(); // wake threads waiting in the queues
 
 	while (!vdec->is_finished)
 	{
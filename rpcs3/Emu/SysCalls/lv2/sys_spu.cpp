@@ -652,6 +652,8 @@ s32 sys_spu_thread_write_ls(u32 id, u32 address, u64 value, u32 type)
 	default: return CELL_EINVAL;
 	}
 
+	spu.mark_ls_dirty(address, type);
+
 	return CELL_OK;
 }
 
@@ -23,6 +23,8 @@
 #include "Emu/Io/Keyboard.h"
 #include "Emu/Io/Mouse.h"
 #include "Emu/RSX/GSManager.h"
+#include "Emu/RSX/RSXTextureDecode.h"
+#include "Emu/RSX/RSXVertexFetch.h"
 #include "Emu/Audio/AudioManager.h"
 #include "Emu/FS/VFS.h"
 #include "Emu/Event.h"
@@ -361,6 +363,10 @@ void Emulator::Stop()
 
 	m_status = Stopped;
 
+	// wake threads parked in waiter_map_t::wait_op() and squeue_t
+	waiter_map_t::notify_all();
+	squeue_notify_all();
+
 	{
 		auto threads = GetCPU().GetThreads();
 
@@ -377,6 +383,12 @@ void Emulator::Stop()
 
 	LOG_NOTICE(HLE, "All threads stopped...");
 
+	{
+		const auto stats = waiter_map_t::get_stats();
+
+		LOG_NOTICE(HLE, "Waiters: parked=%lld, woken=%lld, spurious=%lld, timeouts=%lld, average latency=%lld ns", stats.parked, stats.woken, stats.spurious, stats.timeouts, stats.woken ? stats.latency / stats.woken : 0);
+	}
+
 	finalize_psv_modules();
 	clear_all_psv_objects();
 
@@ -399,6 +411,7 @@ void Emulator::Stop()
 	GetAudioManager().Close();
 	GetEventManager().Clear();
 	GetCPU().Close();
+	spu_recompiler_cache_clear();
 	GetIdManager().Clear();
 	GetPadManager().Close();
 	GetKeyboardManager().Close();
@@ -414,6 +427,22 @@ void Emulator::Stop()
 	SendDbgCommand(DID_STOPPED_EMU);
 }
 
+void Emulator::RunBenchmarks()
+{
+	if (!IsStopped())
+	{
+		LOG_ERROR(GENERAL, "Benchmarks can only be run while the emulator is stopped");
+		return;
+	}
+
+	squeue_benchmark();
+	vm::reservation_benchmark();
+	vm::huge_pages_benchmark();
+	AllocationBenchmark();
+	TextureDecodeBenchmark();
+	VertexFetchBenchmark();
+}
+
 void Emulator::SavePoints(const std::string& path)
 {
 	std::ofstream f(path, std::ios::binary | std::ios::trunc);
@@ -187,6 +187,9 @@ public:
 	void Resume();
 	void Stop();
 
+	// run the micro benchmarks compiled in with their *_BENCHMARK macros (only while stopped)
+	void RunBenchmarks();
+
 	void SavePoints(const std::string& path);
 	void LoadPoints(const std::string& path);
 
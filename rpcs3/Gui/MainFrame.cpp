@@ -373,12 +373,14 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	// CPU/SPU settings
 	wxStaticBoxSizer* s_round_cpu_decoder = new wxStaticBoxSizer(wxVERTICAL, p_cpu, _("CPU"));
 	wxStaticBoxSizer* s_round_spu_decoder = new wxStaticBoxSizer(wxVERTICAL, p_cpu, _("SPU"));
+	wxStaticBoxSizer* s_round_cpu_reservation = new wxStaticBoxSizer(wxVERTICAL, p_cpu, _("Reservations"));
 
 	// Graphics
 	wxStaticBoxSizer* s_round_gs_render = new wxStaticBoxSizer(wxVERTICAL, p_graphics, _("Render"));
 	wxStaticBoxSizer* s_round_gs_res    = new wxStaticBoxSizer(wxVERTICAL, p_graphics, _("Default resolution"));
 	wxStaticBoxSizer* s_round_gs_aspect = new wxStaticBoxSizer(wxVERTICAL, p_graphics, _("Default aspect ratio"));
 	wxStaticBoxSizer* s_round_gs_frame_limit = new wxStaticBoxSizer(wxVERTICAL, p_graphics, _("Frame limit"));
+	wxStaticBoxSizer* s_round_gs_decompiler = new wxStaticBoxSizer(wxVERTICAL, p_graphics, _("Shader decompiler"));
 
 	// Input / Output
 	wxStaticBoxSizer* s_round_io_pad_handler      = new wxStaticBoxSizer(wxVERTICAL, p_io, _("Pad Handler"));
@@ -400,10 +402,12 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 
 	wxComboBox* cbox_cpu_decoder      = new wxComboBox(p_cpu, wxID_ANY);
 	wxComboBox* cbox_spu_decoder      = new wxComboBox(p_cpu, wxID_ANY);
+	wxComboBox* cbox_cpu_reservation  = new wxComboBox(p_cpu, wxID_ANY);
 	wxComboBox* cbox_gs_render        = new wxComboBox(p_graphics, wxID_ANY);
 	wxComboBox* cbox_gs_resolution    = new wxComboBox(p_graphics, wxID_ANY);
 	wxComboBox* cbox_gs_aspect        = new wxComboBox(p_graphics, wxID_ANY);
 	wxComboBox* cbox_gs_frame_limit   = new wxComboBox(p_graphics, wxID_ANY);
+	wxComboBox* cbox_gs_decompiler    = new wxComboBox(p_graphics, wxID_ANY);
 	wxComboBox* cbox_pad_handler      = new wxComboBox(p_io, wxID_ANY);
 	wxComboBox* cbox_keyboard_handler = new wxComboBox(p_io, wxID_ANY);
 	wxComboBox* cbox_mouse_handler    = new wxComboBox(p_io, wxID_ANY);
@@ -413,12 +417,14 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	wxComboBox* cbox_hle_loglvl       = new wxComboBox(p_hle, wxID_ANY);
 	wxComboBox* cbox_sys_lang         = new wxComboBox(p_system, wxID_ANY);
 
+	wxCheckBox* chbox_cpu_huge_pages      = new wxCheckBox(p_cpu, wxID_ANY, "Use huge pages for guest memory");
 	wxCheckBox* chbox_gs_log_prog         = new wxCheckBox(p_graphics, wxID_ANY, "Log vertex/fragment programs");
 	wxCheckBox* chbox_gs_dump_depth       = new wxCheckBox(p_graphics, wxID_ANY, "Write Depth Buffer");
 	wxCheckBox* chbox_gs_dump_color       = new wxCheckBox(p_graphics, wxID_ANY, "Write Color Buffers");
 	wxCheckBox* chbox_gs_read_color       = new wxCheckBox(p_graphics, wxID_ANY, "Read Color Buffer");
 	wxCheckBox* chbox_gs_vsync            = new wxCheckBox(p_graphics, wxID_ANY, "VSync");
 	wxCheckBox* chbox_gs_3dmonitor        = new wxCheckBox(p_graphics, wxID_ANY, "3D Monitor");
+	wxCheckBox* chbox_gs_shader_cache     = new wxCheckBox(p_graphics, wxID_ANY, "Use shader cache");
 	wxCheckBox* chbox_audio_dump          = new wxCheckBox(p_audio, wxID_ANY, "Dump to file");
 	wxCheckBox* chbox_audio_conv          = new wxCheckBox(p_audio, wxID_ANY, "Convert to 16 bit");
 	wxCheckBox* chbox_hle_logging         = new wxCheckBox(p_hle, wxID_ANY, "Log all SysCalls");
@@ -444,6 +450,9 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	cbox_spu_decoder->Append("SPU Interpreter 2");
 	cbox_spu_decoder->Append("SPU JIT (ASMJIT)");
 
+	cbox_cpu_reservation->Append("Page protection");
+	cbox_cpu_reservation->Append("Version stamps");
+
 	cbox_gs_render->Append("Null");
 	cbox_gs_render->Append("OpenGL");
 	//cbox_gs_render->Append("Software");
@@ -459,6 +468,10 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	for (auto item : { "Off", "50", "59.94", "30", "60", "Auto" })
 		cbox_gs_frame_limit->Append(item);
 
+	cbox_gs_decompiler->Append("Synchronous");
+	cbox_gs_decompiler->Append("Asynchronous (skip draws)");
+	cbox_gs_decompiler->Append("Asynchronous (fallback shader)");
+
 	cbox_pad_handler->Append("Null");
 	cbox_pad_handler->Append("Windows");
 #if defined (_WIN32)
@@ -514,12 +527,14 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	cbox_sys_lang->Append("English (UK)");
 
 	// Get values from .ini
+	chbox_cpu_huge_pages     ->SetValue(Ini.CPUHugePages.GetValue());
 	chbox_gs_log_prog        ->SetValue(Ini.GSLogPrograms.GetValue());
 	chbox_gs_dump_depth      ->SetValue(Ini.GSDumpDepthBuffer.GetValue());
 	chbox_gs_dump_color      ->SetValue(Ini.GSDumpColorBuffers.GetValue());
 	chbox_gs_read_color      ->SetValue(Ini.GSReadColorBuffer.GetValue());
 	chbox_gs_vsync           ->SetValue(Ini.GSVSyncEnable.GetValue());
 	chbox_gs_3dmonitor       ->SetValue(Ini.GS3DTV.GetValue());
+	chbox_gs_shader_cache    ->SetValue(Ini.GSShaderCache.GetValue());
 	chbox_audio_dump         ->SetValue(Ini.AudioDumpToFile.GetValue());
 	chbox_audio_conv         ->SetValue(Ini.AudioConvertToU16.GetValue());
 	chbox_hle_logging        ->SetValue(Ini.HLELogging.GetValue());
@@ -539,10 +554,12 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 
 	cbox_cpu_decoder     ->SetSelection(Ini.CPUDecoderMode.GetValue() ? Ini.CPUDecoderMode.GetValue() : 0);
 	cbox_spu_decoder     ->SetSelection(Ini.SPUDecoderMode.GetValue() ? Ini.SPUDecoderMode.GetValue() : 0);
+	cbox_cpu_reservation ->SetSelection(Ini.CPUReservationMode.GetValue());
 	cbox_gs_render       ->SetSelection(Ini.GSRenderMode.GetValue());
 	cbox_gs_resolution   ->SetSelection(ResolutionIdToNum(Ini.GSResolution.GetValue()) - 1);
 	cbox_gs_aspect       ->SetSelection(Ini.GSAspectRatio.GetValue() - 1);
 	cbox_gs_frame_limit  ->SetSelection(Ini.GSFrameLimit.GetValue());
+	cbox_gs_decompiler   ->SetSelection(Ini.GSShaderDecompiler.GetValue());
 	cbox_pad_handler     ->SetSelection(Ini.PadHandlerMode.GetValue());
 	cbox_keyboard_handler->SetSelection(Ini.KeyboardHandlerMode.GetValue());
 	cbox_mouse_handler   ->SetSelection(Ini.MouseHandlerMode.GetValue());
@@ -554,11 +571,13 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	
 	s_round_cpu_decoder->Add(cbox_cpu_decoder, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_round_spu_decoder->Add(cbox_spu_decoder, wxSizerFlags().Border(wxALL, 5).Expand());
+	s_round_cpu_reservation->Add(cbox_cpu_reservation, wxSizerFlags().Border(wxALL, 5).Expand());
 
 	s_round_gs_render->Add(cbox_gs_render, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_round_gs_res->Add(cbox_gs_resolution, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_round_gs_aspect->Add(cbox_gs_aspect, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_round_gs_frame_limit->Add(cbox_gs_frame_limit, wxSizerFlags().Border(wxALL, 5).Expand());
+	s_round_gs_decompiler->Add(cbox_gs_decompiler, wxSizerFlags().Border(wxALL, 5).Expand());
 
 	s_round_io_pad_handler->Add(cbox_pad_handler, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_round_io_keyboard_handler->Add(cbox_keyboard_handler, wxSizerFlags().Border(wxALL, 5).Expand());
@@ -576,18 +595,22 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	// Core
 	s_subpanel_cpu->Add(s_round_cpu_decoder, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_cpu->Add(s_round_spu_decoder, wxSizerFlags().Border(wxALL, 5).Expand());
+	s_subpanel_cpu->Add(s_round_cpu_reservation, wxSizerFlags().Border(wxALL, 5).Expand());
+	s_subpanel_cpu->Add(chbox_cpu_huge_pages, wxSizerFlags().Border(wxALL, 5).Expand());
 
 	// Graphics
 	s_subpanel_graphics->Add(s_round_gs_render, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(s_round_gs_res, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(s_round_gs_aspect, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(s_round_gs_frame_limit, wxSizerFlags().Border(wxALL, 5).Expand());
+	s_subpanel_graphics->Add(s_round_gs_decompiler, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(chbox_gs_log_prog, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(chbox_gs_dump_depth, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(chbox_gs_dump_color, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(chbox_gs_read_color, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(chbox_gs_vsync, wxSizerFlags().Border(wxALL, 5).Expand());
 	s_subpanel_graphics->Add(chbox_gs_3dmonitor, wxSizerFlags().Border(wxALL, 5).Expand());
+	s_subpanel_graphics->Add(chbox_gs_shader_cache, wxSizerFlags().Border(wxALL, 5).Expand());
 
 	// Input - Output
 	s_subpanel_io->Add(s_round_io_pad_handler, wxSizerFlags().Border(wxALL, 5).Expand());
@@ -644,16 +667,20 @@ void MainFrame::Config(wxCommandEvent& WXUNUSED(event))
 	{
 		Ini.CPUDecoderMode.SetValue(cbox_cpu_decoder->GetSelection());
 		Ini.SPUDecoderMode.SetValue(cbox_spu_decoder->GetSelection());
+		Ini.CPUReservationMode.SetValue(cbox_cpu_reservation->GetSelection());
+		Ini.CPUHugePages.SetValue(chbox_cpu_huge_pages->GetValue());
 		Ini.GSRenderMode.SetValue(cbox_gs_render->GetSelection());
 		Ini.GSResolution.SetValue(ResolutionNumToId(cbox_gs_resolution->GetSelection() + 1));
 		Ini.GSAspectRatio.SetValue(cbox_gs_aspect->GetSelection() + 1);
 		Ini.GSFrameLimit.SetValue(cbox_gs_frame_limit->GetSelection());
+		Ini.GSShaderDecompiler.SetValue(cbox_gs_decompiler->GetSelection());
 		Ini.GSLogPrograms.SetValue(chbox_gs_log_prog->GetValue());
 		Ini.GSDumpDepthBuffer.SetValue(chbox_gs_dump_depth->GetValue());
 		Ini.GSDumpColorBuffers.SetValue(chbox_gs_dump_color->GetValue());
 		Ini.GSReadColorBuffer.SetValue(chbox_gs_read_color->GetValue());
 		Ini.GSVSyncEnable.SetValue(chbox_gs_vsync->GetValue());
 		Ini.GS3DTV.SetValue(chbox_gs_3dmonitor->GetValue());
+		Ini.GSShaderCache.SetValue(chbox_gs_shader_cache->GetValue());
 		Ini.PadHandlerMode.SetValue(cbox_pad_handler->GetSelection());
 		Ini.KeyboardHandlerMode.SetValue(cbox_keyboard_handler->GetSelection());
 		Ini.MouseHandlerMode.SetValue(cbox_mouse_handler->GetSelection());
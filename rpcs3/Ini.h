@@ -93,6 +93,8 @@ public:
 	// Core
 	IniEntry<u8> CPUDecoderMode;
 	IniEntry<u8> SPUDecoderMode;
+	IniEntry<u8> CPUReservationMode;
+	IniEntry<bool> CPUHugePages;
 
 	// Graphics
 	IniEntry<u8> GSRenderMode;
@@ -105,6 +107,8 @@ public:
 	IniEntry<bool> GSReadColorBuffer;
 	IniEntry<bool> GSVSyncEnable;
 	IniEntry<bool> GS3DTV;
+	IniEntry<bool> GSShaderCache;
+	IniEntry<u8> GSShaderDecompiler;
 
 	// Audio
 	IniEntry<u8> AudioOutMode;
@@ -174,6 +178,8 @@ public:
 		// Core
 		CPUDecoderMode.Init("CPU_DecoderMode", path);
 		SPUDecoderMode.Init("CPU_SPUDecoderMode", path);
+		CPUReservationMode.Init("CPU_ReservationMode", path);
+		CPUHugePages.Init("CPU_HugePages", path);
 
 		// Graphics
 		GSRenderMode.Init("GS_RenderMode", path);
@@ -186,6 +192,8 @@ public:
 		GSReadColorBuffer.Init("GS_GSReadColorBuffer", path);
 		GSVSyncEnable.Init("GS_VSyncEnable", path);
 		GS3DTV.Init("GS_3DTV", path);
+		GSShaderCache.Init("GS_ShaderCache", path);
+		GSShaderDecompiler.Init("GS_ShaderDecompiler", path);
 
 		// Audio
 		AudioOutMode.Init("Audio_AudioOutMode", path);
@@ -251,6 +259,8 @@ public:
 		// Core
 		CPUDecoderMode.Load(0);
 		SPUDecoderMode.Load(0);
+		CPUReservationMode.Load(0);
+		CPUHugePages.Load(false);
 
 		// Graphics
 		GSRenderMode.Load(1);
@@ -263,6 +273,8 @@ public:
 		GSReadColorBuffer.Load(false);
 		GSVSyncEnable.Load(false);
 		GS3DTV.Load(false);
+		GSShaderCache.Load(true);
+		GSShaderDecompiler.Load(0);
 
 		// Audio
 		AudioOutMode.Load(1);
@@ -328,6 +340,8 @@ public:
 		// CPU/SPU
 		CPUDecoderMode.Save();
 		SPUDecoderMode.Save();
+		CPUReservationMode.Save();
+		CPUHugePages.Save();
 
 		// Graphics
 		GSRenderMode.Save();
@@ -340,6 +354,8 @@ public:
 		GSReadColorBuffer.Save();
 		GSVSyncEnable.Save();
 		GS3DTV.Save();
+		GSShaderCache.Save();
+		GSShaderDecompiler.Save();
 
 		// Audio 
 		AudioOutMode.Save();
@@ -50,8 +50,9 @@ bool Rpcs3App::OnInit()
 {
 	static const wxCmdLineEntryDesc desc[]
 	{
-		{ wxCMD_LINE_SWITCH, "h", "help", "Command line options:\nh (help): Help and commands\nt (test): For directly executing a (S)ELF", wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+		{ wxCMD_LINE_SWITCH, "h", "help", "Command line options:\nh (help): Help and commands\nt (test): For directly executing a (S)ELF\nb (benchmark): Run the compiled in benchmarks", wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
 		{ wxCMD_LINE_SWITCH, "t", "test", "Run in test mode on (S)ELF", wxCMD_LINE_VAL_NONE },
+		{ wxCMD_LINE_SWITCH, "b", "benchmark", "Run the benchmarks enabled by *_BENCHMARK macros, the results are written to the log", wxCMD_LINE_VAL_NONE },
 		{ wxCMD_LINE_PARAM, NULL, NULL, "(S)ELF", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
 		{ wxCMD_LINE_NONE }
 	};
@@ -167,6 +168,7 @@ void Rpcs3App::OnArguments(const wxCmdLineParser& parser)
 	// Usage:
 	//   rpcs3-*.exe               Initializes RPCS3
 	//   rpcs3-*.exe [(S)ELF]      Initializes RPCS3, then loads and runs the specified (S)ELF file.
+	//   rpcs3-*.exe -b            Initializes RPCS3, then runs the benchmarks compiled in.
 
 	if (parser.FoundSwitch("t"))
 	{
@@ -179,6 +181,11 @@ void Rpcs3App::OnArguments(const wxCmdLineParser& parser)
 		}
 	}
 	
+	if (parser.FoundSwitch("b"))
+	{
+		Emu.RunBenchmarks();
+	}
+
 	if (parser.GetParamCount() > 0)
 	{
 		Emu.SetPath(fmt::ToUTF8(parser.GetParam(0)));